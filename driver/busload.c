@@ -0,0 +1,132 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+
+#include "busload.h"
+
+/*
+ * Bus load per channel.
+ *
+ * Every frame seen on a channel, received or sent by us, adds its wire time
+ * (triple_frame_bits() at the configured bitrates) to the slot of the time
+ * it was seen. The slots form a ring covering the longest window; the load
+ * of a window is the wire time of its complete slots over its length. All
+ * accounting runs on the adapter worker, readers take a racy snapshot.
+ */
+
+extern bool trace_func_main;
+extern void print_func_trace (bool is_trace, int line, const char *func);
+
+static const unsigned int triple_load_windows[] = { 1, 10, TRIPLE_LOAD_SLOTS };
+
+static inline u32 triple_busload_slot (ktime_t now)
+{
+  return (u32) div_u64(ktime_to_ns(now), TRIPLE_LOAD_SLOT_MS * NSEC_PER_MSEC);
+}
+
+int triple_busload_config (USB2CAN_TRIPLE *adapter, const struct triple_bitrate_cfg *cfg)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  TRIPLE_BUSLOAD *bl;
+  u32             data_bps;
+
+  if (cfg->channel > 2 || cfg->nominal_bps > 1000000 || cfg->data_bps > 20000000)
+    return -EINVAL;
+
+  /* below 1 kbit/s a bit time does not fit the u32 ps */
+  if (cfg->nominal_bps && cfg->nominal_bps < 1000)
+    return -EINVAL;
+
+  bl       = &adapter->load[cfg->channel];
+  data_bps = cfg->data_bps ? cfg->data_bps : cfg->nominal_bps;
+
+  WRITE_ONCE(bl->nominal_bps, 0);
+  if (!cfg->nominal_bps)
+    return 0;
+
+  WRITE_ONCE(bl->flags, cfg->exact ? TRIPLE_FT_EXACT : 0);
+  WRITE_ONCE(bl->data_bps, data_bps);
+  WRITE_ONCE(bl->data_ps, (u32) div_u64(1000000000000ULL, data_bps));
+  WRITE_ONCE(bl->nominal_ps, (u32) div_u64(1000000000000ULL, cfg->nominal_bps));
+  smp_wmb();
+  WRITE_ONCE(bl->nominal_bps, cfg->nominal_bps);
+
+  return 0;
+
+} /* END: triple_busload_config() */
+
+// Adapter worker, for every frame decoded or handed to the tty
+void triple_busload_account (USB2CAN_TRIPLE *adapter, int channel, canid_t can_id, const u8 *data, u8 len, u32 flags, ktime_t now)
+{
+  TRIPLE_BUSLOAD *bl = &adapter->load[channel];
+  u32             slot;
+  u32             i;
+
+  if (!READ_ONCE(bl->nominal_bps))
+    return;
+  smp_rmb();
+
+  /* Clear the slots skipped since the last frame */
+  slot = triple_busload_slot(now);
+  if (slot != bl->slot)
+  {
+    if (slot - bl->slot >= TRIPLE_LOAD_SLOTS)
+      memset(bl->ps, 0, sizeof(bl->ps));
+    else
+      for (i = bl->slot + 1; i != slot + 1; i++)
+        bl->ps[i % TRIPLE_LOAD_SLOTS] = 0;
+    bl->slot = slot;
+  }
+
+  bl->ps[slot % TRIPLE_LOAD_SLOTS] += triple_frame_ps(triple_frame_bits(can_id, data, len, flags | READ_ONCE(bl->flags)),
+                                                      READ_ONCE(bl->nominal_ps), READ_ONCE(bl->data_ps));
+
+} /* END: triple_busload_account() */
+
+void triple_busload_show (USB2CAN_TRIPLE *adapter, struct seq_file *m)
+{
+  TRIPLE_BUSLOAD *bl;
+  u32             now = triple_busload_slot(ktime_get());
+  u32             newest;
+  u32             slot;
+  u64             ps;
+  u64             load;
+  int             channel;
+  int             w;
+
+  for (channel = 0; channel < 3; channel++)
+  {
+    bl = &adapter->load[channel];
+
+    seq_printf(m, "%s:\n", adapter->devs[channel]->name);
+    if (!READ_ONCE(bl->nominal_bps))
+    {
+      seq_puts(m, "  bitrate      not set\n");
+      continue;
+    }
+
+    seq_printf(m, "  bitrate      %u / %u bit/s\n", bl->nominal_bps, bl->data_bps);
+    seq_printf(m, "  stuffing     %s\n", (bl->flags & TRIPLE_FT_EXACT) ? "exact" : "worst case");
+
+    /* Complete slots only; slots the worker has not reached yet are idle */
+    newest = READ_ONCE(bl->slot);
+    for (w = 0; w < ARRAY_SIZE(triple_load_windows); w++)
+    {
+      ps = 0;
+      for (slot = now - triple_load_windows[w]; slot != now; slot++)
+      {
+        if ((s32) (newest - slot) >= 0 && newest - slot < TRIPLE_LOAD_SLOTS)
+          ps += READ_ONCE(bl->ps[slot % TRIPLE_LOAD_SLOTS]);
+      }
+
+      /* in 0.01 % */
+      load = div64_u64(ps * 10000, (u64) triple_load_windows[w] * TRIPLE_LOAD_SLOT_MS * 1000000000ULL);
+      seq_printf(m, "  load %5u ms %llu.%02llu %%\n", triple_load_windows[w] * TRIPLE_LOAD_SLOT_MS,
+                 div_u64(load, 100), load - div_u64(load, 100) * 100);
+    }
+  }
+
+} /* END: triple_busload_show() */
@@ -0,0 +1,180 @@
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/uaccess.h>
+
+#include "change.h"
+
+extern bool trace_func_main;
+extern void print_func_trace (bool is_trace, int line, const char *func);
+
+static inline u32 triple_change_key (canid_t can_id)
+{
+  return can_id & (CAN_EFF_FLAG | CAN_EFF_MASK);
+}
+
+static inline struct triple_change_entry *triple_change_entry (struct triple_change *c, unsigned int idx)
+{
+  return (struct triple_change_entry *)(c->entries + idx * c->stride);
+}
+
+static void triple_change_destroy (struct triple_change *c)
+{
+  kvfree(c->keys);
+  kvfree(c->slot);
+  kvfree(c->entries);
+  kfree(c);
+
+} /* END: triple_change_destroy() */
+
+static void triple_change_destroy_rcu (struct rcu_head *head)
+{
+  triple_change_destroy(container_of(head, struct triple_change, rcu));
+}
+
+/* Called from the RX worker only, so the state needs no lock. */
+bool triple_change_update (struct triple_change *c, canid_t can_id, const u8 *data, int len)
+{
+  struct triple_change_entry *e;
+  u32                         key = triple_change_key(can_id);
+  unsigned int                h = hash_32(key, 32) & c->hmask;
+  unsigned int                i;
+  bool                        changed;
+  u8                         *mask;
+  u8                         *last;
+  u8                          b;
+
+  while (c->keys[h] != key)
+  {
+    if (c->keys[h] == TRIPLE_CHANGE_EMPTY)
+      return true;                      /* not watched               */
+    h = (h + 1) & c->hmask;
+  }
+
+  e    = triple_change_entry(c, c->slot[h]);
+  mask = e->bytes;
+  last = e->bytes + c->width;
+
+  /* only the first width bytes are kept, compare what is stored */
+  if (len > c->width)
+    len = c->width;
+  changed = !e->valid || e->len != len;
+
+  for (i = 0; i < len; i++)
+  {
+    b = data[i] & mask[i];
+    if (b != last[i])
+    {
+      changed = true;
+      last[i] = b;
+    }
+  }
+
+  if (!changed && !(c->timeout && (u32)((u32) jiffies - e->last) >= c->timeout))
+    return false;
+
+  e->len   = len;
+  e->valid = 1;
+  e->last  = (u32) jiffies;
+
+  return true;
+
+} /* END: triple_change_update() */
+
+int triple_change_set (USB2CAN_TRIPLE *adapter, const struct triple_change_cfg *cfg)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  struct triple_change     *c = NULL;
+  struct triple_change     *old;
+  struct triple_change_id   id;
+  struct triple_change_id __user *uids = u64_to_user_ptr(cfg->ids);
+  unsigned int              slots;
+  unsigned int              i;
+  unsigned int              h;
+  u32                       key;
+
+  if (cfg->channel > 2 || cfg->n_ids > TRIPLE_CHANGE_MAX_IDS)
+    return -EINVAL;
+
+  if (cfg->n_ids)
+  {
+    c = kzalloc(sizeof(*c), GFP_KERNEL);
+    if (!c)
+      return -ENOMEM;
+
+    slots     = roundup_pow_of_two(cfg->n_ids * 2);
+    c->hmask  = slots - 1;
+    c->width  = (cfg->channel == 2 && adapter->can_fd) ? CANFD_MAX_DLEN : CAN_MAX_DLEN;
+    c->stride = ALIGN(sizeof(struct triple_change_entry) + 2 * c->width, 16);
+    c->timeout = msecs_to_jiffies(cfg->timeout_ms);
+
+    c->keys    = kvmalloc_array(slots, sizeof(*c->keys), GFP_KERNEL);
+    c->slot    = kvmalloc_array(slots, sizeof(*c->slot), GFP_KERNEL);
+    c->entries = kvzalloc(cfg->n_ids * c->stride, GFP_KERNEL);
+    if (!c->keys || !c->slot || !c->entries)
+    {
+      triple_change_destroy(c);
+      return -ENOMEM;
+    }
+
+    memset(c->keys, 0xFF, slots * sizeof(*c->keys));
+
+    for (i = 0; i < cfg->n_ids; i++)
+    {
+      if (copy_from_user(&id, &uids[i], sizeof(id)))
+      {
+        triple_change_destroy(c);
+        return -EFAULT;
+      }
+
+      key = triple_change_key(id.can_id);
+      h   = hash_32(key, 32) & c->hmask;
+
+      while (c->keys[h] != TRIPLE_CHANGE_EMPTY && c->keys[h] != key)
+        h = (h + 1) & c->hmask;
+
+      /* a duplicate id keeps its first entry, only the mask is updated */
+      if (c->keys[h] == TRIPLE_CHANGE_EMPTY)
+      {
+        c->keys[h] = key;
+        c->slot[h] = i;
+      }
+
+      memcpy(triple_change_entry(c, c->slot[h])->bytes, id.mask, c->width);
+    }
+  }
+
+  spin_lock_bh(&adapter->lock);
+  old = rcu_dereference_protected(adapter->change[cfg->channel], lockdep_is_held(&adapter->lock));
+  rcu_assign_pointer(adapter->change[cfg->channel], c);
+  spin_unlock_bh(&adapter->lock);
+
+  if (old)
+    call_rcu(&old->rcu, triple_change_destroy_rcu);
+
+  return 0;
+
+} /* END: triple_change_set() */
+
+void triple_change_free (USB2CAN_TRIPLE *adapter)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  struct triple_change *c;
+  int                   i;
+
+  for (i = 0; i < 3; i++)
+  {
+    c = rcu_dereference_protected(adapter->change[i], 1);
+    RCU_INIT_POINTER(adapter->change[i], NULL);
+    if (c)
+      call_rcu(&c->rcu, triple_change_destroy_rcu);
+  }
+
+} /* END: triple_change_free() */
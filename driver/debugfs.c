@@ -0,0 +1,225 @@
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/netdevice.h>
+
+#include "debugfs.h"
+#include "periodic.h"
+#include "probe.h"
+#include "busload.h"
+#include "idstats.h"
+#include "tap.h"
+
+extern bool trace_func_main;
+extern void print_func_trace (bool is_trace, int line, const char *func);
+
+static struct dentry *triple_debugfs_root;
+
+/* triplecan/<tty>/stats - driver private per channel counters */
+static int triple_stats_show (struct seq_file *m, void *v)
+{
+  USB2CAN_TRIPLE     *adapter = m->private;
+  TRIPLE_CHAN_STATS  *cs;
+  int                 i;
+  int                 j;
+
+  for (i = 0; i < 3; i++)
+  {
+    cs = &adapter->cstats[i];
+
+    seq_printf(m, "%s:\n", adapter->devs[i]->name);
+    seq_printf(m, "  rx_filtered  %lu\n", READ_ONCE(cs->rx_filtered));
+    seq_printf(m, "  rx_unchanged %lu\n", READ_ONCE(cs->rx_unchanged));
+    seq_printf(m, "  gw_forwarded %lu\n", READ_ONCE(cs->gw_forwarded));
+    seq_printf(m, "  gw_dropped   %lu\n", READ_ONCE(cs->gw_dropped));
+    seq_printf(m, "  pe_sent      %lu\n", READ_ONCE(cs->pe_sent));
+    seq_printf(m, "  pe_overruns  %lu\n", READ_ONCE(cs->pe_overruns));
+
+    if (cs->pe_sent)
+    {
+      seq_printf(m, "  pe_delay_avg %llu ns\n", div64_u64(cs->pe_delay_sum, cs->pe_sent));
+      seq_printf(m, "  pe_delay_max %llu ns\n", cs->pe_delay_max);
+      seq_puts(m, "  pe_delay_hist");
+      for (j = 0; j < TRIPLE_DELAY_BUCKETS; j++)
+        seq_printf(m, " %lu", cs->pe_delay_hist[j]);
+      seq_puts(m, "\n");
+    }
+
+    seq_printf(m, "  tx_order     %s\n", adapter->tx_order[i] == TRIPLE_TXQ_ID ? "id" : "fifo");
+    seq_printf(m, "  tx_max_age   %lld us\n", ktime_to_us(adapter->tx_max_age[i]));
+    seq_printf(m, "  tx_expired   %lu\n", READ_ONCE(cs->tx_expired));
+    seq_printf(m, "  tx_stalls    %lu\n", READ_ONCE(cs->tx_stalls));
+    seq_printf(m, "  tx_flushed   %lu\n", READ_ONCE(cs->tx_flushed));
+    for (j = 0; j < TRIPLE_PRIO_CLASSES; j++)
+    {
+      if (!cs->tx_class_sent[j])
+        continue;
+
+      seq_printf(m, "  tx_class%d    sent %lu wait_avg %llu ns wait_max %llu ns\n", j, cs->tx_class_sent[j],
+                 div64_u64(cs->tx_class_wait_sum[j], cs->tx_class_sent[j]), cs->tx_class_wait_max[j]);
+    }
+  }
+
+  return 0;
+
+} /* END: triple_stats_show() */
+
+static int triple_stats_open (struct inode *inode, struct file *file)
+{
+  return single_open(file, triple_stats_show, inode->i_private);
+}
+
+static const struct file_operations triple_stats_fops =
+{
+  .owner   = THIS_MODULE,
+  .open    = triple_stats_open,
+  .read    = seq_read,
+  .llseek  = seq_lseek,
+  .release = single_release,
+};
+
+/* triplecan/<tty>/periodic - the cyclic TX table */
+static int triple_periodic_file_show (struct seq_file *m, void *v)
+{
+  triple_periodic_show(m->private, m);
+  return 0;
+
+} /* END: triple_periodic_file_show() */
+
+static int triple_periodic_open (struct inode *inode, struct file *file)
+{
+  return single_open(file, triple_periodic_file_show, inode->i_private);
+}
+
+static const struct file_operations triple_periodic_fops =
+{
+  .owner   = THIS_MODULE,
+  .open    = triple_periodic_open,
+  .read    = seq_read,
+  .llseek  = seq_lseek,
+  .release = single_release,
+};
+
+/* triplecan/<tty>/rtt - host <-> adapter round trip of the marker probe */
+static int triple_rtt_show (struct seq_file *m, void *v)
+{
+  triple_probe_show(m->private, m);
+  return 0;
+
+} /* END: triple_rtt_show() */
+
+static int triple_rtt_open (struct inode *inode, struct file *file)
+{
+  return single_open(file, triple_rtt_show, inode->i_private);
+}
+
+static const struct file_operations triple_rtt_fops =
+{
+  .owner   = THIS_MODULE,
+  .open    = triple_rtt_open,
+  .read    = seq_read,
+  .llseek  = seq_lseek,
+  .release = single_release,
+};
+
+/* triplecan/<tty>/busload - wire time share of each channel */
+static int triple_busload_file_show (struct seq_file *m, void *v)
+{
+  triple_busload_show(m->private, m);
+  return 0;
+
+} /* END: triple_busload_file_show() */
+
+static int triple_busload_open (struct inode *inode, struct file *file)
+{
+  return single_open(file, triple_busload_file_show, inode->i_private);
+}
+
+static const struct file_operations triple_busload_fops =
+{
+  .owner   = THIS_MODULE,
+  .open    = triple_busload_open,
+  .read    = seq_read,
+  .llseek  = seq_lseek,
+  .release = single_release,
+};
+
+/* triplecan/<tty>/ids - per CAN id counters, periods and jitter */
+static int triple_ids_show (struct seq_file *m, void *v)
+{
+  triple_idstats_show(m->private, m);
+  return 0;
+
+} /* END: triple_ids_show() */
+
+static int triple_ids_open (struct inode *inode, struct file *file)
+{
+  return single_open(file, triple_ids_show, inode->i_private);
+}
+
+static const struct file_operations triple_ids_fops =
+{
+  .owner   = THIS_MODULE,
+  .open    = triple_ids_open,
+  .read    = seq_read,
+  .llseek  = seq_lseek,
+  .release = single_release,
+};
+
+void triple_debugfs_init (void)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  triple_debugfs_root = debugfs_create_dir("triplecan", NULL);
+
+} /* END: triple_debugfs_init() */
+
+void triple_debugfs_exit (void)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  debugfs_remove_recursive(triple_debugfs_root);
+  triple_debugfs_root = NULL;
+
+} /* END: triple_debugfs_exit() */
+
+void triple_debugfs_add (USB2CAN_TRIPLE *adapter, const char *name)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  /* debugfs is best effort, the driver works without it */
+  if (IS_ERR_OR_NULL(triple_debugfs_root))
+    return;
+
+  adapter->debugfs = debugfs_create_dir(name, triple_debugfs_root);
+  if (IS_ERR_OR_NULL(adapter->debugfs))
+  {
+    adapter->debugfs = NULL;
+    return;
+  }
+
+  debugfs_create_file("stats", S_IRUGO, adapter->debugfs, adapter, &triple_stats_fops);
+  debugfs_create_file("periodic", S_IRUGO, adapter->debugfs, adapter, &triple_periodic_fops);
+  debugfs_create_file("rtt", S_IRUGO, adapter->debugfs, adapter, &triple_rtt_fops);
+  debugfs_create_file("busload", S_IRUGO, adapter->debugfs, adapter, &triple_busload_fops);
+  debugfs_create_file("ids", S_IRUGO, adapter->debugfs, adapter, &triple_ids_fops);
+  triple_tap_debugfs(adapter, adapter->debugfs);
+
+} /* END: triple_debugfs_add() */
+
+void triple_debugfs_remove (USB2CAN_TRIPLE *adapter)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  debugfs_remove_recursive(adapter->debugfs);
+  adapter->debugfs = NULL;
+
+} /* END: triple_debugfs_remove() */
@@ -0,0 +1,104 @@
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/uaccess.h>
+
+#include "filter.h"
+
+extern bool trace_func_main;
+extern void print_func_trace (bool is_trace, int line, const char *func);
+
+static int triple_range_cmp (const void *a, const void *b)
+{
+  const struct triple_id_range *ra = a;
+  const struct triple_id_range *rb = b;
+
+  if (ra->from < rb->from)
+    return -1;
+
+  return ra->from > rb->from;
+
+} /* END: triple_range_cmp() */
+
+int triple_filter_set (USB2CAN_TRIPLE *adapter, const struct triple_filter_cfg *cfg)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  struct triple_filter  *f = NULL;
+  struct triple_filter  *old;
+  unsigned int           i;
+  unsigned int           n = 0;
+
+  if (cfg->channel > 2 || cfg->n_eff > TRIPLE_FILTER_MAX_EFF)
+    return -EINVAL;
+
+  if (cfg->enable)
+  {
+    f = kzalloc(sizeof(*f) + cfg->n_eff * sizeof(f->eff[0]), GFP_KERNEL);
+    if (!f)
+      return -ENOMEM;
+
+    memcpy(f->sff, cfg->sff, sizeof(f->sff));
+
+    if (cfg->n_eff && copy_from_user(f->eff, u64_to_user_ptr(cfg->eff), cfg->n_eff * sizeof(f->eff[0])))
+    {
+      kfree(f);
+      return -EFAULT;
+    }
+
+    /* Sort and merge overlapping ranges so the RX path can bisect. */
+    sort(f->eff, cfg->n_eff, sizeof(f->eff[0]), triple_range_cmp, NULL);
+
+    for (i = 0; i < cfg->n_eff; i++)
+    {
+      if (f->eff[i].from > f->eff[i].to || f->eff[i].to > CAN_EFF_MASK)
+      {
+        kfree(f);
+        return -EINVAL;
+      }
+
+      if (n && f->eff[i].from <= f->eff[n - 1].to + 1)
+      {
+        if (f->eff[i].to > f->eff[n - 1].to)
+          f->eff[n - 1].to = f->eff[i].to;
+        continue;
+      }
+
+      f->eff[n++] = f->eff[i];
+    }
+
+    f->n_eff = n;
+  }
+
+  spin_lock_bh(&adapter->lock);
+  old = rcu_dereference_protected(adapter->filter[cfg->channel], lockdep_is_held(&adapter->lock));
+  rcu_assign_pointer(adapter->filter[cfg->channel], f);
+  spin_unlock_bh(&adapter->lock);
+
+  if (old)
+    kfree_rcu(old, rcu);
+
+  return 0;
+
+} /* END: triple_filter_set() */
+
+void triple_filter_free (USB2CAN_TRIPLE *adapter)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  struct triple_filter *f;
+  int                   i;
+
+  for (i = 0; i < 3; i++)
+  {
+    f = rcu_dereference_protected(adapter->filter[i], 1);
+    RCU_INIT_POINTER(adapter->filter[i], NULL);
+    if (f)
+      kfree_rcu(f, rcu);
+  }
+
+} /* END: triple_filter_free() */
@@ -0,0 +1,194 @@
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/skbuff.h>
+#include <linux/uaccess.h>
+
+#include "tx.h"
+#include "gateway.h"
+
+extern bool trace_func_main;
+extern void print_func_trace (bool is_trace, int line, const char *func);
+
+static int triple_route_cmp (const void *a, const void *b)
+{
+  const struct triple_gw_route *ra = a;
+  const struct triple_gw_route *rb = b;
+
+  return (int) ra->src - (int) rb->src;
+
+} /* END: triple_route_cmp() */
+
+/* Build the frame for route r and put it in front of the dst channel TX path. */
+static void triple_gateway_forward (USB2CAN_TRIPLE *adapter, const struct triple_gw_route *r, canid_t can_id, const TRIPLE_CAN_FRAME *frame)
+{
+  struct sk_buff      *skb;
+  struct canfd_frame  *cf;
+  TRIPLE_CHAN_STATS   *cs = &adapter->cstats[r->src];
+  bool                 fd = frame->fd;
+  int                  len = frame->rtr ? 0 : frame->dlc;
+  int                  i;
+  int                  err;
+
+  if (!netif_running(adapter->devs[r->dst]))
+  {
+    cs->gw_dropped++;
+    return;
+  }
+
+  /* Only port 3 speaks CAN FD; short FD frames are forwarded as CAN 2.0 */
+  if (fd && !(r->dst == 2 && adapter->can_fd))
+  {
+    if (len > CAN_MAX_DLEN)
+    {
+      cs->gw_dropped++;
+      return;
+    }
+    fd = false;
+  }
+
+  skb = triple_alloc_skb(adapter->devs[r->dst], fd);
+  if (!skb)
+  {
+    cs->gw_dropped++;
+    return;
+  }
+
+  /* Routed frames are ordinary traffic (skb->priority 0) on dst */
+  skb_set_queue_mapping(skb, TRIPLE_TX_BANDS - 1);
+
+  /* struct can_frame is a prefix of struct canfd_frame */
+  cf = (struct canfd_frame *) skb_put(skb, fd ? sizeof(struct canfd_frame) : sizeof(struct can_frame));
+  memset(cf, 0, fd ? sizeof(struct canfd_frame) : sizeof(struct can_frame));
+
+  cf->can_id = can_id;
+  if (r->flags & TRIPLE_GW_REWRITE_ID)
+    cf->can_id = (can_id & CAN_RTR_FLAG) | (r->new_id & (CAN_EFF_FLAG | CAN_EFF_MASK));
+
+  cf->len = len;
+  if (fd)
+  {
+    if (frame->fd_br_switch)
+      cf->flags |= CANFD_BRS;
+  }
+
+  for (i = 0; i < len; i++)
+  {
+    cf->data[i] = frame->data[i];
+    if (r->flags & TRIPLE_GW_MOD_DATA)
+      cf->data[i] = (cf->data[i] & r->and_mask[i]) | r->or_mask[i];
+  }
+
+  spin_lock_bh(&adapter->lock);
+
+  err = adapter->tty ? triple_tx_enqueue(adapter, r->dst, skb) : -ENODEV;
+  if (!err)
+    triple_tx_kick(adapter);
+
+  spin_unlock_bh(&adapter->lock);
+
+  if (err)
+  {
+    kfree_skb(skb);
+    cs->gw_dropped++;
+    return;
+  }
+
+  cs->gw_forwarded++;
+
+} /* END: triple_gateway_forward() */
+
+void triple_gateway_route (USB2CAN_TRIPLE *adapter, int channel, canid_t can_id, const TRIPLE_CAN_FRAME *frame)
+{
+  const struct triple_gateway  *gw;
+  const struct triple_gw_route *r;
+  unsigned int                  i;
+
+  rcu_read_lock();
+
+  gw = rcu_dereference(adapter->gateway);
+  if (gw)
+  {
+    for (i = gw->first[channel]; i < gw->first[channel + 1]; i++)
+    {
+      r = &gw->routes[i];
+      if ((can_id & r->mask) == (r->can_id & r->mask))
+        triple_gateway_forward(adapter, r, can_id, frame);
+    }
+  }
+
+  rcu_read_unlock();
+
+} /* END: triple_gateway_route() */
+
+int triple_gateway_set (USB2CAN_TRIPLE *adapter, const struct triple_gw_cfg *cfg)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  struct triple_gateway  *gw = NULL;
+  struct triple_gateway  *old;
+  unsigned int            i;
+  unsigned int            c;
+
+  if (cfg->n_routes > TRIPLE_GW_MAX_ROUTES)
+    return -EINVAL;
+
+  if (cfg->n_routes)
+  {
+    gw = kzalloc(sizeof(*gw) + cfg->n_routes * sizeof(gw->routes[0]), GFP_KERNEL);
+    if (!gw)
+      return -ENOMEM;
+
+    if (copy_from_user(gw->routes, u64_to_user_ptr(cfg->routes), cfg->n_routes * sizeof(gw->routes[0])))
+    {
+      kfree(gw);
+      return -EFAULT;
+    }
+
+    for (i = 0; i < cfg->n_routes; i++)
+    {
+      if (gw->routes[i].src > 2 || gw->routes[i].dst > 2 || gw->routes[i].src == gw->routes[i].dst)
+      {
+        kfree(gw);
+        return -EINVAL;
+      }
+    }
+
+    sort(gw->routes, cfg->n_routes, sizeof(gw->routes[0]), triple_route_cmp, NULL);
+
+    for (c = 0, i = 0; c < 4; c++)
+    {
+      while (i < cfg->n_routes && gw->routes[i].src < c)
+        i++;
+      gw->first[c] = i;
+    }
+  }
+
+  spin_lock_bh(&adapter->lock);
+  old = rcu_dereference_protected(adapter->gateway, lockdep_is_held(&adapter->lock));
+  rcu_assign_pointer(adapter->gateway, gw);
+  spin_unlock_bh(&adapter->lock);
+
+  if (old)
+    kfree_rcu(old, rcu);
+
+  return 0;
+
+} /* END: triple_gateway_set() */
+
+void triple_gateway_free (USB2CAN_TRIPLE *adapter)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  struct triple_gateway *gw;
+
+  gw = rcu_dereference_protected(adapter->gateway, 1);
+  RCU_INIT_POINTER(adapter->gateway, NULL);
+  if (gw)
+    kfree_rcu(gw, rcu);
+
+} /* END: triple_gateway_free() */
@@ -0,0 +1,173 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/vmalloc.h>
+#include <linux/hash.h>
+#include <linux/math64.h>
+#include <linux/log2.h>
+#include <linux/version.h>
+
+#include "idstats.h"
+
+/*
+ * Per CAN id traffic statistics of one channel.
+ *
+ * SFF ids index an array directly, EFF ids go to an open addressing table
+ * sized at enable time; ids that find no slot within TRIPLE_IDSTATS_PROBE
+ * tries are only counted. Only the worker writes, the debugfs dump reads a
+ * racy snapshot. Jitter is the standard deviation of the period.
+ */
+
+extern bool trace_func_main;
+extern void print_func_trace (bool is_trace, int line, const char *func);
+
+#define  TRIPLE_IDSTATS_EFF_DEFAULT   4096
+
+void triple_idstats_eff (struct triple_idstats *t, canid_t can_id, u8 dlc, bool fd, u64 now)
+{
+  unsigned int i = hash_32(can_id, ilog2(t->eff_mask + 1));
+  int          n;
+
+  for (n = 0; n < TRIPLE_IDSTATS_PROBE; n++, i = (i + 1) & t->eff_mask)
+  {
+    if (t->eff[i].can_id == can_id || !t->eff[i].can_id)
+    {
+      triple_idstats_update(&t->eff[i], can_id, dlc, fd, now);
+      return;
+    }
+  }
+
+  t->eff_full++;
+
+} /* END: triple_idstats_eff() */
+
+int triple_idstats_set (USB2CAN_TRIPLE *adapter, const struct triple_idstats_cfg *cfg)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  struct triple_idstats *t = NULL;
+  struct triple_idstats *old;
+  unsigned int           slots = cfg->eff_slots ? cfg->eff_slots : TRIPLE_IDSTATS_EFF_DEFAULT;
+
+  /* one slot would make hash_32() shift by 32 */
+  BUILD_BUG_ON(TRIPLE_IDSTATS_EFF_MIN <= TRIPLE_IDSTATS_PROBE);
+
+  if (cfg->channel > 2 || !is_power_of_2(slots) || slots < TRIPLE_IDSTATS_EFF_MIN || slots > TRIPLE_IDSTATS_EFF_MAX)
+    return -EINVAL;
+
+  if (cfg->enable)
+  {
+    t = vzalloc(sizeof(*t) + slots * sizeof(t->eff[0]));
+    if (!t)
+      return -ENOMEM;
+
+    t->eff_mask = slots - 1;
+  }
+
+  spin_lock_bh(&adapter->lock);
+  old = rcu_dereference_protected(adapter->idstats[cfg->channel], lockdep_is_held(&adapter->lock));
+  rcu_assign_pointer(adapter->idstats[cfg->channel], t);
+  spin_unlock_bh(&adapter->lock);
+
+  if (old)
+  {
+    synchronize_rcu();
+    vfree(old);
+  }
+
+  return 0;
+
+} /* END: triple_idstats_set() */
+
+void triple_idstats_free (USB2CAN_TRIPLE *adapter)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  struct triple_idstats *t[3];
+  int                    i;
+
+  for (i = 0; i < 3; i++)
+  {
+    t[i] = rcu_dereference_protected(adapter->idstats[i], 1);
+    RCU_INIT_POINTER(adapter->idstats[i], NULL);
+  }
+
+  synchronize_rcu();
+  for (i = 0; i < 3; i++)
+    vfree(t[i]);
+
+} /* END: triple_idstats_free() */
+
+static void triple_idstats_line (struct seq_file *m, const struct triple_id_stat *e, u64 now)
+{
+  u32  count = READ_ONCE(e->count);
+  u64  avg = 0;
+  u64  var = 0;
+  u64  mean;
+
+  if (!count)
+    return;
+
+  /* count - 1 periods */
+  if (count > 1)
+  {
+    avg  = div_u64(e->period_sum_ns, count - 1);
+    mean = avg >> 10;
+    var  = div_u64(e->period_sq, count - 1);
+    var  = var > mean * mean ? var - mean * mean : 0;
+  }
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+  var = int_sqrt64(var);
+#else
+  var = int_sqrt(min_t(u64, var, ULONG_MAX));
+#endif
+
+  if (e->can_id & CAN_EFF_FLAG)
+    seq_printf(m, "  %08X", e->can_id & CAN_EFF_MASK);
+  else
+    seq_printf(m, "  %03X     ", e->can_id & CAN_SFF_MASK);
+
+  seq_printf(m, " %10u %12llu %10llu %10llu %10llu %3u%s %10llu\n", count,
+             div_u64(avg, NSEC_PER_USEC), div_u64(var << 10, NSEC_PER_USEC),
+             div_u64((u64) e->period_min << 10, NSEC_PER_USEC), div_u64((u64) e->period_max << 10, NSEC_PER_USEC),
+             e->dlc, e->fd ? "F" : " ", now > e->last_ns ? div_u64(now - e->last_ns, NSEC_PER_MSEC) : 0);
+
+} /* END: triple_idstats_line() */
+
+void triple_idstats_show (USB2CAN_TRIPLE *adapter, struct seq_file *m)
+{
+  struct triple_idstats *t;
+  u64                    now = ktime_to_ns(ktime_get());
+  unsigned int           i;
+  int                    channel;
+
+  for (channel = 0; channel < 3; channel++)
+  {
+    seq_printf(m, "%s:\n", adapter->devs[channel]->name);
+
+    rcu_read_lock();
+    t = rcu_dereference(adapter->idstats[channel]);
+    if (!t)
+    {
+      rcu_read_unlock();
+      seq_puts(m, "  off\n");
+      continue;
+    }
+
+    seq_printf(m, "  eff_slots %u eff_full %lu\n", t->eff_mask + 1, READ_ONCE(t->eff_full));
+    seq_puts(m, "  id            count  period_us  jitter_us     min_us     max_us dlc     age_ms\n");
+
+    for (i = 0; i <= CAN_SFF_MASK; i++)
+      triple_idstats_line(m, &t->sff[i], now);
+
+    for (i = 0; i <= t->eff_mask; i++)
+      triple_idstats_line(m, &t->eff[i], now);
+
+    rcu_read_unlock();
+  }
+
+} /* END: triple_idstats_show() */
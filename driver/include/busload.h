@@ -0,0 +1,15 @@
+#ifndef __BUSLOAD_H__
+#define __BUSLOAD_H__
+
+#include <linux/ktime.h>
+#include <linux/seq_file.h>
+
+#include "triple_helper.h"
+#include "triple_ioctl.h"
+#include "triple_frametime.h"
+
+int  triple_busload_config (USB2CAN_TRIPLE *adapter, const struct triple_bitrate_cfg *cfg);
+void triple_busload_account(USB2CAN_TRIPLE *adapter, int channel, canid_t can_id, const u8 *data, u8 len, u32 flags, ktime_t now);
+void triple_busload_show   (USB2CAN_TRIPLE *adapter, struct seq_file *m);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef __CHANGE_H__
+#define __CHANGE_H__
+
+#include <linux/can.h>
+#include <linux/jiffies.h>
+#include <linux/rcupdate.h>
+
+#include "triple_helper.h"
+#include "triple_ioctl.h"
+
+#define TRIPLE_CHANGE_EMPTY  0xFFFFFFFFU    /* never a valid key         */
+
+/*
+ * Per id state. Entries are stride bytes apart: header, mask[width],
+ * data[width]; width is 8 for CAN 2.0 channels and 64 for CAN FD, so a
+ * CAN 2.0 entry is 32 bytes and two of them share a cache line.
+ */
+struct triple_change_entry
+{
+  u32  last;                            /* jiffies of last delivery  */
+  u8   len;                             /* last delivered length     */
+  u8   valid;                           /* data holds a payload      */
+  u8   reserved[2];
+  u8   bytes[];                         /* mask[width], data[width]  */
+};
+
+struct triple_change
+{
+  struct rcu_head  rcu;
+  unsigned long    timeout;             /* jiffies, 0 -> never       */
+  unsigned int     width;               /* compared payload bytes    */
+  unsigned int     stride;              /* bytes per entry           */
+  unsigned int     hmask;               /* hash slots - 1            */
+  u32             *keys;                /* open addressing, linear probing */
+  u16             *slot;                /* key -> entry index        */
+  u8              *entries;
+};
+
+int  triple_change_set (USB2CAN_TRIPLE *adapter, const struct triple_change_cfg *cfg);
+void triple_change_free(USB2CAN_TRIPLE *adapter);
+bool triple_change_update(struct triple_change *c, canid_t can_id, const u8 *data, int len);
+
+/* RX path: false -> payload of a watched id did not change, drop it. */
+static inline bool triple_change_pass(USB2CAN_TRIPLE *adapter, int channel, canid_t can_id, const u8 *data, int len)
+{
+  struct triple_change *c;
+  bool                  pass = true;
+
+  if (!rcu_access_pointer(adapter->change[channel]))
+    return true;
+
+  rcu_read_lock();
+  c = rcu_dereference(adapter->change[channel]);
+  if (c)
+    pass = triple_change_update(c, can_id, data, len);
+  rcu_read_unlock();
+
+  return pass;
+}
+
+#endif
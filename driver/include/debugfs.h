@@ -0,0 +1,11 @@
+#ifndef __DEBUGFS_H__
+#define __DEBUGFS_H__
+
+#include "triple_helper.h"
+
+void triple_debugfs_init   (void);
+void triple_debugfs_exit   (void);
+void triple_debugfs_add    (USB2CAN_TRIPLE *adapter, const char *name);
+void triple_debugfs_remove (USB2CAN_TRIPLE *adapter);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+#include <linux/can.h>
+#include <linux/rcupdate.h>
+
+#include "triple_helper.h"
+#include "triple_ioctl.h"
+
+struct triple_filter
+{
+  struct rcu_head         rcu;
+  u32                     sff[TRIPLE_FILTER_SFF_WORDS];
+  unsigned int            n_eff;
+  struct triple_id_range  eff[];        /* sorted, merged            */
+};
+
+int  triple_filter_set (USB2CAN_TRIPLE *adapter, const struct triple_filter_cfg *cfg);
+void triple_filter_free(USB2CAN_TRIPLE *adapter);
+
+static inline bool triple_filter_eff(const struct triple_filter *f, u32 id)
+{
+  unsigned int lo = 0;
+  unsigned int hi = f->n_eff;
+  unsigned int mid;
+
+  while (lo < hi)
+  {
+    mid = (lo + hi) / 2;
+
+    if (id < f->eff[mid].from)
+      hi = mid;
+    else if (id > f->eff[mid].to)
+      lo = mid + 1;
+    else
+      return true;
+  }
+
+  return false;
+}
+
+/* RX path, called by the worker right after the id has been parsed. */
+static inline bool triple_filter_pass(USB2CAN_TRIPLE *adapter, int channel, canid_t can_id)
+{
+  const struct triple_filter *f;
+  bool                        pass = true;
+  u32                         id;
+
+  if (!rcu_access_pointer(adapter->filter[channel]))
+    return true;
+
+  rcu_read_lock();
+  f = rcu_dereference(adapter->filter[channel]);
+  if (f)
+  {
+    if (can_id & CAN_EFF_FLAG)
+      pass = triple_filter_eff(f, can_id & CAN_EFF_MASK);
+    else
+    {
+      id   = can_id & CAN_SFF_MASK;
+      pass = (f->sff[id >> 5] >> (id & 31)) & 1;
+    }
+  }
+  rcu_read_unlock();
+
+  return pass;
+}
+
+#endif
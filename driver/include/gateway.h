@@ -0,0 +1,28 @@
+#ifndef __GATEWAY_H__
+#define __GATEWAY_H__
+
+#include <linux/can.h>
+#include <linux/rcupdate.h>
+
+#include "triple_helper.h"
+#include "triple_ioctl.h"
+
+struct triple_gateway
+{
+  struct rcu_head          rcu;
+  unsigned int             first[4];    /* routes of channel c: [first[c], first[c + 1]) */
+  struct triple_gw_route   routes[];    /* sorted by src             */
+};
+
+int  triple_gateway_set (USB2CAN_TRIPLE *adapter, const struct triple_gw_cfg *cfg);
+void triple_gateway_free(USB2CAN_TRIPLE *adapter);
+void triple_gateway_route(USB2CAN_TRIPLE *adapter, int channel, canid_t can_id, const TRIPLE_CAN_FRAME *frame);
+
+/* RX path, called by the worker for every decoded frame */
+static inline void triple_gateway(USB2CAN_TRIPLE *adapter, int channel, canid_t can_id, const TRIPLE_CAN_FRAME *frame)
+{
+  if (rcu_access_pointer(adapter->gateway))
+    triple_gateway_route(adapter, channel, can_id, frame);
+}
+
+#endif
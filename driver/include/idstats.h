@@ -0,0 +1,87 @@
+#ifndef __IDSTATS_H__
+#define __IDSTATS_H__
+
+#include <linux/kernel.h>
+#include <linux/can.h>
+#include <linux/rcupdate.h>
+#include <linux/seq_file.h>
+
+#include "triple_helper.h"
+#include "triple_ioctl.h"
+
+#define  TRIPLE_IDSTATS_PROBE   8       /* EFF slots tried per lookup */
+
+/* one CAN id, periods kept in units of 1024 ns to stay shift only */
+struct triple_id_stat
+{
+  u32      can_id;                      /* EFF table: 0 -> free slot */
+  u8       dlc;                         /* last frame                */
+  u8       fd;
+  u32      count;
+  u32      period_min;                  /* 1024 ns                   */
+  u32      period_max;
+  u64      last_ns;                     /* CLOCK_MONOTONIC           */
+  u64      period_sum_ns;
+  u64      period_sq;                   /* sum of squares, 1024 ns units */
+};
+
+/* per channel table, written by the worker only */
+struct triple_idstats
+{
+  unsigned int           eff_mask;      /* EFF slots - 1             */
+  unsigned long          eff_full;      /* frames of ids without a slot */
+  struct triple_id_stat  sff[CAN_SFF_MASK + 1];
+  struct triple_id_stat  eff[];         /* open addressing, linear probe */
+};
+
+int  triple_idstats_set  (USB2CAN_TRIPLE *adapter, const struct triple_idstats_cfg *cfg);
+void triple_idstats_free (USB2CAN_TRIPLE *adapter);
+void triple_idstats_show (USB2CAN_TRIPLE *adapter, struct seq_file *m);
+void triple_idstats_eff  (struct triple_idstats *t, canid_t can_id, u8 dlc, bool fd, u64 now);
+
+static inline void triple_idstats_update(struct triple_id_stat *e, canid_t can_id, u8 dlc, bool fd, u64 now)
+{
+  u64 d;
+  u32 p;
+
+  if (e->count)
+  {
+    d = now - e->last_ns;
+    p = min_t(u64, d >> 10, U32_MAX);
+
+    e->period_sum_ns += d;
+    e->period_sq     += (u64) p * p;
+    if (p < e->period_min || e->count == 1)
+      e->period_min = p;
+    if (p > e->period_max)
+      e->period_max = p;
+  }
+
+  e->can_id  = can_id;
+  e->dlc     = dlc;
+  e->fd      = fd;
+  e->last_ns = now;
+  e->count++;
+}
+
+/* RX path, every decoded frame before filters see it */
+static inline void triple_idstats_account(USB2CAN_TRIPLE *adapter, int channel, canid_t can_id, u8 dlc, bool fd, ktime_t now)
+{
+  struct triple_idstats *t;
+
+  if (!rcu_access_pointer(adapter->idstats[channel]))
+    return;
+
+  rcu_read_lock();
+  t = rcu_dereference(adapter->idstats[channel]);
+  if (t)
+  {
+    if (can_id & CAN_EFF_FLAG)
+      triple_idstats_eff(t, can_id, dlc, fd, ktime_to_ns(now));
+    else
+      triple_idstats_update(&t->sff[can_id & CAN_SFF_MASK], can_id, dlc, fd, ktime_to_ns(now));
+  }
+  rcu_read_unlock();
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef __PERIODIC_H__
+#define __PERIODIC_H__
+
+#include <linux/hrtimer.h>
+#include <linux/timerqueue.h>
+#include <linux/hashtable.h>
+#include <linux/seq_file.h>
+
+#include "triple_helper.h"
+#include "triple_ioctl.h"
+
+struct triple_periodic_entry
+{
+  struct timerqueue_node  node;         /* expires = next due time   */
+  struct hlist_node       hnode;        /* by (channel, can_id)      */
+  ktime_t                 period;
+  int                     channel;
+  bool                    fd;
+  struct canfd_frame      frame;
+  unsigned long           sent;
+  u64                     release_max;  /* ns late when handed to the TX path */
+};
+
+struct triple_periodic
+{
+  spinlock_t              lock;         /* entries, queue, ids       */
+  bool                    stopping;
+  struct hrtimer          timer;        /* fires at the earliest due time */
+  struct kthread_work     work;         /* releases due frames on the adapter worker */
+  struct timerqueue_head  queue;
+  DECLARE_HASHTABLE(ids, 10);
+  unsigned int            count;
+  USB2CAN_TRIPLE         *adapter;
+};
+
+int  triple_periodic_init(USB2CAN_TRIPLE *adapter);
+int  triple_periodic_cmd (USB2CAN_TRIPLE *adapter, const struct triple_periodic_cmd *cmd);
+void triple_periodic_stop(USB2CAN_TRIPLE *adapter);
+void triple_periodic_show(USB2CAN_TRIPLE *adapter, struct seq_file *m);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef __PROBE_H__
+#define __PROBE_H__
+
+#include <linux/kthread.h>
+#include <linux/seq_file.h>
+
+#include "triple_helper.h"
+
+#define  TRIPLE_RTT_BUCKETS   24        /* <1us, <2us, ... <4s, more */
+
+/* host <-> adapter round trip probe, one marker in flight at a time */
+struct triple_probe
+{
+  struct kthread_delayed_work work;     /* injects the next marker   */
+  unsigned char       cmd;              /* U2C_TR_CMD_MARKER or _STATUS */
+  u16                 seq;              /* of the marker in flight   */
+  bool                pending;          /* due, waits for a free xbuff */
+  bool                outstanding;      /* sent, no answer yet       */
+  ktime_t             sent;             /* tty took the marker       */
+
+  unsigned long       n_sent;
+  unsigned long       n_answered;
+  unsigned long       n_lost;           /* no answer within a second */
+  u64                 rtt_last;         /* ns                        */
+  u64                 rtt_min;
+  u64                 rtt_max;
+  u64                 rtt_sum;
+  unsigned long       hist[TRIPLE_RTT_BUCKETS]; /* log2 us buckets   */
+
+  USB2CAN_TRIPLE     *adapter;
+};
+
+int  triple_probe_init  (USB2CAN_TRIPLE *adapter);
+void triple_probe_stop  (USB2CAN_TRIPLE *adapter);
+bool triple_probe_send  (USB2CAN_TRIPLE *adapter);
+void triple_probe_answer(USB2CAN_TRIPLE *adapter, unsigned char cmd, const unsigned char *data, ktime_t now);
+void triple_probe_show  (USB2CAN_TRIPLE *adapter, struct seq_file *m);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef __RXRING_H__
+#define __RXRING_H__
+
+#include <linux/kernel.h>
+#include <linux/can.h>
+#include <linux/miscdevice.h>
+#include <linux/wait.h>
+
+#include "triple_helper.h"
+#include "triple_rxring.h"
+
+/* the ring behind /dev/triplecan-<tty>, lives until the last reader is gone */
+struct triple_rxring
+{
+  struct miscdevice           misc;
+  char                        name[80];
+  struct triple_rxring_hdr   *hdr;      /* vmalloc_user, mapped by readers */
+  struct triple_rxring_frame *frames;
+  u32                         mask;     /* frames - 1                */
+  size_t                      size;
+  wait_queue_head_t           wait;
+  atomic_t                    refs;     /* adapter + open files      */
+  bool                        dead;     /* adapter closed            */
+};
+
+int  triple_rxring_init   (USB2CAN_TRIPLE *adapter, const char *name);
+void triple_rxring_remove (USB2CAN_TRIPLE *adapter);
+void triple_rxring_push   (struct triple_rxring *r, int channel, canid_t can_id, const u8 *data, u8 len, u8 flags, ktime_t stamp);
+
+/* RX path, every decoded frame; only the worker calls it */
+static inline void triple_rxring_account(USB2CAN_TRIPLE *adapter, int channel, canid_t can_id, const u8 *data, u8 len, u8 flags, ktime_t stamp)
+{
+  if (adapter->rxring)
+    triple_rxring_push(adapter->rxring, channel, can_id, data, len, flags, stamp);
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef __TAP_H__
+#define __TAP_H__
+
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/rcupdate.h>
+#include <linux/debugfs.h>
+#include <linux/jump_label.h>
+
+#include "triple_helper.h"
+
+enum
+{
+  TRIPLE_TAP_RX = 0,                    /* adapter -> host           */
+  TRIPLE_TAP_TX = 1,                    /* host -> adapter           */
+};
+
+/* one direction, bytes of records, single producer */
+struct triple_tap_ring
+{
+  unsigned char  *buf;
+  u32             size;                 /* power of 2                */
+  u32             head;                 /* written by the producer   */
+  u32             tail;                 /* written by the reader     */
+  unsigned long   dropped;              /* records that did not fit  */
+};
+
+struct triple_tap
+{
+  unsigned int            kb;
+  struct triple_tap_ring  ring[2];
+};
+
+void triple_tap_write   (USB2CAN_TRIPLE *adapter, int dir, const unsigned char *buf, int len);
+void triple_tap_free    (USB2CAN_TRIPLE *adapter);
+void triple_tap_debugfs (USB2CAN_TRIPLE *adapter, struct dentry *dir);
+
+/* a patched out branch while no adapter has the tap on */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0)
+DECLARE_STATIC_KEY_FALSE(triple_tap_key);
+#define  triple_tap_enabled()       static_branch_unlikely(&triple_tap_key)
+#else
+extern atomic_t triple_tap_users;
+#define  triple_tap_enabled()       unlikely(atomic_read(&triple_tap_users))
+#endif
+
+static inline void triple_tap(USB2CAN_TRIPLE *adapter, int dir, const unsigned char *buf, int len)
+{
+  if (triple_tap_enabled() && len > 0)
+    triple_tap_write(adapter, dir, buf, len);
+}
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef __TRIPLE_FRAMETIME_H__
+#define __TRIPLE_FRAMETIME_H__
+
+/*
+ * On-wire length of CAN 2.0 and CAN FD (ISO) frames.
+ *
+ * A frame is SOF to the end of the intermission, split into the bits sent at
+ * the nominal and at the data bitrate. Stuff bits are either the worst case
+ * of the dynamically stuffed region ((n - 1) / 4) or counted from the frame
+ * content, including the CRC of CAN 2.0 frames. The fixed stuff bits of the
+ * CAN FD CRC field are always exact. The error state is assumed to be active
+ * unless TRIPLE_FT_ESI is given.
+ *
+ * This header is shared by the driver and the userspace tools, keep it free
+ * of kernel only types.
+ */
+
+#include <linux/types.h>
+#include <linux/can.h>
+
+#define  TRIPLE_FT_FD               0x01  /* FDF, CAN FD frame        */
+#define  TRIPLE_FT_BRS              0x02  /* data phase at the data bitrate */
+#define  TRIPLE_FT_ESI              0x04  /* error passive transmitter */
+#define  TRIPLE_FT_EXACT            0x08  /* count stuff bits from the content */
+
+/* ACK slot, ACK delimiter, EOF and intermission, always nominal */
+#define  TRIPLE_FT_TRAILER          12
+
+struct triple_frame_bits
+{
+  __u32  nominal;                       /* bits at the nominal bitrate */
+  __u32  data;                          /* bits at the data bitrate  */
+};
+
+/* Bit stuffing and CRC-15 state over the dynamically stuffed region */
+struct triple_ft_stuff
+{
+  __u32  prev;
+  __u32  run;
+  __u32  stuffed;
+  __u16  crc;
+};
+
+static inline void triple_ft_push (struct triple_ft_stuff *s, __u32 value, int n)
+{
+  __u32 bit;
+
+  while (n-- > 0)
+  {
+    bit = (value >> n) & 1;
+
+    /* x^15 + x^14 + x^10 + x^8 + x^7 + x^4 + x^3 + 1 */
+    if (bit ^ ((s->crc >> 14) & 1))
+      s->crc = ((s->crc << 1) ^ 0x4599) & 0x7fff;
+    else
+      s->crc = (s->crc << 1) & 0x7fff;
+
+    /* The stuff bit starts the next run */
+    if (bit == s->prev && ++s->run == 5)
+    {
+      s->stuffed++;
+      s->prev = !bit;
+      s->run  = 1;
+    }
+    else if (bit != s->prev)
+    {
+      s->prev = bit;
+      s->run  = 1;
+    }
+  }
+}
+
+static inline __u8 triple_ft_dlc (__u8 len)
+{
+  if (len <= 8)
+    return len;
+  if (len <= 12)
+    return 9;
+  if (len <= 16)
+    return 10;
+  if (len <= 20)
+    return 11;
+  if (len <= 24)
+    return 12;
+  if (len <= 32)
+    return 13;
+  if (len <= 48)
+    return 14;
+  return 15;
+}
+
+static inline __u8 triple_ft_len (__u8 dlc)
+{
+  static const __u8 len[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64 };
+
+  return len[dlc & 0x0F];
+}
+
+/*
+ * Bits of one frame. len is the payload length (CAN FD) or the DLC (CAN 2.0,
+ * RTR frames carry no data), data may be NULL without TRIPLE_FT_EXACT.
+ */
+static inline struct triple_frame_bits triple_frame_bits (__u32 can_id, const __u8 *data, __u8 len, __u32 flags)
+{
+  struct triple_frame_bits  b;
+  struct triple_ft_stuff    s = { 2, 0, 0, 0 };
+  __u32                     eff = (can_id & CAN_EFF_FLAG) ? 1 : 0;
+  __u32                     rtr = (can_id & CAN_RTR_FLAG) ? 1 : 0;
+  __u32                     arb;
+  __u32                     dyn;
+  __u32                     nominal_stuff;
+  __u8                      dlc;
+  int                       n;
+  int                       i;
+
+  if (!(flags & TRIPLE_FT_FD))
+  {
+    dlc = len > 15 ? 15 : len;
+    n   = rtr ? 0 : (dlc > 8 ? 8 : dlc);
+
+    /* SOF, id, RTR/SRR, IDE, [id, RTR, r1], r0, DLC, data, CRC */
+    dyn = (eff ? 54 : 34) + 8 * n;
+
+    if (!(flags & TRIPLE_FT_EXACT))
+    {
+      b.nominal = dyn + (dyn - 1) / 4 + 1 + TRIPLE_FT_TRAILER;
+      b.data    = 0;
+      return b;
+    }
+
+    triple_ft_push(&s, 0, 1);
+    if (eff)
+    {
+      triple_ft_push(&s, (can_id & CAN_EFF_MASK) >> 18, 11);
+      triple_ft_push(&s, 3, 2);
+      triple_ft_push(&s, can_id & 0x3FFFF, 18);
+      triple_ft_push(&s, rtr, 1);
+      triple_ft_push(&s, 0, 2);
+    }
+    else
+    {
+      triple_ft_push(&s, can_id & CAN_SFF_MASK, 11);
+      triple_ft_push(&s, rtr, 1);
+      triple_ft_push(&s, 0, 2);
+    }
+    triple_ft_push(&s, dlc, 4);
+    for (i = 0; i < n; i++)
+      triple_ft_push(&s, data[i], 8);
+    triple_ft_push(&s, s.crc, 15);
+
+    b.nominal = dyn + s.stuffed + 1 + TRIPLE_FT_TRAILER;
+    b.data    = 0;
+    return b;
+  }
+
+  dlc = triple_ft_dlc(len);
+  n   = triple_ft_len(dlc);
+
+  /* SOF, id, [SRR, IDE, id], RRS, (IDE), FDF, res, BRS | ESI, DLC, data */
+  arb = eff ? 36 : 17;
+  dyn = 1 + 4 + 8 * n;
+
+  if (!(flags & TRIPLE_FT_EXACT))
+  {
+    nominal_stuff = (arb - 1) / 4;
+    s.stuffed     = nominal_stuff + dyn / 4;
+  }
+  else
+  {
+    triple_ft_push(&s, 0, 1);
+    if (eff)
+    {
+      triple_ft_push(&s, (can_id & CAN_EFF_MASK) >> 18, 11);
+      triple_ft_push(&s, 3, 2);
+      triple_ft_push(&s, can_id & 0x3FFFF, 18);
+      triple_ft_push(&s, 0, 1);
+    }
+    else
+    {
+      triple_ft_push(&s, can_id & CAN_SFF_MASK, 11);
+      triple_ft_push(&s, 0, 2);
+    }
+    triple_ft_push(&s, 2, 2);
+    triple_ft_push(&s, (flags & TRIPLE_FT_BRS) ? 1 : 0, 1);
+    nominal_stuff = s.stuffed;
+
+    triple_ft_push(&s, (flags & TRIPLE_FT_ESI) ? 1 : 0, 1);
+    triple_ft_push(&s, dlc, 4);
+    for (i = 0; i < n; i++)
+      triple_ft_push(&s, i < len ? data[i] : 0, 8);
+  }
+
+  /* stuff count, CRC-17/21 with its fixed stuff bits, CRC delimiter */
+  dyn += s.stuffed - nominal_stuff + 4 + (n > 16 ? 21 + 7 : 17 + 6) + 1;
+
+  if (flags & TRIPLE_FT_BRS)
+  {
+    b.nominal = arb + nominal_stuff + TRIPLE_FT_TRAILER;
+    b.data    = dyn;
+  }
+  else
+  {
+    b.nominal = arb + nominal_stuff + dyn + TRIPLE_FT_TRAILER;
+    b.data    = 0;
+  }
+
+  return b;
+}
+
+/* Wire time in ps, bit times in ps (10^12 / bitrate) */
+static inline __u64 triple_frame_ps (struct triple_frame_bits b, __u32 nominal_bit_ps, __u32 data_bit_ps)
+{
+  return (__u64) b.nominal * nominal_bit_ps + (__u64) b.data * data_bit_ps;
+}
+
+#endif //__TRIPLE_FRAMETIME_H__
@@ -1,8 +1,20 @@
 #ifndef __TRIPLE_HELPER_H__
 #define __TRIPLE_HELPER_H__
 
+#include <linux/kthread.h>
+#include <linux/timer.h>
+
 #define   TRIPLE_MTU    100 //40
 #define   TRIPLE_MAGIC  0x739A//0x729B
+#define   TRIPLE_RX_RING  65536 /* bytes buffered between ldisc and worker, power of 2 */
+#define   TRIPLE_RX_STAMPS 256  /* receive_buf chunks awaiting decode, power of 2 */
+#define   TRIPLE_TXQ_LEN  16    /* frames queued in the driver per channel and band */
+#define   TRIPLE_TX_BANDS 4     /* netdev TX queues per channel, 0 is sent first */
+#define   TRIPLE_PQ_LEN   256   /* periodic frames due but not yet sent */
+#define   TRIPLE_DELAY_BUCKETS 16 /* <1us, <2us, ... <16ms, more */
+#define   TRIPLE_PRIO_CLASSES  4  /* TX wait stats by top bits of the 11 bit base id */
+#define   TRIPLE_LOAD_SLOT_MS  100 /* bus load resolution          */
+#define   TRIPLE_LOAD_SLOTS    100 /* longest bus load window, 10 s */
 
 #define    ID_LEN           4
 #define    DATA_LEN         8
@@ -32,6 +44,56 @@ enum
   TRIPLE_EID = 1
 };
 
+/*--------------------------------------------------------------*/
+typedef struct
+{
+  unsigned long       rx_filtered;      /* rejected by acceptance filter */
+  unsigned long       rx_unchanged;     /* suppressed by change-only mode */
+  unsigned long       gw_forwarded;     /* routed to another channel */
+  unsigned long       gw_dropped;       /* route target busy or down */
+
+  unsigned long       pe_sent;          /* periodic frames handed to the tty */
+  unsigned long       pe_overruns;      /* periods skipped, queue full or late */
+  u64                 pe_delay_sum;     /* ns from due time to tty write */
+  u64                 pe_delay_max;
+  unsigned long       pe_delay_hist[TRIPLE_DELAY_BUCKETS]; /* log2 us buckets */
+
+  unsigned long       tx_class_sent[TRIPLE_PRIO_CLASSES]; /* by arbitration id class */
+  u64                 tx_class_wait_sum[TRIPLE_PRIO_CLASSES]; /* ns from enqueue to tty write */
+  u64                 tx_class_wait_max[TRIPLE_PRIO_CLASSES];
+  unsigned long       tx_expired;       /* dropped at their deadline before encoding */
+  unsigned long       tx_stalls;        /* TX watchdog found no tty progress */
+  unsigned long       tx_flushed;       /* frames given up by the watchdog */
+} TRIPLE_CHAN_STATS;
+
+/* one receive_buf call: ring position after its bytes, CLOCK_MONOTONIC at entry */
+struct triple_rx_chunk
+{
+  unsigned int        end;
+  ktime_t             stamp;
+};
+
+/* wire time of one channel in TRIPLE_LOAD_SLOT_MS slots, written by the worker only */
+typedef struct
+{
+  u32                 nominal_bps;      /* 0 -> not accounted        */
+  u32                 data_bps;
+  u32                 nominal_ps;       /* bit times                 */
+  u32                 data_ps;
+  u32                 flags;            /* TRIPLE_FT_EXACT           */
+  u32                 slot;             /* newest slot, ms / TRIPLE_LOAD_SLOT_MS */
+  u64                 ps[TRIPLE_LOAD_SLOTS];
+} TRIPLE_BUSLOAD;
+
+struct triple_filter;
+struct triple_change;
+struct triple_gateway;
+struct triple_periodic;
+struct triple_probe;
+struct triple_idstats;
+struct triple_rxring;
+struct triple_tap;
+
 /*--------------------------------------------------------------*/
 typedef struct
 {
@@ -41,21 +103,53 @@ typedef struct
   struct tty_struct  *tty;              /* ptr to TTY structure      */
   struct net_device  *devs[3];          /* easy for intr handling    */
   spinlock_t          lock;
-  struct work_struct  tx_work;          /* Flushes transmit buffer   */
+  struct kthread_worker *worker;        /* per-adapter RX/TX context */
+  struct kthread_work tx_work;          /* Flushes transmit buffer   */
+  struct kthread_work rx_work;          /* Decodes received bytes    */
 
   atomic_t            ref_count;        /* reference count           */
   int                 gif_channel;      /* index for SIOCGIFNAME     */
 
-  unsigned char       current_channel;  /* Record current channel: for fixing tx_packet bug (v2.2) */
+  unsigned char       current_channel;  /* channel of tx_skb, round robin start */
   int                 can_fd;
   /* These are pointers to the malloc()ed frame buffers. */
   unsigned char       rbuff[TRIPLE_MTU];  /* receiver buffer           */
   int                 rcount;           /* received chars counter    */
+  unsigned char      *rx_ring;          /* ldisc -> worker bytes     */
+  unsigned int        rx_head;          /* written by receive_buf    */
+  unsigned int        rx_tail;          /* consumed by rx_work       */
+  struct triple_rx_chunk rx_chunk[TRIPLE_RX_STAMPS]; /* arrival time of ring bytes */
+  unsigned int        rx_shead;         /* written by receive_buf    */
+  unsigned int        rx_stail;         /* consumed by rx_work       */
+  ktime_t             rx_prev;          /* stamp of the last finished chunk */
+  ktime_t             rx_stamp;         /* arrival of the frame being decoded */
+  struct sk_buff_head pq;               /* periodic frames, sent first */
+  struct sk_buff_head txq[3][TRIPLE_TX_BANDS]; /* frames waiting for the tty */
+  unsigned char       tx_order[3];      /* TRIPLE_TXQ_FIFO / TRIPLE_TXQ_ID */
+  ktime_t             tx_max_age[3];    /* queueing deadline, 0 -> none */
+  struct sk_buff     *tx_skb;           /* frame in xbuff            */
+  unsigned long       tx_progress;      /* jiffies, last tty progress */
+  ktime_t             tx_accepted;      /* tty took the last byte of xbuff */
+  bool                tx_retried;       /* watchdog rewrote xbuff once */
+  struct timer_list   tx_watchdog;
+  struct kthread_work wd_work;          /* stall recovery on the worker */
   unsigned char       xbuff[TRIPLE_MTU];  /* transmitter buffer        */
   unsigned char      *xhead;            /* pointer to next XMIT byte */
   int                 xleft;            /* bytes left in XMIT queue  */
   unsigned long       flags;            /* Flag values/ mode etc     */
 
+  struct triple_filter __rcu *filter[3]; /* per channel, NULL -> accept all */
+  struct triple_change __rcu *change[3]; /* per channel, NULL -> deliver all */
+  struct triple_gateway __rcu *gateway; /* channel to channel routes */
+  struct triple_idstats __rcu *idstats[3]; /* per channel, NULL -> off */
+  struct triple_periodic *periodic;     /* cyclic TX table           */
+  struct triple_probe *probe;           /* round trip latency probe  */
+  struct triple_rxring *rxring;         /* mmap RX ring, NULL -> off */
+  struct triple_tap __rcu *tap;         /* raw byte capture, NULL -> off */
+  TRIPLE_CHAN_STATS   cstats[3];        /* driver private counters   */
+  TRIPLE_BUSLOAD      load[3];          /* wire time per channel     */
+  struct dentry      *debugfs;          /* triplecan/<tty>           */
+
 #define  SLF_INUSE  0                 /* Channel in use            */
 #define  SLF_ERROR  1                 /* Parity, etc. error        */
 
@@ -0,0 +1,152 @@
+#ifndef __TRIPLE_IOCTL_H__
+#define __TRIPLE_IOCTL_H__
+
+/*
+ * Private ioctls of the triplecan line discipline.
+ *
+ * They are issued on the tty file descriptor the discipline is attached to
+ * (the same fd tripled uses for TIOCSETD / SIOCGIFNAME). This header is
+ * shared by the driver and the userspace utility, keep it free of kernel
+ * only types.
+ */
+
+#include <linux/types.h>
+#include <linux/sockios.h>
+#include <linux/can.h>
+
+#define  TRIPLE_CPULIST_LEN         64
+
+/* worker (RX decode + TX drain) scheduling of one adapter */
+struct triple_worker_cfg
+{
+  __s32  prio;                          /* 0 -> SCHED_NORMAL, >0 -> SCHED_FIFO */
+  char   cpus[TRIPLE_CPULIST_LEN];      /* cpulist ("2-3,6"), empty -> any CPU */
+};
+
+/* acceptance filter of one channel, applied before skb allocation */
+#define  TRIPLE_FILTER_SFF_WORDS    (2048 / 32)
+#define  TRIPLE_FILTER_MAX_EFF      4096
+
+struct triple_id_range
+{
+  __u32  from;                          /* first accepted id         */
+  __u32  to;                            /* last accepted id          */
+};
+
+struct triple_filter_cfg
+{
+  __u32  channel;                       /* 0 - 2                     */
+  __u32  enable;                        /* 0 -> accept everything    */
+  __u32  sff[TRIPLE_FILTER_SFF_WORDS];  /* bit n set -> accept SFF id n */
+  __u32  n_eff;                         /* entries in eff            */
+  __u64  eff;                           /* struct triple_id_range *, EFF ids */
+};
+
+/* change-only delivery: pass a frame only when its (masked) payload changed */
+#define  TRIPLE_CHANGE_MAX_IDS      4096
+
+struct triple_change_id
+{
+  __u32  can_id;                        /* CAN_EFF_FLAG selects extended id */
+  __u8   mask[64];                      /* payload bits that count as a change */
+};
+
+struct triple_change_cfg
+{
+  __u32  channel;                       /* 0 - 2                     */
+  __u32  timeout_ms;                    /* deliver anyway after, 0 -> never */
+  __u32  n_ids;                         /* 0 -> mode off             */
+  __u32  reserved;
+  __u64  ids;                           /* struct triple_change_id * */
+};
+
+/* in-driver gateway between the channels of one adapter */
+#define  TRIPLE_GW_MAX_ROUTES       256
+
+#define  TRIPLE_GW_REWRITE_ID       0x01  /* replace id by new_id     */
+#define  TRIPLE_GW_MOD_DATA         0x02  /* data = (data & and) | or */
+
+struct triple_gw_route
+{
+  __u32  src;                           /* source channel 0 - 2      */
+  __u32  dst;                           /* destination channel 0 - 2 */
+  __u32  can_id;                        /* match: (id & mask) == (can_id & mask) */
+  __u32  mask;                          /* CAN_EFF_FLAG / CAN_RTR_FLAG may be part of it */
+  __u32  flags;                         /* TRIPLE_GW_*               */
+  __u32  new_id;                        /* CAN_EFF_FLAG selects extended id */
+  __u8   and_mask[64];
+  __u8   or_mask[64];
+};
+
+struct triple_gw_cfg
+{
+  __u32  n_routes;                      /* 0 -> gateway off          */
+  __u32  reserved;
+  __u64  routes;                        /* struct triple_gw_route *  */
+};
+
+/* hrtimer driven periodic transmit table, entries keyed by (channel, can_id) */
+#define  TRIPLE_PERIODIC_MAX        4096
+
+enum
+{
+  TRIPLE_PERIODIC_ADD = 0,              /* start sending frame every period_us */
+  TRIPLE_PERIODIC_UPDATE,               /* new payload (and period if != 0) */
+  TRIPLE_PERIODIC_REMOVE,
+  TRIPLE_PERIODIC_FLUSH,                /* remove all entries of channel */
+};
+
+struct triple_periodic_cmd
+{
+  __u32               op;               /* TRIPLE_PERIODIC_*         */
+  __u32               channel;          /* 0 - 2                     */
+  __u32               period_us;
+  __u32               fd;               /* frame is a CAN FD frame   */
+  struct canfd_frame  frame;
+};
+
+/* driver side TX queue of one channel */
+enum
+{
+  TRIPLE_TXQ_FIFO = 0,                  /* arrival order (default)   */
+  TRIPLE_TXQ_ID,                        /* bus arbitration order, FIFO within an id */
+};
+
+struct triple_txq_cfg
+{
+  __u32  channel;                       /* 0 - 2                     */
+  __u32  order;                         /* TRIPLE_TXQ_*              */
+  __u32  max_age_us;                    /* drop frames queued longer, 0 -> keep */
+};
+
+/* bitrates of one channel, for frame wire time and bus load */
+struct triple_bitrate_cfg
+{
+  __u32  channel;                       /* 0 - 2                     */
+  __u32  nominal_bps;                   /* 0 -> bus load off         */
+  __u32  data_bps;                      /* CAN FD data phase, 0 -> nominal */
+  __u32  exact;                         /* count stuff bits instead of worst case */
+};
+
+/* per CAN id statistics of one channel, dumped in debugfs triplecan/<tty>/ids */
+struct triple_idstats_cfg
+{
+  __u32  channel;                       /* 0 - 2                     */
+  __u32  enable;                        /* 0 -> off, 1 -> on (restarts the table) */
+  __u32  eff_slots;                     /* power of two, 0 -> 4096   */
+};
+
+/* eff_slots range, the table has to be longer than the driver probes per lookup */
+#define  TRIPLE_IDSTATS_EFF_MIN     16
+#define  TRIPLE_IDSTATS_EFF_MAX     65536
+
+#define  TRIPLE_IOCSWORKER          (SIOCDEVPRIVATE + 0)
+#define  TRIPLE_IOCSFILTER          (SIOCDEVPRIVATE + 1)
+#define  TRIPLE_IOCSCHANGE          (SIOCDEVPRIVATE + 2)
+#define  TRIPLE_IOCSGATEWAY         (SIOCDEVPRIVATE + 3)
+#define  TRIPLE_IOCPERIODIC         (SIOCDEVPRIVATE + 4)
+#define  TRIPLE_IOCSTXQ             (SIOCDEVPRIVATE + 5)
+#define  TRIPLE_IOCSBITRATE         (SIOCDEVPRIVATE + 6)
+#define  TRIPLE_IOCSIDSTATS         (SIOCDEVPRIVATE + 7)
+
+#endif //__TRIPLE_IOCTL_H__
@@ -6,5 +6,6 @@
 /*--------------------------------------*/
 int TripleSendHex(TRIPLE_CAN_FRAME *frame);
 int  TripleRecvHex (TRIPLE_CAN_FRAME *frame);
+int  TripleSendCmd (unsigned char *p, unsigned char cmd, const unsigned char *data, int n);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,81 @@
+#ifndef __TRIPLE_RXRING_H__
+#define __TRIPLE_RXRING_H__
+
+/*
+ * Memory mapped RX ring of one adapter, /dev/triplecan-<tty>.
+ *
+ * With the module parameter rx_ring_frames set, the decoder appends every
+ * received CAN frame of all three channels (before filters, change-only
+ * mode and the gateway) to a ring the reader opens O_RDWR and maps shared:
+ *
+ *   offset 0                     struct triple_rxring_hdr
+ *   offset hdr->offset           hdr->frames * struct triple_rxring_frame
+ *
+ * The driver advances head, the reader advances tail; both count frames
+ * and wrap freely, the slot is index & (frames - 1). A full ring drops the
+ * new frame and counts it in dropped. poll() reports readable once
+ * head - tail reaches wake (1 when 0), so a reader sleeping on a large
+ * threshold should poll with a timeout to pick up the rest.
+ *
+ * Shared by the driver and userspace, keep it free of kernel only types.
+ */
+
+#include <linux/types.h>
+
+#define  TRIPLE_RXRING_MAGIC        0x54524952  /* "TRIR"            */
+#define  TRIPLE_RXRING_VERSION      1
+
+#define  TRIPLE_RXRING_FD           0x01
+#define  TRIPLE_RXRING_BRS          0x02
+#define  TRIPLE_RXRING_ESI          0x04
+
+struct triple_rxring_frame
+{
+  __u64  tstamp_ns;                     /* CLOCK_MONOTONIC, arrival at the ldisc */
+  __u32  can_id;                        /* CAN_EFF_FLAG / CAN_RTR_FLAG as in SocketCAN */
+  __u8   channel;                       /* 0 - 2                     */
+  __u8   flags;                         /* TRIPLE_RXRING_*           */
+  __u8   len;                           /* data bytes, 0 for RTR     */
+  __u8   reserved;
+  __u8   data[64];
+};
+
+struct triple_rxring_hdr
+{
+  __u32  magic;
+  __u32  version;
+  __u32  frames;                        /* slots, power of 2         */
+  __u32  frame_size;                    /* sizeof(struct triple_rxring_frame) */
+  __u32  offset;                        /* first slot                */
+  __u32  reserved0[11];
+
+  /* written by the driver, own cache line */
+  __u32  head;
+  __u32  reserved1;
+  __u64  dropped;                       /* frames lost to a full ring */
+  __u32  reserved2[12];
+
+  /* written by the reader */
+  __u32  tail;
+  __u32  wake;                          /* poll threshold in frames  */
+};
+
+#ifndef __KERNEL__
+/* Oldest unread frame or NULL, then triple_rxring_release() once done with it */
+static inline const struct triple_rxring_frame *triple_rxring_peek (const struct triple_rxring_hdr *h, __u32 n)
+{
+  __u32 head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+
+  if (head - h->tail <= n)
+    return NULL;
+
+  return (const struct triple_rxring_frame *) ((const char *) h + h->offset) + ((h->tail + n) & (h->frames - 1));
+}
+
+static inline void triple_rxring_release (struct triple_rxring_hdr *h, __u32 n)
+{
+  __atomic_store_n(&h->tail, h->tail + n, __ATOMIC_RELEASE);
+}
+#endif
+
+#endif //__TRIPLE_RXRING_H__
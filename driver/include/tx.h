@@ -3,16 +3,70 @@
 
 
 #include <linux/can.h>
-#include <linux/workqueue.h>
+#include <linux/kthread.h>
 #include <linux/netdevice.h>
+#include <linux/ktime.h>
+#include <linux/version.h>
+#include <net/sock.h>
 
 #include "triple_helper.h"
 #include "triple_parse.h"
+#include "triple_ioctl.h"
+
+/* driver private part of TX skbs (skb->cb is ours once in ndo_start_xmit) */
+struct triple_skb_cb
+{
+  ktime_t  due;                         /* periodic: scheduled time  */
+  ktime_t  queued;                      /* entered the channel queue */
+  ktime_t  deadline;                    /* not sent after -> dropped, 0 -> none */
+  u32      key;                         /* triple_arb_key()          */
+  int      channel;
+};
+
+#define TRIPLE_SKB_CB(skb)  ((struct triple_skb_cb *)(skb)->cb)
+
+/*
+ * Order in which frames win arbitration on the bus, lower wins: the 11 bit
+ * base id, then RTR (SFF) or SRR (EFF, recessive), IDE, the 18 bit id
+ * extension and the EFF RTR bit.
+ */
+static inline u32 triple_arb_key (canid_t can_id)
+{
+  u32 rtr = !!(can_id & CAN_RTR_FLAG);
+
+  if (!(can_id & CAN_EFF_FLAG))
+    return ((can_id & CAN_SFF_MASK) << 21) | (rtr << 20);
+
+  return (((can_id >> 18) & CAN_SFF_MASK) << 21) | (1 << 20) | (1 << 19) | ((can_id & 0x3FFFF) << 1) | rtr;
+
+} /* END: triple_arb_key() */
+
+/* skb->tstamp was set by the sender with SO_TXTIME, not by the driver */
+static inline bool triple_tx_has_txtime (const struct sk_buff *skb)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+  return skb->sk && sk_fullsock(skb->sk) && sock_flag(skb->sk, SOCK_TXTIME);
+#else
+  return false;
+#endif
+
+} /* END: triple_tx_has_txtime() */
 
 void triple_unesc   (USB2CAN_TRIPLE *adapter, unsigned char s);
 void triple_bump    (USB2CAN_TRIPLE *adapter);
+int  triple_tty_write(USB2CAN_TRIPLE *adapter, const unsigned char *buf, int len);
 void triple_encaps  (USB2CAN_TRIPLE *adapter, int channel, struct can_frame *cf);
 void triple_encaps_fd  (USB2CAN_TRIPLE *adapter, int channel, struct canfd_frame *cf);
-void triple_transmit(struct work_struct *work);
+struct sk_buff *triple_alloc_skb(struct net_device *dev, bool fd);
+int  triple_txq_config(USB2CAN_TRIPLE *adapter, const struct triple_txq_cfg *cfg);
+int  triple_tx_enqueue(USB2CAN_TRIPLE *adapter, int channel, struct sk_buff *skb);
+void triple_tx_kick (USB2CAN_TRIPLE *adapter);
+void triple_delay_account(TRIPLE_CHAN_STATS *st, ktime_t now, ktime_t due);
+void triple_tx_purge(USB2CAN_TRIPLE *adapter, int channel);
+void triple_transmit(struct kthread_work *work);
+void triple_tx_watchdog(struct kthread_work *work);
+void triple_tx_watchdog_start(USB2CAN_TRIPLE *adapter);
+void triple_tx_watchdog_stop(USB2CAN_TRIPLE *adapter);
+void triple_receive (struct kthread_work *work);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,12 @@
+#ifndef __WORKER_H__
+#define __WORKER_H__
+
+#include "triple_helper.h"
+#include "triple_ioctl.h"
+
+int  triple_worker_start (USB2CAN_TRIPLE *adapter, const char *name);
+void triple_worker_stop  (USB2CAN_TRIPLE *adapter);
+int  triple_worker_config(USB2CAN_TRIPLE *adapter, const struct triple_worker_cfg *cfg);
+void triple_rx_queue     (USB2CAN_TRIPLE *adapter, const unsigned char *cp, int count, ktime_t stamp);
+
+#endif
@@ -48,6 +48,18 @@
 #include <linux/if_arp.h>
 
 #include "tx.h"
+#include "worker.h"
+#include "filter.h"
+#include "change.h"
+#include "gateway.h"
+#include "periodic.h"
+#include "probe.h"
+#include "busload.h"
+#include "idstats.h"
+#include "rxring.h"
+#include "tap.h"
+#include "debugfs.h"
+#include "triple_ioctl.h"
 
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("TripleCAN interface driver");
@@ -101,14 +113,32 @@ static struct tty_ldisc_ops triple_ldisc =
 static int triple_netdev_open (struct net_device *dev);
 static int triple_netdev_close(struct net_device *dev);
 static netdev_tx_t triple_xmit(struct sk_buff *skb, struct net_device *dev);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,2,0)
+static u16 triple_select_queue(struct net_device *dev, struct sk_buff *skb, struct net_device *sb_dev);
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+static u16 triple_select_queue(struct net_device *dev, struct sk_buff *skb, struct net_device *sb_dev, select_queue_fallback_t fallback);
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(3,14,0)
+static u16 triple_select_queue(struct net_device *dev, struct sk_buff *skb, void *accel_priv, select_queue_fallback_t fallback);
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(3,13,0)
+static u16 triple_select_queue(struct net_device *dev, struct sk_buff *skb, void *accel_priv);
+#else
+static u16 triple_select_queue(struct net_device *dev, struct sk_buff *skb);
+#endif
 static int triple_change_mtu  (struct net_device *dev, int new_mtu);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+static void triple_tx_timeout(struct net_device *dev, unsigned int txqueue);
+#else
+static void triple_tx_timeout(struct net_device *dev);
+#endif
 
 static struct net_device_ops triple_netdev_ops =
 {
   .ndo_open       = triple_netdev_open,
   .ndo_stop       = triple_netdev_close,
   .ndo_start_xmit = triple_xmit,
+  .ndo_select_queue = triple_select_queue,
   .ndo_change_mtu = triple_change_mtu,
+  .ndo_tx_timeout = triple_tx_timeout,
 };
 
 /* internal function */
@@ -147,8 +177,11 @@ static int __init triple_init (void)
   {
     printk(KERN_ERR "triple: can't register line discipline\n");
     kfree(triple_devs);
+    return status;
   }
 
+  triple_debugfs_init();
+
   return status;
 
 
@@ -231,20 +264,34 @@ static void __exit triple_exit (void)
   triple_devs = NULL;
 
   tty_unregister_ldisc(&triple_ldisc);
+  triple_debugfs_exit();
+
+  /* Wait for deferred frees of per channel tables */
+  rcu_barrier();
 
 } /* END: triple_exit() */
 
 static void triple_receive_buf (struct tty_struct *tty, const unsigned char *cp, const char *fp, int count)
 {
   USB2CAN_TRIPLE *adapter = (USB2CAN_TRIPLE *) tty->disc_data;
+  ktime_t         stamp = ktime_get();    /* one clock read for the whole chunk */
+  int             run;
 
   if (!adapter || adapter->magic != TRIPLE_MAGIC || (!netif_running(adapter->devs[0]) && !netif_running(adapter->devs[1]) && !netif_running(adapter->devs[2])))
     return;
 
-  /* Read the characters out of the buffer */
-  while (count--)
+  triple_tap(adapter, TRIPLE_TAP_RX, cp, count);
+
+  /* Decoding happens on the adapter worker, here we only queue the bytes */
+  if (!fp)
+  {
+    triple_rx_queue(adapter, cp, count, stamp);
+    return;
+  }
+
+  while (count > 0)
   {
-    if (fp && *fp++)
+    if (*fp)
     {
       if (!test_and_set_bit(SLF_ERROR, &adapter->flags))
       {
@@ -259,9 +306,19 @@ static void triple_receive_buf (struct tty_struct *tty, const unsigned char *cp,
       }
 
       cp++;
+      fp++;
+      count--;
       continue;
     }
-    triple_unesc(adapter, *cp++);
+
+    /* Queue the run of good characters at once */
+    for (run = 0; run < count && !fp[run]; run++)
+      ;
+
+    triple_rx_queue(adapter, cp, run, stamp);
+    cp    += run;
+    fp    += run;
+    count -= run;
   }
 
 } /* END: triple_receive_buf() */
@@ -303,16 +360,35 @@ static int triple_open (struct tty_struct *tty)
   if (!adapter)
     goto ERR_EXIT;
 
+  /* Dedicated RX decode / TX drain context of this adapter. */
+  err = triple_worker_start(adapter, tty->name);
+  if (err)
+  {
+    kfree(adapter);
+    goto ERR_EXIT;
+  }
+
+  err = triple_periodic_init(adapter);
+  if (err)
+  {
+    triple_worker_stop(adapter);
+    kfree(adapter);
+    goto ERR_EXIT;
+  }
+
   /* OK.  Find a free triple channel to use. */
   err = -ENFILE;
   if (triple_alloc(tty_devnum(tty), adapter) != 0)
   {
+    triple_periodic_stop(adapter);
+    triple_worker_stop(adapter);
     kfree(adapter);
     goto ERR_EXIT;
   }
 
   adapter->tty = tty;
   tty->disc_data = adapter;
+  triple_debugfs_add(adapter, tty->name);
 
   if (!test_bit(SLF_INUSE, &adapter->flags))
   {
@@ -343,6 +419,10 @@ static int triple_open (struct tty_struct *tty)
 
   }
 
+  triple_tx_watchdog_start(adapter);
+  triple_probe_init(adapter);   /* optional, no probe on failure */
+  triple_rxring_init(adapter, tty->name);   /* optional, no ring on failure */
+
   /* Done.  We have linked the TTY line to a channel. */
   rtnl_unlock();
   tty->receive_room = 65536;  /* We don't flow control */
@@ -351,10 +431,13 @@ static int triple_open (struct tty_struct *tty)
   return 0;
 
 ERR_FREE_CHAN:
+  /* undo what triple_close() would, the watchdog, probe and ring are not up yet */
+  triple_debugfs_remove(adapter);
+  triple_periodic_stop(adapter);
+  triple_worker_stop(adapter);
   adapter->tty = NULL;
   tty->disc_data = NULL;
   clear_bit(SLF_INUSE, &adapter->flags);
-  rtnl_unlock();
 
 ERR_EXIT:
   rtnl_unlock();
@@ -383,7 +466,29 @@ static void triple_close (struct tty_struct *tty)
   adapter->tty = NULL;
   spin_unlock_bh(&adapter->lock);
 
-  flush_work(&adapter->tx_work);
+  triple_debugfs_remove(adapter);
+  triple_tx_watchdog_stop(adapter);
+  triple_probe_stop(adapter);
+  triple_periodic_stop(adapter);
+  triple_worker_stop(adapter);
+  triple_rxring_remove(adapter);
+
+  spin_lock_bh(&adapter->lock);
+  triple_tx_purge(adapter, 0);
+  triple_tx_purge(adapter, 1);
+  triple_tx_purge(adapter, 2);
+  __skb_queue_purge(&adapter->pq);
+  if (adapter->tx_skb)
+  {
+    kfree_skb(adapter->tx_skb);
+    adapter->tx_skb = NULL;
+  }
+  spin_unlock_bh(&adapter->lock);
+  triple_filter_free(adapter);
+  triple_change_free(adapter);
+  triple_gateway_free(adapter);
+  triple_idstats_free(adapter);
+  triple_tap_free(adapter);
 
   /* Flush network side */
   unregister_netdev(adapter->devs[0]);
@@ -446,6 +551,110 @@ static int triple_ioctl (struct tty_struct *tty, struct file *file, unsigned int
   case SIOCSIFHWADDR:
     return -EINVAL;
 
+  case TRIPLE_IOCSWORKER:
+  {
+    struct triple_worker_cfg cfg;
+
+    if (!capable(CAP_NET_ADMIN))
+      return -EPERM;
+
+    if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+      return -EFAULT;
+
+    return triple_worker_config(adapter, &cfg);
+  }
+
+  case TRIPLE_IOCSFILTER:
+  {
+    struct triple_filter_cfg cfg;
+
+    if (!capable(CAP_NET_ADMIN))
+      return -EPERM;
+
+    if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+      return -EFAULT;
+
+    return triple_filter_set(adapter, &cfg);
+  }
+
+  case TRIPLE_IOCSCHANGE:
+  {
+    struct triple_change_cfg cfg;
+
+    if (!capable(CAP_NET_ADMIN))
+      return -EPERM;
+
+    if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+      return -EFAULT;
+
+    return triple_change_set(adapter, &cfg);
+  }
+
+  case TRIPLE_IOCSGATEWAY:
+  {
+    struct triple_gw_cfg cfg;
+
+    if (!capable(CAP_NET_ADMIN))
+      return -EPERM;
+
+    if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+      return -EFAULT;
+
+    return triple_gateway_set(adapter, &cfg);
+  }
+
+  case TRIPLE_IOCPERIODIC:
+  {
+    struct triple_periodic_cmd cmd;
+
+    if (!capable(CAP_NET_ADMIN))
+      return -EPERM;
+
+    if (copy_from_user(&cmd, (void __user *)arg, sizeof(cmd)))
+      return -EFAULT;
+
+    return triple_periodic_cmd(adapter, &cmd);
+  }
+
+  case TRIPLE_IOCSTXQ:
+  {
+    struct triple_txq_cfg cfg;
+
+    if (!capable(CAP_NET_ADMIN))
+      return -EPERM;
+
+    if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+      return -EFAULT;
+
+    return triple_txq_config(adapter, &cfg);
+  }
+
+  case TRIPLE_IOCSBITRATE:
+  {
+    struct triple_bitrate_cfg cfg;
+
+    if (!capable(CAP_NET_ADMIN))
+      return -EPERM;
+
+    if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+      return -EFAULT;
+
+    return triple_busload_config(adapter, &cfg);
+  }
+
+  case TRIPLE_IOCSIDSTATS:
+  {
+    struct triple_idstats_cfg cfg;
+
+    if (!capable(CAP_NET_ADMIN))
+      return -EPERM;
+
+    if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+      return -EFAULT;
+
+    return triple_idstats_set(adapter, &cfg);
+  }
+
   default:
     return tty_mode_ioctl(tty, cmd, arg);
   }
@@ -460,7 +669,10 @@ static void triple_write_wakeup (struct tty_struct *tty)
 
   USB2CAN_TRIPLE *adapter = tty->disc_data;
 
-  schedule_work(&adapter->tx_work);
+  if (!adapter || !adapter->worker)
+    return;
+
+  kthread_queue_work(adapter->worker, &adapter->tx_work);
 
 
 } /* END: triple_write_wakeup() */
@@ -483,7 +695,7 @@ static int triple_netdev_open (struct net_device *dev)
     return -ENODEV;
 
   adapter->flags &= (1 << SLF_INUSE);
-  netif_start_queue(dev);
+  netif_tx_start_all_queues(dev);
 
   return 0;
 
@@ -513,7 +725,8 @@ static int triple_netdev_close (struct net_device *dev)
       clear_bit(TTY_DO_WRITE_WAKEUP, &adapter->tty->flags);
   }
 
-  netif_stop_queue(dev);
+  netif_tx_stop_all_queues(dev);
+  triple_tx_purge(adapter, channel);
 
   if (!netif_running(adapter->devs[!channel]))
   {
@@ -566,22 +779,18 @@ static netdev_tx_t triple_xmit (struct sk_buff *skb, struct net_device *dev)
     goto OUT;
   }
 
-  netif_stop_queue(adapter->devs[0]);
-  netif_stop_queue(adapter->devs[1]);
-  netif_stop_queue(adapter->devs[2]);
-
-  int can_fd_channel = 2;
-
-  if ((channel == can_fd_channel) && (adapter->can_fd)) //CAN_FD
+  /* The queue is stopped when it fills up, so this should not happen */
+  if (triple_tx_enqueue(adapter, channel, skb))
   {
-    triple_encaps_fd(adapter, 2, (struct canfd_frame *) skb->data); // sockatCAN frame -> Triple HW (ttyWrite)
-  }
-  else //CAN 2.0
-  {
-    triple_encaps(adapter, channel, (struct can_frame *) skb->data); // sockatCAN frame -> Triple HW (ttyWrite)
+    netif_stop_subqueue(dev, skb_get_queue_mapping(skb));
+    spin_unlock(&adapter->lock);
+    return NETDEV_TX_BUSY;
   }
 
+  triple_tx_kick(adapter);
+
   spin_unlock(&adapter->lock);
+  return NETDEV_TX_OK;
 
 OUT:
   kfree_skb(skb);
@@ -589,6 +798,65 @@ OUT:
 
 } /* END: triple_xmit() */
 
+/*
+ * TX queue (band) of a frame, band 0 is sent first. With mqprio the
+ * configured priority -> tc -> queue map is used, otherwise SO_PRIORITY:
+ * 0 -> bulk (last band), 1 .. TRIPLE_TX_BANDS-1 -> more urgent bands.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,2,0)
+static u16 triple_select_queue (struct net_device *dev, struct sk_buff *skb, struct net_device *sb_dev)
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+static u16 triple_select_queue (struct net_device *dev, struct sk_buff *skb, struct net_device *sb_dev, select_queue_fallback_t fallback)
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(3,14,0)
+static u16 triple_select_queue (struct net_device *dev, struct sk_buff *skb, void *accel_priv, select_queue_fallback_t fallback)
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(3,13,0)
+static u16 triple_select_queue (struct net_device *dev, struct sk_buff *skb, void *accel_priv)
+#else
+static u16 triple_select_queue (struct net_device *dev, struct sk_buff *skb)
+#endif
+{
+  /* Runs before the qdisc, the TX max age counts from here */
+  if (!skb->tstamp && !triple_tx_has_txtime(skb))
+  {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,11,0)
+    skb_set_delivery_time(skb, ktime_get(), SKB_CLOCK_MONOTONIC);
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5,18,0)
+    skb_set_delivery_time(skb, ktime_get(), true);
+#else
+    skb->tstamp = ktime_get();
+#endif
+  }
+
+  if (netdev_get_num_tc(dev))
+    return dev->tc_to_txq[netdev_get_prio_tc_map(dev, skb->priority)].offset;
+
+  return TRIPLE_TX_BANDS - 1 - min_t(u32, skb->priority, TRIPLE_TX_BANDS - 1);
+
+} /* END: triple_select_queue() */
+
+/* A TX queue stayed stopped for watchdog_timeo, let the TX watchdog look */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+static void triple_tx_timeout (struct net_device *dev, unsigned int txqueue)
+#else
+static void triple_tx_timeout (struct net_device *dev)
+#endif
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  USB2CAN_TRIPLE  *adapter = ((TRIPLE_PRIV *) netdev_priv(dev))->adapter;
+
+  printk(KERN_WARNING "%s: transmit timed out\n", dev->name);
+
+  /* triple_close() clears tty under the lock before the worker goes away */
+  spin_lock_bh(&adapter->lock);
+  if (adapter->tty && adapter->worker)
+    kthread_queue_work(adapter->worker, &adapter->wd_work);
+  spin_unlock_bh(&adapter->lock);
+
+} /* END: triple_tx_timeout() */
+
 static int triple_change_mtu (struct net_device *dev, int new_mtu)
 {
   /*=======================================================*/
@@ -636,6 +904,7 @@ static int triple_alloc (dev_t line, USB2CAN_TRIPLE *adapter)
 
   int                 i;
   int                 channel;
+  int                 band;
   int                 id[3];
   char                name[IFNAMSIZ];
   struct net_device  *dev;
@@ -665,9 +934,9 @@ static int triple_alloc (dev_t line, USB2CAN_TRIPLE *adapter)
   sprintf(name, "triplecan%d", id[0]);
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3,17,0)
-  devs[0] = alloc_netdev(sizeof(*priv), name, triple_setup);
+  devs[0] = alloc_netdev_mqs(sizeof(*priv), name, triple_setup, TRIPLE_TX_BANDS, 1);
 #else
-  devs[0] = alloc_netdev(sizeof(*priv), name, NET_NAME_UNKNOWN, triple_setup);
+  devs[0] = alloc_netdev_mqs(sizeof(*priv), name, NET_NAME_UNKNOWN, triple_setup, TRIPLE_TX_BANDS, 1);
 #endif
 
   if (!devs[0])
@@ -676,9 +945,9 @@ static int triple_alloc (dev_t line, USB2CAN_TRIPLE *adapter)
   sprintf(name, "triplecan%d", id[1]);
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3,17,0)
-  devs[1] = alloc_netdev(sizeof(*priv), name, triple_setup);
+  devs[1] = alloc_netdev_mqs(sizeof(*priv), name, triple_setup, TRIPLE_TX_BANDS, 1);
 #else
-  devs[1] = alloc_netdev(sizeof(*priv), name, NET_NAME_UNKNOWN, triple_setup);
+  devs[1] = alloc_netdev_mqs(sizeof(*priv), name, NET_NAME_UNKNOWN, triple_setup, TRIPLE_TX_BANDS, 1);
 #endif
 
   if (!devs[1])
@@ -693,17 +962,17 @@ static int triple_alloc (dev_t line, USB2CAN_TRIPLE *adapter)
   {
     printk("---------------->canfd alloc netdev\n");
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3,17,0)
-    devs[2] = alloc_netdev(sizeof(*priv), name, triple_fd_setup);
+    devs[2] = alloc_netdev_mqs(sizeof(*priv), name, triple_fd_setup, TRIPLE_TX_BANDS, 1);
 #else
-    devs[2] = alloc_netdev(sizeof(*priv), name, NET_NAME_UNKNOWN, triple_fd_setup);
+    devs[2] = alloc_netdev_mqs(sizeof(*priv), name, NET_NAME_UNKNOWN, triple_fd_setup, TRIPLE_TX_BANDS, 1);
 #endif
   }
   else
   {
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3,17,0)
-    devs[2] = alloc_netdev(sizeof(*priv), name, triple_setup);
+    devs[2] = alloc_netdev_mqs(sizeof(*priv), name, triple_setup, TRIPLE_TX_BANDS, 1);
 #else
-    devs[2] = alloc_netdev(sizeof(*priv), name, NET_NAME_UNKNOWN, triple_setup);
+    devs[2] = alloc_netdev_mqs(sizeof(*priv), name, NET_NAME_UNKNOWN, triple_setup, TRIPLE_TX_BANDS, 1);
 #endif
   }
 
@@ -738,8 +1007,13 @@ static int triple_alloc (dev_t line, USB2CAN_TRIPLE *adapter)
   triple_devs[id[1]] = devs[1];
   triple_devs[id[2]] = devs[2];
   spin_lock_init(&adapter->lock);
+  for (channel = 0; channel < 3; channel++)
+  {
+    for (band = 0; band < TRIPLE_TX_BANDS; band++)
+      skb_queue_head_init(&adapter->txq[channel][band]);
+  }
+  skb_queue_head_init(&adapter->pq);
   atomic_set(&adapter->ref_count, 3); //?
-  INIT_WORK(&adapter->tx_work, triple_transmit);
 
   return 0;
 
@@ -768,7 +1042,7 @@ static void triple_setup (struct net_device *dev)
   dev->type = ARPHRD_CAN;
 
   /* New-style flags. */
-  dev->flags    = IFF_NOARP;
+  dev->flags    = IFF_NOARP | IFF_ECHO;  /* loopback from triple_tx_complete() */
   dev->features = NETIF_F_HW_CSUM;
 
 
@@ -796,7 +1070,7 @@ static void triple_fd_setup (struct net_device *dev)
   dev->type = ARPHRD_CAN;
 
   /* New-style flags. */
-  dev->flags    = IFF_NOARP;
+  dev->flags    = IFF_NOARP | IFF_ECHO;  /* loopback from triple_tx_complete() */
   dev->features = NETIF_F_HW_CSUM;
 
 
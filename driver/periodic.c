@@ -0,0 +1,345 @@
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/skbuff.h>
+#include <linux/netdevice.h>
+#include <linux/version.h>
+
+#include "tx.h"
+#include "periodic.h"
+
+extern bool trace_func_main;
+extern void print_func_trace (bool is_trace, int line, const char *func);
+
+/* Entries due within this window are released together. */
+#define TRIPLE_PERIODIC_SLACK_NS  20000
+
+static inline u64 triple_periodic_key (int channel, canid_t can_id)
+{
+  return ((u64) channel << 32) | (can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_EFF_MASK));
+}
+
+static struct triple_periodic_entry *triple_periodic_find (struct triple_periodic *p, int channel, canid_t can_id)
+{
+  struct triple_periodic_entry *e;
+  u64                           key = triple_periodic_key(channel, can_id);
+
+  hash_for_each_possible(p->ids, e, hnode, key)
+  {
+    if (triple_periodic_key(e->channel, e->frame.can_id) == key)
+      return e;
+  }
+
+  return NULL;
+
+} /* END: triple_periodic_find() */
+
+/* p->lock held */
+static void triple_periodic_arm (struct triple_periodic *p)
+{
+  struct timerqueue_node *next = timerqueue_getnext(&p->queue);
+
+  if (next && !p->stopping)
+    hrtimer_start(&p->timer, next->expires, HRTIMER_MODE_ABS);
+
+} /* END: triple_periodic_arm() */
+
+static enum hrtimer_restart triple_periodic_timer (struct hrtimer *timer)
+{
+  struct triple_periodic *p = container_of(timer, struct triple_periodic, timer);
+
+  kthread_queue_work(p->adapter->worker, &p->work);
+
+  return HRTIMER_NORESTART;
+
+} /* END: triple_periodic_timer() */
+
+/* Build the skb of a due entry, p->lock held */
+static struct sk_buff *triple_periodic_skb (USB2CAN_TRIPLE *adapter, struct triple_periodic_entry *e)
+{
+  struct sk_buff *skb;
+  size_t          size = e->fd ? sizeof(struct canfd_frame) : sizeof(struct can_frame);
+
+  skb = triple_alloc_skb(adapter->devs[e->channel], e->fd);
+  if (!skb)
+    return NULL;
+
+  memcpy(skb_put(skb, size), &e->frame, size);
+  TRIPLE_SKB_CB(skb)->due     = e->node.expires;
+  TRIPLE_SKB_CB(skb)->channel = e->channel;
+
+  return skb;
+
+} /* END: triple_periodic_skb() */
+
+static void triple_periodic_work (struct kthread_work *work)
+{
+  struct triple_periodic        *p = container_of(work, struct triple_periodic, work);
+  USB2CAN_TRIPLE                *adapter = p->adapter;
+  struct triple_periodic_entry  *e;
+  struct timerqueue_node        *node;
+  struct sk_buff_head            due;
+  struct sk_buff                *skb;
+  ktime_t                        now = ktime_get();
+  ktime_t                        horizon = ktime_add_ns(now, TRIPLE_PERIODIC_SLACK_NS);
+  u64                            late;
+
+  __skb_queue_head_init(&due);
+
+  spin_lock_bh(&p->lock);
+
+  while ((node = timerqueue_getnext(&p->queue)) && ktime_compare(node->expires, horizon) <= 0)
+  {
+    e = container_of(node, struct triple_periodic_entry, node);
+    timerqueue_del(&p->queue, node);
+
+    late = ktime_compare(now, node->expires) > 0 ? ktime_to_ns(ktime_sub(now, node->expires)) : 0;
+    if (late > e->release_max)
+      e->release_max = late;
+
+    if (netif_running(adapter->devs[e->channel]))
+    {
+      skb = triple_periodic_skb(adapter, e);
+      if (skb)
+      {
+        __skb_queue_tail(&due, skb);
+        e->sent++;
+      }
+      else
+        adapter->cstats[e->channel].pe_overruns++;
+    }
+
+    /* Keep the phase, skip periods we are too late for */
+    node->expires = ktime_add(node->expires, e->period);
+    while (ktime_compare(node->expires, now) <= 0)
+    {
+      node->expires = ktime_add(node->expires, e->period);
+      adapter->cstats[e->channel].pe_overruns++;
+    }
+
+    timerqueue_add(&p->queue, node);
+  }
+
+  triple_periodic_arm(p);
+  spin_unlock_bh(&p->lock);
+
+  if (skb_queue_empty(&due))
+    return;
+
+  spin_lock_bh(&adapter->lock);
+
+  while ((skb = __skb_dequeue(&due)))
+  {
+    if (!adapter->tty || skb_queue_len(&adapter->pq) >= TRIPLE_PQ_LEN)
+    {
+      adapter->cstats[TRIPLE_SKB_CB(skb)->channel].pe_overruns++;
+      kfree_skb(skb);
+      continue;
+    }
+
+    __skb_queue_tail(&adapter->pq, skb);
+  }
+
+  triple_tx_kick(adapter);
+  spin_unlock_bh(&adapter->lock);
+
+} /* END: triple_periodic_work() */
+
+int triple_periodic_init (USB2CAN_TRIPLE *adapter)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  struct triple_periodic *p;
+
+  p = kzalloc(sizeof(*p), GFP_KERNEL);
+  if (!p)
+    return -ENOMEM;
+
+  spin_lock_init(&p->lock);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,13,0)
+  hrtimer_setup(&p->timer, triple_periodic_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+#else
+  hrtimer_init(&p->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+  p->timer.function = triple_periodic_timer;
+#endif
+  kthread_init_work(&p->work, triple_periodic_work);
+  timerqueue_init_head(&p->queue);
+  hash_init(p->ids);
+  p->adapter = adapter;
+
+  adapter->periodic = p;
+  return 0;
+
+} /* END: triple_periodic_init() */
+
+int triple_periodic_cmd (USB2CAN_TRIPLE *adapter, const struct triple_periodic_cmd *cmd)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  struct triple_periodic        *p = adapter->periodic;
+  struct triple_periodic_entry  *e;
+  struct triple_periodic_entry  *new = NULL;
+  struct hlist_node             *tmp;
+  int                            bkt;
+  int                            maxlen;
+  int                            err = 0;
+
+  if (cmd->channel > 2)
+    return -EINVAL;
+
+  maxlen = cmd->fd ? CANFD_MAX_DLEN : CAN_MAX_DLEN;
+  if (cmd->fd && !(cmd->channel == 2 && adapter->can_fd))
+    return -EINVAL;
+
+  if ((cmd->op == TRIPLE_PERIODIC_ADD || cmd->op == TRIPLE_PERIODIC_UPDATE) && cmd->frame.len > maxlen)
+    return -EINVAL;
+
+  if (cmd->op == TRIPLE_PERIODIC_ADD)
+  {
+    /* a period shorter than a frame on the wire makes no sense */
+    if (cmd->period_us < 100)
+      return -EINVAL;
+
+    new = kzalloc(sizeof(*new), GFP_KERNEL);
+    if (!new)
+      return -ENOMEM;
+
+    timerqueue_init(&new->node);
+    new->period  = us_to_ktime(cmd->period_us);
+    new->channel = cmd->channel;
+    new->fd      = cmd->fd;
+    new->frame   = cmd->frame;
+  }
+
+  spin_lock_bh(&p->lock);
+
+  e = triple_periodic_find(p, cmd->channel, cmd->frame.can_id);
+
+  switch (cmd->op)
+  {
+  case TRIPLE_PERIODIC_ADD:
+    if (e)
+      err = -EEXIST;
+    else if (p->count >= TRIPLE_PERIODIC_MAX)
+      err = -ENOSPC;
+    else
+    {
+      /* first copy goes out right away */
+      new->node.expires = ktime_get();
+      hash_add(p->ids, &new->hnode, triple_periodic_key(new->channel, new->frame.can_id));
+      timerqueue_add(&p->queue, &new->node);
+      p->count++;
+      new = NULL;
+      triple_periodic_arm(p);
+    }
+    break;
+
+  case TRIPLE_PERIODIC_UPDATE:
+    if (!e)
+    {
+      err = -ENOENT;
+      break;
+    }
+
+    e->frame.len   = cmd->frame.len;
+    e->frame.flags = cmd->frame.flags;
+    memcpy(e->frame.data, cmd->frame.data, sizeof(e->frame.data));
+    if (cmd->period_us >= 100)
+      e->period = us_to_ktime(cmd->period_us);
+    break;
+
+  case TRIPLE_PERIODIC_REMOVE:
+    if (!e)
+    {
+      err = -ENOENT;
+      break;
+    }
+
+    timerqueue_del(&p->queue, &e->node);
+    hash_del(&e->hnode);
+    p->count--;
+    kfree(e);
+    break;
+
+  case TRIPLE_PERIODIC_FLUSH:
+    hash_for_each_safe(p->ids, bkt, tmp, e, hnode)
+    {
+      if (e->channel != cmd->channel)
+        continue;
+
+      timerqueue_del(&p->queue, &e->node);
+      hash_del(&e->hnode);
+      p->count--;
+      kfree(e);
+    }
+    break;
+
+  default:
+    err = -EINVAL;
+  }
+
+  spin_unlock_bh(&p->lock);
+
+  kfree(new);
+  return err;
+
+} /* END: triple_periodic_cmd() */
+
+/* Before the worker goes away: the timer must not queue work anymore. */
+void triple_periodic_stop (USB2CAN_TRIPLE *adapter)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  struct triple_periodic        *p = adapter->periodic;
+  struct triple_periodic_entry  *e;
+  struct hlist_node             *tmp;
+  int                            bkt;
+
+  if (!p)
+    return;
+
+  spin_lock_bh(&p->lock);
+  p->stopping = true;
+  spin_unlock_bh(&p->lock);
+
+  hrtimer_cancel(&p->timer);
+  kthread_cancel_work_sync(&p->work);
+
+  hash_for_each_safe(p->ids, bkt, tmp, e, hnode)
+  {
+    hash_del(&e->hnode);
+    kfree(e);
+  }
+
+  adapter->periodic = NULL;
+  kfree(p);
+
+} /* END: triple_periodic_stop() */
+
+void triple_periodic_show (USB2CAN_TRIPLE *adapter, struct seq_file *m)
+{
+  struct triple_periodic        *p = adapter->periodic;
+  struct triple_periodic_entry  *e;
+  int                            bkt;
+
+  if (!p)
+    return;
+
+  seq_printf(m, "%-4s %-10s %-4s %-10s %-12s %s\n", "chan", "id", "len", "period_us", "sent", "release_max_ns");
+
+  spin_lock_bh(&p->lock);
+
+  hash_for_each(p->ids, bkt, e, hnode)
+  {
+    seq_printf(m, "%-4d %08X   %-4u %-10lld %-12lu %llu\n", e->channel, e->frame.can_id, e->frame.len,
+               ktime_to_us(e->period), e->sent, e->release_max);
+  }
+
+  spin_unlock_bh(&p->lock);
+
+} /* END: triple_periodic_show() */
@@ -0,0 +1,202 @@
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/tty.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+
+#include "triple_parse.h"
+#include "probe.h"
+#include "tx.h"
+
+extern bool trace_func_main;
+extern void print_func_trace (bool is_trace, int line, const char *func);
+
+static unsigned int rtt_probe_ms = 0;
+module_param(rtt_probe_ms, uint, 0644);
+MODULE_PARM_DESC(rtt_probe_ms, "Interval of the host <-> adapter round trip probe (0 = off, at most 60000)");
+
+static bool rtt_probe_status = false;
+module_param(rtt_probe_status, bool, 0644);
+MODULE_PARM_DESC(rtt_probe_status, "Probe with status requests instead of markers (firmware without marker echo)");
+
+/* A marker without answer after this long is counted as lost */
+#define TRIPLE_PROBE_LOST_MS  1000
+
+/* Longer rtt_probe_ms values are taken as this */
+#define TRIPLE_PROBE_MAX_MS   60000
+
+static void triple_probe_work (struct kthread_work *work)
+{
+  struct kthread_delayed_work  *dwork = container_of(work, struct kthread_delayed_work, work);
+  struct triple_probe          *probe = container_of(dwork, struct triple_probe, work);
+  USB2CAN_TRIPLE               *adapter = probe->adapter;
+  unsigned int                  interval = min_t(unsigned int, READ_ONCE(rtt_probe_ms), TRIPLE_PROBE_MAX_MS);
+
+  if (interval)
+  {
+    spin_lock_bh(&adapter->lock);
+
+    if (probe->outstanding && ktime_to_ms(ktime_sub(ktime_get(), probe->sent)) > TRIPLE_PROBE_LOST_MS)
+    {
+      probe->outstanding = false;
+      probe->n_lost++;
+    }
+
+    if (!probe->outstanding && adapter->tty)
+    {
+      probe->pending = true;
+      triple_tx_kick(adapter);
+    }
+
+    spin_unlock_bh(&adapter->lock);
+  }
+
+  /* The interval is a module parameter, pick up changes */
+  kthread_queue_delayed_work(adapter->worker, &probe->work, msecs_to_jiffies(interval ? interval : 1000));
+
+} /* END: triple_probe_work() */
+
+/* Put the due marker into xbuff, adapter->lock held and xbuff free */
+bool triple_probe_send (USB2CAN_TRIPLE *adapter)
+{
+  struct triple_probe  *probe = adapter->probe;
+  unsigned char         seq[2];
+  int                   len;
+  int                   actual;
+
+  if (!probe || !probe->pending)
+    return false;
+
+  probe->pending = false;
+  probe->cmd = rtt_probe_status ? U2C_TR_CMD_STATUS : U2C_TR_CMD_MARKER;
+  probe->seq++;
+  seq[0] = probe->seq >> 8;
+  seq[1] = probe->seq & 0xFF;
+
+  len = TripleSendCmd(adapter->xbuff, probe->cmd, seq, probe->cmd == U2C_TR_CMD_MARKER ? 2 : 0);
+
+  actual = triple_tty_write(adapter, adapter->xbuff, len);
+
+  /* A few bytes, the tty takes them at once unless it is stalled */
+  probe->sent = ktime_get();
+  probe->outstanding = true;
+  probe->n_sent++;
+
+  adapter->xleft = len - actual;
+  adapter->xhead = adapter->xbuff + actual;
+
+  return true;
+
+} /* END: triple_probe_send() */
+
+/* Marker echo or status response from the adapter, now is its arrival */
+void triple_probe_answer (USB2CAN_TRIPLE *adapter, unsigned char cmd, const unsigned char *data, ktime_t now)
+{
+  struct triple_probe  *probe;
+  u64                   ns;
+  u64                   us;
+  int                   bucket;
+
+  /* adapter->probe may go away under us on close */
+  spin_lock_bh(&adapter->lock);
+
+  probe = adapter->probe;
+  if (!probe || !probe->outstanding || cmd != probe->cmd)
+    goto OUT;
+
+  if (cmd == U2C_TR_CMD_MARKER && ((data[0] << 8) | data[1]) != probe->seq)
+    goto OUT;
+
+  probe->outstanding = false;
+
+  ns = ktime_compare(now, probe->sent) > 0 ? ktime_to_ns(ktime_sub(now, probe->sent)) : 0;
+  us = ns / NSEC_PER_USEC;
+  bucket = us ? min_t(int, ilog2(us) + 1, TRIPLE_RTT_BUCKETS - 1) : 0;
+
+  probe->n_answered++;
+  probe->rtt_last = ns;
+  probe->rtt_sum += ns;
+  if (!probe->rtt_min || ns < probe->rtt_min)
+    probe->rtt_min = ns;
+  if (ns > probe->rtt_max)
+    probe->rtt_max = ns;
+  probe->hist[bucket]++;
+
+OUT:
+  spin_unlock_bh(&adapter->lock);
+
+} /* END: triple_probe_answer() */
+
+int triple_probe_init (USB2CAN_TRIPLE *adapter)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  struct triple_probe  *probe;
+
+  probe = kzalloc(sizeof(*probe), GFP_KERNEL);
+  if (!probe)
+    return -ENOMEM;
+
+  probe->adapter = adapter;
+  kthread_init_delayed_work(&probe->work, triple_probe_work);
+  adapter->probe = probe;
+
+  kthread_queue_delayed_work(adapter->worker, &probe->work, HZ);
+  return 0;
+
+} /* END: triple_probe_init() */
+
+/* Before the worker goes away */
+void triple_probe_stop (USB2CAN_TRIPLE *adapter)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  struct triple_probe  *probe = adapter->probe;
+
+  if (!probe)
+    return;
+
+  kthread_cancel_delayed_work_sync(&probe->work);
+
+  spin_lock_bh(&adapter->lock);
+  adapter->probe = NULL;
+  spin_unlock_bh(&adapter->lock);
+
+  kfree(probe);
+
+} /* END: triple_probe_stop() */
+
+void triple_probe_show (USB2CAN_TRIPLE *adapter, struct seq_file *m)
+{
+  struct triple_probe  *probe = adapter->probe;
+  int                   i;
+
+  if (!probe)
+    return;
+
+  spin_lock_bh(&adapter->lock);
+
+  seq_printf(m, "interval  %u ms (%s)\n", min_t(unsigned int, READ_ONCE(rtt_probe_ms), TRIPLE_PROBE_MAX_MS), rtt_probe_status ? "status" : "marker");
+  seq_printf(m, "sent      %lu\n", probe->n_sent);
+  seq_printf(m, "answered  %lu\n", probe->n_answered);
+  seq_printf(m, "lost      %lu\n", probe->n_lost);
+
+  if (probe->n_answered)
+  {
+    seq_printf(m, "rtt_last  %llu ns\n", probe->rtt_last);
+    seq_printf(m, "rtt_min   %llu ns\n", probe->rtt_min);
+    seq_printf(m, "rtt_avg   %llu ns\n", div64_u64(probe->rtt_sum, probe->n_answered));
+    seq_printf(m, "rtt_max   %llu ns\n", probe->rtt_max);
+    seq_puts(m, "hist_us  ");
+    for (i = 0; i < TRIPLE_RTT_BUCKETS; i++)
+      seq_printf(m, " %lu", probe->hist[i]);
+    seq_puts(m, "\n");
+  }
+
+  spin_unlock_bh(&adapter->lock);
+
+} /* END: triple_probe_show() */
@@ -0,0 +1,215 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/version.h>
+
+#include "rxring.h"
+
+/*
+ * Memory mapped RX ring, see triple_rxring.h for the layout.
+ *
+ * The worker is the only writer; it sees adapter->rxring from open until
+ * the worker is stopped in close. The ring memory outlives the adapter as
+ * long as a reader has the device open (a mapping holds its file), then
+ * the last release frees it.
+ */
+
+extern bool trace_func_main;
+extern void print_func_trace (bool is_trace, int line, const char *func);
+
+static unsigned int rx_ring_frames = 0;
+module_param(rx_ring_frames, uint, 0444);
+MODULE_PARM_DESC(rx_ring_frames, "Frames in the mmap RX ring /dev/triplecan-<tty> of each adapter, power of 2 (0 = no device)");
+
+#define  TRIPLE_RXRING_MAX          (1 << 20)
+
+static void triple_rxring_put (struct triple_rxring *r)
+{
+  if (!atomic_dec_and_test(&r->refs))
+    return;
+
+  vfree(r->hdr);
+  kfree(r);
+
+} /* END: triple_rxring_put() */
+
+static int triple_rxring_open (struct inode *inode, struct file *file)
+{
+  /* misc_open() left our miscdevice here and holds off misc_deregister() */
+  struct triple_rxring *r = container_of(file->private_data, struct triple_rxring, misc);
+
+  atomic_inc(&r->refs);
+  file->private_data = r;
+
+  return 0;
+}
+
+static int triple_rxring_close (struct inode *inode, struct file *file)
+{
+  triple_rxring_put(file->private_data);
+  return 0;
+}
+
+static int triple_rxring_mmap (struct file *file, struct vm_area_struct *vma)
+{
+  struct triple_rxring *r = file->private_data;
+
+  if (vma->vm_pgoff || vma->vm_end - vma->vm_start > r->size)
+    return -EINVAL;
+
+  return remap_vmalloc_range(vma, r->hdr, 0);
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,16,0)
+#define  TRIPLE_POLLIN              (EPOLLIN | EPOLLRDNORM)
+#define  TRIPLE_POLLHUP             EPOLLHUP
+static __poll_t triple_rxring_poll (struct file *file, poll_table *wait)
+#else
+#define  TRIPLE_POLLIN              (POLLIN | POLLRDNORM)
+#define  TRIPLE_POLLHUP             POLLHUP
+static unsigned int triple_rxring_poll (struct file *file, poll_table *wait)
+#endif
+{
+  struct triple_rxring     *r = file->private_data;
+  struct triple_rxring_hdr *h = r->hdr;
+  u32                       wake = clamp_t(u32, READ_ONCE(h->wake), 1, r->mask + 1);
+
+  poll_wait(file, &r->wait, wait);
+
+  if (READ_ONCE(r->dead))
+    return TRIPLE_POLLHUP;
+
+  if (smp_load_acquire(&h->head) - READ_ONCE(h->tail) >= wake)
+    return TRIPLE_POLLIN;
+
+  return 0;
+}
+
+static const struct file_operations triple_rxring_fops =
+{
+  .owner   = THIS_MODULE,
+  .open    = triple_rxring_open,
+  .release = triple_rxring_close,
+  .mmap    = triple_rxring_mmap,
+  .poll    = triple_rxring_poll,
+  .llseek  = noop_llseek,
+};
+
+void triple_rxring_push (struct triple_rxring *r, int channel, canid_t can_id, const u8 *data, u8 len, u8 flags, ktime_t stamp)
+{
+  struct triple_rxring_hdr   *h = r->hdr;
+  struct triple_rxring_frame *f;
+  u32                         head = h->head;
+  u32                         tail = smp_load_acquire(&h->tail);
+
+  if (head - tail > r->mask)
+  {
+    h->dropped++;
+    return;
+  }
+
+  if (len > 64)
+    len = 64;
+
+  f            = &r->frames[head & r->mask];
+  f->tstamp_ns = ktime_to_ns(stamp);
+  f->can_id    = can_id;
+  f->channel   = channel;
+  f->flags     = flags;
+  f->len       = len;
+  memcpy(f->data, data, len);
+
+  smp_store_release(&h->head, head + 1);
+
+  /* wq_has_sleeper() orders the head store against the poller's check */
+  if (head + 1 - tail >= clamp_t(u32, READ_ONCE(h->wake), 1, r->mask + 1) && wq_has_sleeper(&r->wait))
+    wake_up_interruptible(&r->wait);
+
+} /* END: triple_rxring_push() */
+
+int triple_rxring_init (USB2CAN_TRIPLE *adapter, const char *name)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  struct triple_rxring *r;
+  int                   err;
+
+  if (!rx_ring_frames)
+    return 0;
+
+  if (!is_power_of_2(rx_ring_frames) || rx_ring_frames > TRIPLE_RXRING_MAX)
+  {
+    printk(KERN_ERR "triple: rx_ring_frames %u is not a power of 2 up to %u\n", rx_ring_frames, TRIPLE_RXRING_MAX);
+    return -EINVAL;
+  }
+
+  r = kzalloc(sizeof(*r), GFP_KERNEL);
+  if (!r)
+    return -ENOMEM;
+
+  r->mask = rx_ring_frames - 1;
+  r->size = PAGE_ALIGN(PAGE_SIZE + (size_t) rx_ring_frames * sizeof(struct triple_rxring_frame));
+  r->hdr  = vmalloc_user(r->size);
+  if (!r->hdr)
+  {
+    kfree(r);
+    return -ENOMEM;
+  }
+
+  r->frames          = (struct triple_rxring_frame *) ((char *) r->hdr + PAGE_SIZE);
+  r->hdr->magic      = TRIPLE_RXRING_MAGIC;
+  r->hdr->version    = TRIPLE_RXRING_VERSION;
+  r->hdr->frames     = rx_ring_frames;
+  r->hdr->frame_size = sizeof(struct triple_rxring_frame);
+  r->hdr->offset     = PAGE_SIZE;
+  r->hdr->wake       = 1;
+
+  init_waitqueue_head(&r->wait);
+  atomic_set(&r->refs, 1);
+
+  snprintf(r->name, sizeof(r->name), "triplecan-%s", name);
+  r->misc.minor = MISC_DYNAMIC_MINOR;
+  r->misc.name  = r->name;
+  r->misc.fops  = &triple_rxring_fops;
+  r->misc.mode  = 0600;
+
+  err = misc_register(&r->misc);
+  if (err)
+  {
+    vfree(r->hdr);
+    kfree(r);
+    return err;
+  }
+
+  adapter->rxring = r;
+  return 0;
+
+} /* END: triple_rxring_init() */
+
+/* after the worker stopped: no more frames, readers see POLLHUP */
+void triple_rxring_remove (USB2CAN_TRIPLE *adapter)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  struct triple_rxring *r = adapter->rxring;
+
+  if (!r)
+    return;
+
+  adapter->rxring = NULL;
+  misc_deregister(&r->misc);
+
+  WRITE_ONCE(r->dead, true);
+  wake_up_interruptible(&r->wait);
+
+  triple_rxring_put(r);
+
+} /* END: triple_rxring_remove() */
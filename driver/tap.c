@@ -0,0 +1,375 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/uaccess.h>
+#include <linux/seq_file.h>
+#include <linux/mutex.h>
+
+#include "tap.h"
+
+/*
+ * Raw byte tap of the tty, for debugging the framing on live systems.
+ *
+ * triplecan/<tty>/tap_kb sets the size of each direction's ring in KiB
+ * (0 = off). While at least one adapter taps, a static key enables the
+ * hooks in receive_buf and the tty write path; otherwise they are a
+ * patched out branch. Each direction has its own ring with one producer:
+ * receive_buf is serialized by the tty, writes by adapter->lock.
+ *
+ * Reading triplecan/<tty>/tap drains both rings in time order as a pcap
+ * stream (nanosecond timestamps, LINKTYPE_USER0). Every packet is one
+ * direction byte (0 adapter -> host, 1 host -> adapter) followed by the
+ * bytes of one receive_buf call or tty write. A full ring drops new
+ * records and counts them, tap_kb shows the counts.
+ */
+
+extern bool trace_func_main;
+extern void print_func_trace (bool is_trace, int line, const char *func);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0)
+DEFINE_STATIC_KEY_FALSE(triple_tap_key);
+#define  triple_tap_key_inc()       static_branch_inc(&triple_tap_key)
+#define  triple_tap_key_dec()       static_branch_dec(&triple_tap_key)
+#else
+atomic_t triple_tap_users = ATOMIC_INIT(0);
+#define  triple_tap_key_inc()       atomic_inc(&triple_tap_users)
+#define  triple_tap_key_dec()       atomic_dec(&triple_tap_users)
+#endif
+
+#define  TRIPLE_TAP_MAX_KB          16384
+#define  TRIPLE_TAP_CHUNK           2048  /* longer writes are split  */
+#define  TRIPLE_TAP_PAD             U32_MAX /* rest of the ring unused, wrap */
+#define  TRIPLE_TAP_LINKTYPE        147   /* LINKTYPE_USER0          */
+
+/* record in the ring, 16 byte aligned so a pad record always fits */
+struct triple_tap_rec
+{
+  u64  ns;                              /* CLOCK_REALTIME            */
+  u32  len;                             /* bytes behind, or TRIPLE_TAP_PAD */
+  u32  reserved;
+};
+
+struct triple_pcap_hdr
+{
+  u32  magic;
+  u16  version_major;
+  u16  version_minor;
+  s32  thiszone;
+  u32  sigfigs;
+  u32  snaplen;
+  u32  linktype;
+};
+
+struct triple_pcap_rec
+{
+  u32  ts_sec;
+  u32  ts_nsec;
+  u32  incl_len;
+  u32  orig_len;
+};
+
+static DEFINE_MUTEX(triple_tap_lock);   /* tap_kb writes and tap reads */
+
+static void triple_tap_put (struct triple_tap_ring *r, const unsigned char *buf, u32 len, u64 ns)
+{
+  struct triple_tap_rec *rec;
+  u32                    need = ALIGN(sizeof(*rec) + len, 16);
+  u32                    head = r->head;
+  u32                    tail = smp_load_acquire(&r->tail);
+  u32                    off = head & (r->size - 1);
+  u32                    pad = 0;
+
+  if (r->size - off < need)
+    pad = r->size - off;
+
+  if (head + pad + need - tail > r->size)
+  {
+    r->dropped++;
+    return;
+  }
+
+  if (pad)
+  {
+    rec      = (struct triple_tap_rec *) (r->buf + off);
+    rec->len = TRIPLE_TAP_PAD;
+    head    += pad;
+    off      = 0;
+  }
+
+  rec      = (struct triple_tap_rec *) (r->buf + off);
+  rec->ns  = ns;
+  rec->len = len;
+  memcpy(rec + 1, buf, len);
+
+  smp_store_release(&r->head, head + need);
+
+} /* END: triple_tap_put() */
+
+void triple_tap_write (USB2CAN_TRIPLE *adapter, int dir, const unsigned char *buf, int len)
+{
+  struct triple_tap *t;
+  u64                ns;
+  int                n;
+
+  rcu_read_lock();
+  t = rcu_dereference(adapter->tap);
+  if (t)
+  {
+    ns = ktime_get_real_ns();
+    for (; len > 0; len -= n, buf += n)
+    {
+      n = min(len, TRIPLE_TAP_CHUNK);
+      triple_tap_put(&t->ring[dir], buf, n, ns);
+    }
+  }
+  rcu_read_unlock();
+
+} /* END: triple_tap_write() */
+
+/* Next record of a ring, pads skipped; NULL when empty */
+static struct triple_tap_rec *triple_tap_peek (struct triple_tap_ring *r)
+{
+  struct triple_tap_rec *rec;
+  u32                    head = smp_load_acquire(&r->head);
+
+  while (r->tail != head)
+  {
+    rec = (struct triple_tap_rec *) (r->buf + (r->tail & (r->size - 1)));
+    if (rec->len != TRIPLE_TAP_PAD)
+      return rec;
+
+    smp_store_release(&r->tail, ALIGN(r->tail + 1, r->size));
+  }
+
+  return NULL;
+
+} /* END: triple_tap_peek() */
+
+static void triple_tap_release (struct triple_tap *t)
+{
+  if (!t)
+    return;
+
+  vfree(t->ring[TRIPLE_TAP_RX].buf);
+  vfree(t->ring[TRIPLE_TAP_TX].buf);
+  kfree(t);
+  triple_tap_key_dec();
+
+} /* END: triple_tap_release() */
+
+/* triple_tap_lock held */
+static int triple_tap_set (USB2CAN_TRIPLE *adapter, unsigned int kb)
+{
+  struct triple_tap *t = NULL;
+  struct triple_tap *old;
+  int                i;
+
+  if (kb > TRIPLE_TAP_MAX_KB)
+    return -EINVAL;
+
+  if (kb)
+  {
+    kb = roundup_pow_of_two(max(kb, 4U));
+    t  = kzalloc(sizeof(*t), GFP_KERNEL);
+    if (!t)
+      return -ENOMEM;
+
+    t->kb = kb;
+    for (i = 0; i < 2; i++)
+    {
+      t->ring[i].size = kb * 1024;
+      t->ring[i].buf  = vmalloc(kb * 1024);
+      if (!t->ring[i].buf)
+      {
+        vfree(t->ring[0].buf);
+        kfree(t);
+        return -ENOMEM;
+      }
+    }
+
+    triple_tap_key_inc();
+  }
+
+  old = rcu_dereference_protected(adapter->tap, lockdep_is_held(&triple_tap_lock));
+  rcu_assign_pointer(adapter->tap, t);
+
+  if (old)
+  {
+    synchronize_rcu();
+    triple_tap_release(old);
+  }
+
+  return 0;
+
+} /* END: triple_tap_set() */
+
+void triple_tap_free (USB2CAN_TRIPLE *adapter)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  mutex_lock(&triple_tap_lock);
+  triple_tap_set(adapter, 0);
+  mutex_unlock(&triple_tap_lock);
+
+} /* END: triple_tap_free() */
+
+/* triplecan/<tty>/tap - drain as pcap, the file header comes first */
+static ssize_t triple_tap_read (struct file *file, char __user *ubuf, size_t count, loff_t *ppos)
+{
+  USB2CAN_TRIPLE         *adapter = file->private_data;
+  struct triple_tap      *t;
+  struct triple_tap_ring *r;
+  struct triple_tap_rec  *rec[2];
+  struct triple_pcap_hdr  hdr;
+  struct triple_pcap_rec  prec;
+  unsigned char           dir;
+  size_t                  done = 0;
+  u64                     sec;
+  u32                     nsec;
+  int                     i;
+
+  mutex_lock(&triple_tap_lock);
+
+  t = rcu_dereference_protected(adapter->tap, lockdep_is_held(&triple_tap_lock));
+  if (!t)
+  {
+    mutex_unlock(&triple_tap_lock);
+    return 0;
+  }
+
+  if (*ppos == 0)
+  {
+    if (count < sizeof(hdr))
+    {
+      mutex_unlock(&triple_tap_lock);
+      return -EINVAL;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic         = 0xA1B23C4D;   /* nanosecond resolution    */
+    hdr.version_major = 2;
+    hdr.version_minor = 4;
+    hdr.snaplen       = TRIPLE_TAP_CHUNK + 1;
+    hdr.linktype      = TRIPLE_TAP_LINKTYPE;
+    if (copy_to_user(ubuf, &hdr, sizeof(hdr)))
+    {
+      mutex_unlock(&triple_tap_lock);
+      return -EFAULT;
+    }
+    done = sizeof(hdr);
+  }
+
+  for (;;)
+  {
+    for (i = 0; i < 2; i++)
+      rec[i] = triple_tap_peek(&t->ring[i]);
+
+    /* oldest first across both directions */
+    if (!rec[0] && !rec[1])
+      break;
+    dir = !rec[0] || (rec[1] && rec[1]->ns < rec[0]->ns);
+    r   = &t->ring[dir];
+
+    if (count - done < sizeof(prec) + 1 + rec[dir]->len)
+      break;
+
+    sec           = div_u64_rem(rec[dir]->ns, NSEC_PER_SEC, &nsec);
+    prec.ts_sec   = sec;
+    prec.ts_nsec  = nsec;
+    prec.incl_len = 1 + rec[dir]->len;
+    prec.orig_len = prec.incl_len;
+
+    if (copy_to_user(ubuf + done, &prec, sizeof(prec)) ||
+        copy_to_user(ubuf + done + sizeof(prec), &dir, 1) ||
+        copy_to_user(ubuf + done + sizeof(prec) + 1, rec[dir] + 1, rec[dir]->len))
+    {
+      mutex_unlock(&triple_tap_lock);
+      return done ? done : -EFAULT;
+    }
+
+    done += sizeof(prec) + 1 + rec[dir]->len;
+    smp_store_release(&r->tail, r->tail + ALIGN(sizeof(*rec[dir]) + rec[dir]->len, 16));
+  }
+
+  mutex_unlock(&triple_tap_lock);
+
+  *ppos += done;
+  return done;
+
+} /* END: triple_tap_read() */
+
+static int triple_tap_open (struct inode *inode, struct file *file)
+{
+  file->private_data = inode->i_private;
+  return nonseekable_open(inode, file);
+}
+
+static const struct file_operations triple_tap_fops =
+{
+  .owner   = THIS_MODULE,
+  .open    = triple_tap_open,
+  .read    = triple_tap_read,
+  .llseek  = noop_llseek,
+};
+
+/* triplecan/<tty>/tap_kb - ring size per direction, drop counters */
+static int triple_tap_kb_show (struct seq_file *m, void *v)
+{
+  USB2CAN_TRIPLE    *adapter = m->private;
+  struct triple_tap *t;
+
+  mutex_lock(&triple_tap_lock);
+  t = rcu_dereference_protected(adapter->tap, lockdep_is_held(&triple_tap_lock));
+  if (t)
+    seq_printf(m, "%u kb, dropped rx %lu tx %lu\n", t->kb, READ_ONCE(t->ring[TRIPLE_TAP_RX].dropped), READ_ONCE(t->ring[TRIPLE_TAP_TX].dropped));
+  else
+    seq_puts(m, "0 (off)\n");
+  mutex_unlock(&triple_tap_lock);
+
+  return 0;
+
+} /* END: triple_tap_kb_show() */
+
+static int triple_tap_kb_open (struct inode *inode, struct file *file)
+{
+  return single_open(file, triple_tap_kb_show, inode->i_private);
+}
+
+static ssize_t triple_tap_kb_write (struct file *file, const char __user *ubuf, size_t count, loff_t *ppos)
+{
+  USB2CAN_TRIPLE *adapter = ((struct seq_file *) file->private_data)->private;
+  unsigned int    kb;
+  int             err;
+
+  err = kstrtouint_from_user(ubuf, count, 0, &kb);
+  if (err)
+    return err;
+
+  mutex_lock(&triple_tap_lock);
+  err = triple_tap_set(adapter, kb);
+  mutex_unlock(&triple_tap_lock);
+
+  return err ? err : count;
+
+} /* END: triple_tap_kb_write() */
+
+static const struct file_operations triple_tap_kb_fops =
+{
+  .owner   = THIS_MODULE,
+  .open    = triple_tap_kb_open,
+  .read    = seq_read,
+  .write   = triple_tap_kb_write,
+  .llseek  = seq_lseek,
+  .release = single_release,
+};
+
+void triple_tap_debugfs (USB2CAN_TRIPLE *adapter, struct dentry *dir)
+{
+  debugfs_create_file("tap", S_IRUSR, dir, adapter, &triple_tap_fops);
+  debugfs_create_file("tap_kb", S_IRUSR | S_IWUSR, dir, adapter, &triple_tap_kb_fops);
+
+} /* END: triple_tap_debugfs() */
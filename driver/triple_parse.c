@@ -68,6 +68,26 @@ int TripleSendHex(TRIPLE_CAN_FRAME *frame)
 
 }
 
+/* Adapter command without a CAN frame (status request, ...), p holds TRIPLE_MTU */
+int TripleSendCmd(unsigned char *p, unsigned char cmd, const unsigned char *data, int n)
+{
+  int length = 0;
+  int i;
+
+  p[length++] = U2C_TR_FIRST_BYTE;
+  p[length++] = 1;
+  length += USB2CAN_TRIPLE_PushByte(cmd, (p + length));
+
+  for (i = 0; i < n; i++)
+    length += USB2CAN_TRIPLE_PushByte(data[i], (p + length));
+
+  length += USB2CAN_TRIPLE_PushByteClear(U2C_TR_LAST_BYTE, (p + length));
+  p[1] = length;
+
+  return length;
+
+}
+
 int TripleRecvHex(TRIPLE_CAN_FRAME *frame)
 {
 
@@ -86,6 +106,11 @@ int TripleRecvHex(TRIPLE_CAN_FRAME *frame)
     return 2;
   }
 
+  if (*(p + offset) == U2C_TR_CMD_MARKER)
+  {
+    return 3;
+  }
+
   //if (*(p + offset) != U2C_TR_CMD_TX_CAN)
   /* func - byte 1 */
   frame->CAN_port = *(p + offset + 6) & 0x0F;
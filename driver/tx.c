@@ -2,8 +2,17 @@
 #include <linux/version.h>
 #include <linux/tty.h>
 #include <linux/mutex.h>
+#include <net/sock.h>
 
 #include "tx.h"
+#include "filter.h"
+#include "change.h"
+#include "gateway.h"
+#include "probe.h"
+#include "busload.h"
+#include "idstats.h"
+#include "rxring.h"
+#include "tap.h"
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,9,0)
 #include <linux/can/skb.h>
@@ -48,6 +57,119 @@ void triple_unesc (USB2CAN_TRIPLE *adapter, unsigned char s)
 
 } /* END: triple_unesc() */
 
+/*-----------------------------------------------------------------------*/
+static unsigned int rx_stamp_baud = 0;
+module_param(rx_stamp_baud, uint, 0644);
+MODULE_PARM_DESC(rx_stamp_baud, "Spread RX stamps of one chunk by byte position at this link rate, 10 bits per byte (0 = whole chunk shares one stamp)");
+
+// Arrival time of the frame whose last byte sits at ring position pos - 1
+static ktime_t triple_rx_stamp (USB2CAN_TRIPLE *adapter, unsigned int pos, unsigned int shead)
+{
+  unsigned int            stail = adapter->rx_stail;
+  unsigned int            baud = READ_ONCE(rx_stamp_baud);
+  struct triple_rx_chunk *c;
+  ktime_t                 t;
+
+  /* Chunks that ended before pos are done */
+  while (stail != shead && (int) (pos - adapter->rx_chunk[stail & (TRIPLE_RX_STAMPS - 1)].end) > 0)
+  {
+    adapter->rx_prev = adapter->rx_chunk[stail & (TRIPLE_RX_STAMPS - 1)].stamp;
+    stail++;
+  }
+  smp_store_release(&adapter->rx_stail, stail);
+
+  /* receive_buf found no free slot for this chunk */
+  if (stail == shead)
+    return ktime_get();
+
+  c = &adapter->rx_chunk[stail & (TRIPLE_RX_STAMPS - 1)];
+  if (!baud)
+    return c->stamp;
+
+  /* The stamp is taken when the chunk is complete, bytes after pos came later */
+  t = ktime_sub_ns(c->stamp, div_u64((u64) (c->end - pos) * 10 * NSEC_PER_SEC, baud));
+  if (ktime_to_ns(t) < ktime_to_ns(adapter->rx_prev))
+    t = adapter->rx_prev;
+
+  return t;
+
+} /* END: triple_rx_stamp() */
+
+/*-----------------------------------------------------------------------*/
+// ldisc ring -> Decoder, runs on the adapter worker
+void triple_receive (struct kthread_work *work)
+{
+  /*=======================================================*/
+  //print_func_trace(trace_func_tran, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  USB2CAN_TRIPLE  *adapter = container_of(work, USB2CAN_TRIPLE, rx_work);
+  unsigned int     head = smp_load_acquire(&adapter->rx_head);
+  unsigned int     shead = smp_load_acquire(&adapter->rx_shead);
+  unsigned int     tail = adapter->rx_tail;
+  unsigned char    s;
+
+  while (tail != head)
+  {
+    s = adapter->rx_ring[tail & (TRIPLE_RX_RING - 1)];
+    if (s == U2C_TR_LAST_BYTE)
+      adapter->rx_stamp = triple_rx_stamp(adapter, tail + 1, shead);
+    triple_unesc(adapter, s);
+    tail++;
+  }
+
+  smp_store_release(&adapter->rx_tail, tail);
+
+} /* END: triple_receive() */
+
+/*-----------------------------------------------------------------------*/
+// Empty CAN / CAN FD skb for dev, the caller skb_put()s the frame
+struct sk_buff *triple_alloc_skb (struct net_device *dev, bool fd)
+{
+  struct sk_buff *skb;
+
+  if (!fd)
+  {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,9,0)
+    skb = dev_alloc_skb(sizeof(struct can_frame) + sizeof(struct can_skb_priv));
+#else
+    skb = dev_alloc_skb(sizeof(struct can_frame));
+#endif
+  }
+  else
+  {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,9,0)
+    skb = dev_alloc_skb(sizeof(struct canfd_frame) + sizeof(struct can_skb_priv));
+#else
+    skb = dev_alloc_skb(sizeof(struct canfd_frame));
+#endif
+  }
+
+  if (!skb)
+    return NULL;
+
+  if (!fd)
+    skb->protocol  = htons(ETH_P_CAN);
+  else
+    skb->protocol  = htons(ETH_P_CANFD);
+
+  skb->dev       = dev;
+  skb->pkt_type  = PACKET_BROADCAST;
+  skb->ip_summed = CHECKSUM_UNNECESSARY;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,9,0)
+  can_skb_reserve(skb);
+  can_skb_prv(skb)->ifindex = dev->ifindex;
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,1,5)
+  can_skb_prv(skb)->skbcnt = 0;
+#endif
+
+  return skb;
+
+} /* END: triple_alloc_skb() */
+
 /*-----------------------------------------------------------------------*/
 // Triple HW (ttyRead) -> Decoder (CMD_TX_CAN)-> SockatCAN message
 //recieved message from HW put through decoder if Incoming message push into sockatCAN message a set rx flag on netdev)
@@ -62,6 +184,7 @@ void triple_bump (USB2CAN_TRIPLE *adapter)
   struct sk_buff    *skb;
   struct can_frame   cf;
   struct canfd_frame   cf_fd;
+  canid_t            can_id = 0;
 
   memset(&frame, 0, sizeof(frame));
   escape_memcpy(frame.comm_buf, adapter->rbuff, adapter->rcount);
@@ -79,8 +202,14 @@ void triple_bump (USB2CAN_TRIPLE *adapter)
 
   if (ret == 1)
   {
+    triple_probe_answer(adapter, U2C_TR_CMD_STATUS, NULL, adapter->rx_stamp);
     if (show_debug_tran)
-     // printk("U2C_TR_CMD_STATUS\n");
+      printk("U2C_TR_CMD_STATUS\n");
+    return;
+  }
+  else if (ret == 3)
+  {
+    triple_probe_answer(adapter, U2C_TR_CMD_MARKER, p + 3, adapter->rx_stamp);
     return;
   }
   else if (ret == 2)
@@ -95,6 +224,46 @@ void triple_bump (USB2CAN_TRIPLE *adapter)
       printk("%02X ", *(p + i));
     printk("\n");
   }
+
+  if (frame.CAN_port < 0 || frame.CAN_port > 2)
+    return;
+
+  frame.id_type = frame.id_type - 1;
+
+  if (frame.rtr)
+    can_id |= CAN_RTR_FLAG;
+
+  if (frame.id_type)
+    can_id |= CAN_EFF_FLAG;
+
+  for (i = 0; i < ID_LEN; i++)
+    can_id |= (frame.id[ID_LEN - 1 - i] << (i * 8));
+
+  triple_busload_account(adapter, frame.CAN_port, can_id, frame.data, frame.dlc,
+                         (frame.fd ? TRIPLE_FT_FD : 0) | (frame.fd_br_switch ? TRIPLE_FT_BRS : 0) | (frame.fd_esi ? TRIPLE_FT_ESI : 0),
+                         adapter->rx_stamp);
+  triple_idstats_account(adapter, frame.CAN_port, can_id, frame.dlc, frame.fd, adapter->rx_stamp);
+  triple_rxring_account(adapter, frame.CAN_port, can_id, frame.data, frame.rtr ? 0 : frame.dlc,
+                        (frame.fd ? TRIPLE_RXRING_FD : 0) | (frame.fd_br_switch ? TRIPLE_RXRING_BRS : 0) | (frame.fd_esi ? TRIPLE_RXRING_ESI : 0),
+                        adapter->rx_stamp);
+
+  /* Channel to channel routes see every frame, filters are for local delivery */
+  triple_gateway(adapter, frame.CAN_port, can_id, &frame);
+
+  /* Software acceptance filter: rejected frames never get an skb */
+  if (!triple_filter_pass(adapter, frame.CAN_port, can_id))
+  {
+    adapter->cstats[frame.CAN_port].rx_filtered++;
+    return;
+  }
+
+  /* Change-only delivery of cyclic frames */
+  if (!triple_change_pass(adapter, frame.CAN_port, can_id, frame.data, frame.rtr ? 0 : frame.dlc))
+  {
+    adapter->cstats[frame.CAN_port].rx_unchanged++;
+    return;
+  }
+
   if (!frame.fd)
   {
     /*===============================*/
@@ -112,19 +281,7 @@ void triple_bump (USB2CAN_TRIPLE *adapter)
       /*===============================*/
     }
 
-    frame.CAN_port = frame.CAN_port;//+ 1;
-    frame.id_type  = frame.id_type - 1;
-
-    cf.can_id = 0;
-
-    if (frame.rtr)
-      cf.can_id |= CAN_RTR_FLAG;
-
-    if (frame.id_type)
-      cf.can_id |= CAN_EFF_FLAG;
-
-    for (i = 0; i < ID_LEN; i++)
-      cf.can_id |= (frame.id[ID_LEN - 1 - i] << (i * 8));
+    cf.can_id = can_id;
 
     /* RTR frames may have a dlc > 0 but they never have any data bytes */
     //*(u64 *)(&cf.data) = 0;
@@ -156,16 +313,8 @@ void triple_bump (USB2CAN_TRIPLE *adapter)
       /*===============================*/
     }
 
-    frame.CAN_port = frame.CAN_port;//+ 1;
-    frame.id_type  = frame.id_type - 1;
-
-    cf_fd.can_id = 0;
-
-    if (frame.rtr)
-      cf_fd.can_id |= CAN_RTR_FLAG;
-
-    if (frame.id_type)
-      cf_fd.can_id |= CAN_EFF_FLAG;
+    cf_fd.can_id = can_id;
+    cf_fd.flags  = 0;
 
     if (frame.fd_br_switch )
     {
@@ -177,9 +326,6 @@ void triple_bump (USB2CAN_TRIPLE *adapter)
       cf_fd.flags |=  CANFD_ESI;
     }
 
-    for (i = 0; i < ID_LEN; i++)
-      cf_fd.can_id |= (frame.id[ID_LEN - 1 - i] << (i * 8));
-
     /* RTR frames may have a dlc > 0 but they never have any data bytes */
     //*(u64 *)(&cf.data) = 0;
 
@@ -195,61 +341,56 @@ void triple_bump (USB2CAN_TRIPLE *adapter)
   }
 
 //---------------------------------------------------------------------------------------------------------
-  if (!frame.fd)
-  {
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,9,0)
-    skb = dev_alloc_skb(sizeof(struct can_frame) + sizeof(struct can_skb_priv));
-#else
-    skb = dev_alloc_skb(sizeof(struct can_frame));
-#endif
-  }
-  else
-  {
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,9,0)
-    skb = dev_alloc_skb(sizeof(struct canfd_frame) + sizeof(struct can_skb_priv));
-#else
-    skb = dev_alloc_skb(sizeof(struct canfd_frame));
-#endif
-  }
-
+  skb = triple_alloc_skb(adapter->devs[frame.CAN_port], frame.fd);
   if (!skb)
   {
     return;
   }
 
   if (!frame.fd)
-    skb->protocol  = htons(ETH_P_CAN);
+    memcpy(skb_put(skb, sizeof(struct can_frame)), &cf, sizeof(struct can_frame));
   else
-    skb->protocol  = htons(ETH_P_CANFD);
+    memcpy(skb_put(skb, sizeof(struct canfd_frame)), &cf_fd, sizeof(struct canfd_frame));
 
-  skb->dev       = adapter->devs[frame.CAN_port];
-  skb->pkt_type  = PACKET_BROADCAST;
-  skb->ip_summed = CHECKSUM_UNNECESSARY;
 
+  adapter->devs[frame.CAN_port]->stats.rx_packets++;
+  adapter->devs[frame.CAN_port]->stats.rx_bytes += frame.fd ? cf_fd.len : cf.can_dlc;
 
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,9,0)
-  can_skb_reserve(skb);
-  can_skb_prv(skb)->ifindex = adapter->devs[frame.CAN_port]->ifindex;
+  /* Arrival at the ldisc, not the time the worker got around to decoding */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,17,0)
+  skb->tstamp = ktime_mono_to_real(adapter->rx_stamp);
+#else
+  skb->tstamp = ktime_add(adapter->rx_stamp, ktime_sub(ktime_get_real(), ktime_get()));
 #endif
 
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,1,5)
-  can_skb_prv(skb)->skbcnt = 0;
-#endif
+  netif_rx_ni(skb);
 
-  if (!frame.fd)
-    memcpy(skb_put(skb, sizeof(struct can_frame)), &cf, sizeof(struct can_frame));
-  else
-    memcpy(skb_put(skb, sizeof(struct canfd_frame)), &cf_fd, sizeof(struct canfd_frame));
+} /* END: triple_bump() */
 
 
-  adapter->devs[frame.CAN_port]->stats.rx_packets++;
-  adapter->devs[frame.CAN_port]->stats.rx_bytes += cf.can_dlc;
 
-  netif_rx_ni(skb);
+// Hand bytes to the tty, a failed write (e.g. URB error) accepted nothing
+int triple_tty_write (USB2CAN_TRIPLE *adapter, const unsigned char *buf, int len)
+{
+  int actual;
 
-} /* END: triple_bump() */
+  set_bit(TTY_DO_WRITE_WAKEUP, &adapter->tty->flags);
+  actual = adapter->tty->ops->write(adapter->tty, buf, len);
+  if (actual < 0)
+    actual = 0;
+
+  triple_tap(adapter, TRIPLE_TAP_TX, buf, actual);
 
+  if (actual > 0)
+    adapter->tx_progress = jiffies;
 
+  /* send time of the frame, used for its echo */
+  if (actual == len)
+    adapter->tx_accepted = ktime_get_real();
+
+  return actual;
+
+} /* END: triple_tty_write() */
 
 /*-----------------------------------------------------------------------*/
 // sockatCAN frame -> Triple HW (ttyWrite)
@@ -305,8 +446,7 @@ void triple_encaps (USB2CAN_TRIPLE *adapter, int channel, struct can_frame *cf)
    *       14 Oct 1994  Dmitry Gorodchanin.
    */
 
-  set_bit(TTY_DO_WRITE_WAKEUP, &adapter->tty->flags);
-  actual = adapter->tty->ops->write(adapter->tty, adapter->xbuff, len);
+  actual = triple_tty_write(adapter, adapter->xbuff, len);
 
   adapter->xleft = len - actual;
   adapter->xhead = adapter->xbuff + actual;
@@ -378,8 +518,7 @@ void triple_encaps_fd (USB2CAN_TRIPLE *adapter, int channel, struct canfd_frame
     printk("GREP#1\n");
   }
 
-  set_bit(TTY_DO_WRITE_WAKEUP, &adapter->tty->flags);
-  actual = adapter->tty->ops->write(adapter->tty, adapter->xbuff, len);
+  actual = triple_tty_write(adapter, adapter->xbuff, len);
 
   adapter->xleft = len - actual;
   adapter->xhead = adapter->xbuff + actual;
@@ -388,8 +527,313 @@ void triple_encaps_fd (USB2CAN_TRIPLE *adapter, int channel, struct canfd_frame
 } /* END: triple_encaps() */
 
 
+/*-----------------------------------------------------------------------*/
+// Enqueue to tty write time of a queued frame, by arbitration class
+static void triple_wait_account (TRIPLE_CHAN_STATS *st, ktime_t now, struct sk_buff *skb)
+{
+  u64  ns = ktime_to_ns(ktime_sub(now, TRIPLE_SKB_CB(skb)->queued));
+  int  cls = TRIPLE_SKB_CB(skb)->key >> (32 - ilog2(TRIPLE_PRIO_CLASSES));
+
+  st->tx_class_sent[cls]++;
+  st->tx_class_wait_sum[cls] += ns;
+  if (ns > st->tx_class_wait_max[cls])
+    st->tx_class_wait_max[cls] = ns;
+
+} /* END: triple_wait_account() */
+
+/*
+ * Latest time a frame may still go to the tty. The channel's max age counts
+ * from the send() stamp triple_select_queue() left in skb->tstamp, so time
+ * spent in the qdisc behind a stopped queue counts as well. Frames without
+ * it (gateway, SO_TXTIME senders) count from enqueue. A SO_TXTIME sender in
+ * deadline mode on CLOCK_MONOTONIC can ask for an earlier drop.
+ *
+ * The send() stamp is CLOCK_MONOTONIC and, from 5.18 on, marked as a
+ * monotonic delivery time so the stack does not take it for a realtime
+ * rx stamp. It is never in the future, a time based qdisc sends the frame
+ * at once. Stamps the driver did not set are only trusted when they are
+ * not after queued.
+ * Called at enqueue, after queued is set.
+ */
+static ktime_t triple_tx_deadline (USB2CAN_TRIPLE *adapter, int channel, struct sk_buff *skb)
+{
+  ktime_t  deadline = 0;
+  ktime_t  sent = TRIPLE_SKB_CB(skb)->queued;
+
+  /* can-gw may forward a CLOCK_REALTIME rx stamp, that is never before queued */
+  if (!triple_tx_has_txtime(skb) && skb->tstamp && !ktime_after(skb->tstamp, sent))
+    sent = skb->tstamp;
+
+  if (adapter->tx_max_age[channel])
+    deadline = ktime_add(sent, adapter->tx_max_age[channel]);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+  if (triple_tx_has_txtime(skb) && skb->sk->sk_txtime_deadline_mode &&
+      skb->sk->sk_clockid == CLOCK_MONOTONIC && skb->tstamp)
+  {
+    if (!deadline || ktime_before(skb->tstamp, deadline))
+      deadline = skb->tstamp;
+  }
+#endif
+
+  return deadline;
+
+} /* END: triple_tx_deadline() */
+
+// Drop a dequeued frame that missed its deadline, adapter->lock held
+static bool triple_tx_expired (USB2CAN_TRIPLE *adapter, int channel, struct sk_buff *skb, ktime_t now)
+{
+  struct net_device *dev = adapter->devs[channel];
+  u16                band = skb_get_queue_mapping(skb);
+
+  if (!TRIPLE_SKB_CB(skb)->deadline || ktime_before(now, TRIPLE_SKB_CB(skb)->deadline))
+    return false;
+
+  adapter->cstats[channel].tx_expired++;
+  dev->stats.tx_dropped++;
+  kfree_skb(skb);
+
+  /* Nothing may be in flight to wake the queue later */
+  if (__netif_subqueue_stopped(dev, band) && skb_queue_len(&adapter->txq[channel][band]) < TRIPLE_TXQ_LEN)
+    netif_wake_subqueue(dev, band);
+
+  return true;
+
+} /* END: triple_tx_expired() */
+
+// Queue a frame for channel in the band of its netdev TX queue, adapter->lock held
+int triple_tx_enqueue (USB2CAN_TRIPLE *adapter, int channel, struct sk_buff *skb)
+{
+  u16                  band = min_t(u16, skb_get_queue_mapping(skb), TRIPLE_TX_BANDS - 1);
+  struct sk_buff_head *q = &adapter->txq[channel][band];
+  struct sk_buff      *pos;
+  u32                  key;
+
+  if (skb_queue_len(q) >= TRIPLE_TXQ_LEN)
+    return -ENOSPC;
+
+  skb_set_queue_mapping(skb, band);
+
+  key = triple_arb_key(((struct can_frame *) skb->data)->can_id);
+  TRIPLE_SKB_CB(skb)->queued   = ktime_get();
+  TRIPLE_SKB_CB(skb)->deadline = triple_tx_deadline(adapter, channel, skb);
+  TRIPLE_SKB_CB(skb)->key      = key;
+  TRIPLE_SKB_CB(skb)->channel  = channel;
+
+  if (adapter->tx_order[channel] != TRIPLE_TXQ_ID)
+  {
+    __skb_queue_tail(q, skb);
+  }
+  else
+  {
+    /* Behind the last frame that would not lose arbitration against it */
+    skb_queue_reverse_walk(q, pos)
+    {
+      if (TRIPLE_SKB_CB(pos)->key <= key)
+        break;
+    }
+
+    if (pos == (struct sk_buff *) q)
+      __skb_queue_head(q, skb);
+    else
+      __skb_queue_after(q, pos, skb);
+  }
+
+  /* A full bulk band must not hold back the others */
+  if (skb_queue_len(q) >= TRIPLE_TXQ_LEN)
+    netif_stop_subqueue(adapter->devs[channel], band);
+
+  return 0;
+
+} /* END: triple_tx_enqueue() */
+
+// Start the next queued frame if nothing is in flight, adapter->lock held
+void triple_tx_kick (USB2CAN_TRIPLE *adapter)
+{
+  struct sk_buff  *skb = NULL;
+  int              channel = 0;
+  int              band;
+  int              i;
+  ktime_t          now;
+
+  if (!adapter->tty || adapter->tx_skb || adapter->xleft > 0)
+    return;
+
+  /* A due latency marker goes first, it measures the path, not the queues */
+  if (triple_probe_send(adapter))
+    return;
+
+  now = ktime_get();
+
+  /* Periodic frames have a due time, they go before everything else */
+  skb = __skb_dequeue(&adapter->pq);
+  if (skb)
+  {
+    channel = TRIPLE_SKB_CB(skb)->channel;
+    triple_delay_account(&adapter->cstats[channel], now, TRIPLE_SKB_CB(skb)->due);
+  }
+
+  /* Channels share the tty, serve them round robin */
+  for (i = 1; i <= 3 && !skb; i++)
+  {
+    channel = (adapter->current_channel + i) % 3;
+
+    /* Bands of a channel are strictly prioritized; stale frames are
+     * dropped here, before they are encoded */
+    for (band = 0; band < TRIPLE_TX_BANDS && !skb; band++)
+    {
+      while ((skb = __skb_dequeue(&adapter->txq[channel][band])) && triple_tx_expired(adapter, channel, skb, now))
+        ;
+    }
+
+    if (skb)
+      triple_wait_account(&adapter->cstats[channel], now, skb);
+  }
+
+  if (!skb)
+    return;
+
+  adapter->current_channel = channel;
+  adapter->tx_skb = skb;
+  adapter->tx_progress = jiffies;
+  adapter->tx_retried = false;
+
+  if ((channel == 2) && (adapter->can_fd)) //CAN_FD
+    triple_encaps_fd(adapter, channel, (struct canfd_frame *) skb->data);
+  else //CAN 2.0
+    triple_encaps(adapter, channel, (struct can_frame *) skb->data);
+
+} /* END: triple_tx_kick() */
+
+// Due-to-write delay of a periodic frame, log2 microsecond buckets
+void triple_delay_account (TRIPLE_CHAN_STATS *st, ktime_t now, ktime_t due)
+{
+  u64  ns = ktime_compare(now, due) > 0 ? ktime_to_ns(ktime_sub(now, due)) : 0;
+  u64  us = ns / NSEC_PER_USEC;
+  int  bucket = us ? min_t(int, ilog2(us) + 1, TRIPLE_DELAY_BUCKETS - 1) : 0;
+
+  st->pe_sent++;
+  st->pe_delay_sum += ns;
+  if (ns > st->pe_delay_max)
+    st->pe_delay_max = ns;
+  st->pe_delay_hist[bucket]++;
+
+} /* END: triple_delay_account() */
+
+int triple_txq_config (USB2CAN_TRIPLE *adapter, const struct triple_txq_cfg *cfg)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_tran, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  if (cfg->channel > 2 || cfg->order > TRIPLE_TXQ_ID)
+    return -EINVAL;
+
+  /* Frames already queued keep their place and deadline */
+  spin_lock_bh(&adapter->lock);
+  adapter->tx_order[cfg->channel]   = cfg->order;
+  adapter->tx_max_age[cfg->channel] = us_to_ktime(cfg->max_age_us);
+  spin_unlock_bh(&adapter->lock);
+
+  return 0;
+
+} /* END: triple_txq_config() */
+
+// Drop everything queued for channel, adapter->lock held
+void triple_tx_purge (USB2CAN_TRIPLE *adapter, int channel)
+{
+  struct sk_buff  *skb;
+  struct sk_buff  *tmp;
+  int              band;
+
+  for (band = 0; band < TRIPLE_TX_BANDS; band++)
+  {
+    adapter->devs[channel]->stats.tx_dropped += skb_queue_len(&adapter->txq[channel][band]);
+    __skb_queue_purge(&adapter->txq[channel][band]);
+  }
+
+  skb_queue_walk_safe(&adapter->pq, skb, tmp)
+  {
+    if (TRIPLE_SKB_CB(skb)->channel != channel)
+      continue;
+
+    __skb_unlink(skb, &adapter->pq);
+    kfree_skb(skb);
+  }
+
+} /* END: triple_tx_purge() */
+
+// The frame in xbuff is completely with the tty, adapter->lock held
+static void triple_tx_complete (USB2CAN_TRIPLE *adapter)
+{
+  struct sk_buff     *skb = adapter->tx_skb;
+  struct net_device  *dev = adapter->devs[adapter->current_channel];
+  struct can_frame   *cf;
+  struct canfd_frame *cfd;
+
+  if (!skb)
+    return;
+
+  adapter->tx_skb = NULL;
+  dev->stats.tx_packets++;
+  skb_tx_timestamp(skb);
+
+  if (skb->len == CANFD_MTU)
+  {
+    cfd = (struct canfd_frame *) skb->data;
+    triple_busload_account(adapter, adapter->current_channel, cfd->can_id, cfd->data, cfd->len,
+                           TRIPLE_FT_FD | ((cfd->flags & CANFD_BRS) ? TRIPLE_FT_BRS : 0), ktime_get());
+  }
+  else
+  {
+    cf = (struct can_frame *) skb->data;
+    triple_busload_account(adapter, adapter->current_channel, cf->can_id, cf->data, cf->can_dlc, 0, ktime_get());
+  }
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,9,0)
+  /* IFF_ECHO: the sender sees its frame when it really left the host */
+  if ((dev->flags & IFF_ECHO) && skb->pkt_type == PACKET_LOOPBACK)
+  {
+    skb = can_create_echo_skb(skb);
+    if (!skb)
+      return;
+
+    memset(skb->cb, 0, sizeof(skb->cb));
+    skb->dev       = dev;
+    skb->ip_summed = CHECKSUM_UNNECESSARY;
+    skb->tstamp    = adapter->tx_accepted;
+    netif_rx(skb);
+    return;
+  }
+#endif
+
+  consume_skb(skb);
+
+} /* END: triple_tx_complete() */
+
+// Wake the netdev TX queues that have room again, adapter->lock held
+static void triple_tx_wake (USB2CAN_TRIPLE *adapter)
+{
+  int channel;
+  int band;
+
+  for (channel = 0; channel < 3; channel++)
+  {
+    if (!netif_running(adapter->devs[channel]))
+      continue;
+
+    for (band = 0; band < TRIPLE_TX_BANDS; band++)
+    {
+      if (skb_queue_len(&adapter->txq[channel][band]) < TRIPLE_TXQ_LEN &&
+          __netif_subqueue_stopped(adapter->devs[channel], band))
+        netif_wake_subqueue(adapter->devs[channel], band);
+    }
+  }
+
+} /* END: triple_tx_wake() */
+
 // swhatever -> Triple HW (ttyWrite)
-void triple_transmit (struct work_struct *work)
+void triple_transmit (struct kthread_work *work)
 {
   /*=======================================================*/
   print_func_trace(trace_func_tran, __LINE__, __FUNCTION__);
@@ -407,25 +851,173 @@ void triple_transmit (struct work_struct *work)
     return;
   }
 
-  if (adapter->xleft <= 0)
+  if (adapter->xleft > 0)
   {
-    adapter->devs[adapter->current_channel]->stats.tx_packets++;
+    actual = triple_tty_write(adapter, adapter->xhead, adapter->xleft);
+    adapter->xleft -= actual;
+    adapter->xhead += actual;
+    spin_unlock_bh(&adapter->lock);
+    return;
+  }
+
+  /* The frame in xbuff is out, account it and start the next one */
+  triple_tx_complete(adapter);
+
+  clear_bit(TTY_DO_WRITE_WAKEUP, &adapter->tty->flags);
+  triple_tx_kick(adapter);
+
+  triple_tx_wake(adapter);
+
+  spin_unlock_bh(&adapter->lock);
+
+} /* END: triple_transmit() */
+
+/*-----------------------------------------------------------------------*/
+/* TX watchdog: a tty that accepts nothing and never calls write_wakeup
+ * (e.g. cdc-acm after an URB error) would otherwise stop the queues forever.
+ */
+static unsigned int tx_watchdog_ms = 500;
+module_param(tx_watchdog_ms, uint, 0644);
+MODULE_PARM_DESC(tx_watchdog_ms, "Recover the TX path after this long without tty progress (0 = off)");
+
+static bool tx_watchdog_poke = false;
+module_param(tx_watchdog_poke, bool, 0644);
+MODULE_PARM_DESC(tx_watchdog_poke, "Send a status request to the adapter after a TX stall");
+
+static bool triple_tx_stalled (USB2CAN_TRIPLE *adapter, unsigned long timeout)
+{
+  if (!READ_ONCE(adapter->tx_skb) && READ_ONCE(adapter->xleft) <= 0)
+    return false;
+
+  return time_after(jiffies, READ_ONCE(adapter->tx_progress) + timeout);
+
+} /* END: triple_tx_stalled() */
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,15,0)
+static void triple_tx_watchdog_timer (struct timer_list *t)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,16,0)
+  USB2CAN_TRIPLE  *adapter = timer_container_of(adapter, t, tx_watchdog);
+#else
+  USB2CAN_TRIPLE  *adapter = from_timer(adapter, t, tx_watchdog);
+#endif
+#else
+static void triple_tx_watchdog_timer (unsigned long data)
+{
+  USB2CAN_TRIPLE  *adapter = (USB2CAN_TRIPLE *) data;
+#endif
+  unsigned long    timeout = msecs_to_jiffies(READ_ONCE(tx_watchdog_ms));
+
+  if (timeout && triple_tx_stalled(adapter, timeout))
+    kthread_queue_work(adapter->worker, &adapter->wd_work);
+
+  mod_timer(&adapter->tx_watchdog, jiffies + (timeout ? max_t(unsigned long, timeout / 2, 1) : HZ));
+
+} /* END: triple_tx_watchdog_timer() */
+
+// Recover a stalled transmit path, also queued by ndo_tx_timeout
+void triple_tx_watchdog (struct kthread_work *work)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_tran, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  USB2CAN_TRIPLE  *adapter = container_of(work, USB2CAN_TRIPLE, wd_work);
+  unsigned long    timeout = msecs_to_jiffies(READ_ONCE(tx_watchdog_ms));
+  int              channel;
+  int              actual;
+  int              len;
+
+  spin_lock_bh(&adapter->lock);
 
-    clear_bit(TTY_DO_WRITE_WAKEUP, &adapter->tty->flags);
+  if (!adapter->tty)
+  {
     spin_unlock_bh(&adapter->lock);
+    return;
+  }
+
+  if (!timeout || !triple_tx_stalled(adapter, timeout))
+    goto KICK;
 
-    if (netif_running(adapter->devs[0]))
-      netif_wake_queue(adapter->devs[0]);
-    if (netif_running(adapter->devs[1]))
-      netif_wake_queue(adapter->devs[1]);
-    if (netif_running(adapter->devs[2]))
-      netif_wake_queue(adapter->devs[2]);
+  channel = adapter->current_channel;
+  adapter->cstats[channel].tx_stalls++;
+
+  if (adapter->xleft > 0 && !adapter->tx_retried)
+  {
+    /* First try: the tty may only have missed a write wakeup */
+    adapter->tx_retried  = true;
+    adapter->tx_progress = jiffies;
+    actual = triple_tty_write(adapter, adapter->xhead, adapter->xleft);
+    adapter->xleft -= actual;
+    adapter->xhead += actual;
+    spin_unlock_bh(&adapter->lock);
     return;
   }
 
-  actual = adapter->tty->ops->write(adapter->tty, adapter->xhead, adapter->xleft);
-  adapter->xleft -= actual;
-  adapter->xhead += actual;
+  if (adapter->xleft <= 0)
+  {
+    /* All bytes went out, only the wakeup got lost */
+    triple_tx_complete(adapter);
+  }
+  else
+  {
+    /* Still stuck after a retry: give up on this frame */
+    adapter->cstats[channel].tx_flushed++;
+    adapter->devs[channel]->stats.tx_errors++;
+    kfree_skb(adapter->tx_skb);
+    adapter->tx_skb = NULL;
+    adapter->xleft  = 0;
+  }
+
+  if (tx_watchdog_poke)
+  {
+    len = TripleSendCmd(adapter->xbuff, U2C_TR_CMD_STATUS, NULL, 0);
+    actual = triple_tty_write(adapter, adapter->xbuff, len);
+    adapter->xleft = len - actual;
+    adapter->xhead = adapter->xbuff + actual;
+  }
+
+  adapter->tx_progress = jiffies;
+  adapter->tx_retried  = false;
+
+KICK:
+  triple_tx_kick(adapter);
+  triple_tx_wake(adapter);
+
   spin_unlock_bh(&adapter->lock);
 
-} /* END: triple_transmit() */
+} /* END: triple_tx_watchdog() */
+
+void triple_tx_watchdog_start (USB2CAN_TRIPLE *adapter)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_tran, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  kthread_init_work(&adapter->wd_work, triple_tx_watchdog);
+  adapter->tx_progress = jiffies;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,15,0)
+  timer_setup(&adapter->tx_watchdog, triple_tx_watchdog_timer, 0);
+#else
+  setup_timer(&adapter->tx_watchdog, triple_tx_watchdog_timer, (unsigned long) adapter);
+#endif
+  mod_timer(&adapter->tx_watchdog, jiffies + HZ);
+
+} /* END: triple_tx_watchdog_start() */
+
+// Before the worker goes away
+void triple_tx_watchdog_stop (USB2CAN_TRIPLE *adapter)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_tran, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,2,0)
+  timer_delete_sync(&adapter->tx_watchdog);
+#else
+  del_timer_sync(&adapter->tx_watchdog);
+#endif
+  kthread_cancel_work_sync(&adapter->wd_work);
+
+} /* END: triple_tx_watchdog_stop() */
@@ -0,0 +1,196 @@
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/cpumask.h>
+#include <linux/vmalloc.h>
+#include <linux/version.h>
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0)
+#include <linux/sched/types.h>
+#endif
+
+#include "tx.h"
+#include "worker.h"
+
+extern bool trace_func_main;
+extern void print_func_trace (bool is_trace, int line, const char *func);
+
+/* Defaults for every new adapter, tripled may override them per adapter. */
+static int worker_prio = 0;
+module_param(worker_prio, int, 0644);
+MODULE_PARM_DESC(worker_prio, "SCHED_FIFO priority of the RX/TX worker (0 = SCHED_NORMAL, nice -20)");
+
+static char worker_cpus[TRIPLE_CPULIST_LEN];
+module_param_string(worker_cpus, worker_cpus, sizeof(worker_cpus), 0644);
+MODULE_PARM_DESC(worker_cpus, "CPU list the RX/TX worker may run on (default: any)");
+
+static int triple_worker_apply (struct task_struct *task, int prio, const char *cpus)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  int            err = 0;
+  cpumask_var_t  mask;
+
+  if (prio < 0 || prio >= MAX_RT_PRIO)
+    return -EINVAL;
+
+  if (cpus[0] != '\0')
+  {
+    if (!zalloc_cpumask_var(&mask, GFP_KERNEL))
+      return -ENOMEM;
+
+    err = cpulist_parse(cpus, mask);
+    if (!err && !cpumask_intersects(mask, cpu_online_mask))
+      err = -EINVAL;
+    if (!err)
+      err = set_cpus_allowed_ptr(task, mask);
+
+    free_cpumask_var(mask);
+    if (err)
+      return err;
+  }
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0)
+  /* Modules can no longer pick an arbitrary RT priority. */
+  if (prio > 0)
+    sched_set_fifo(task);
+  else
+    sched_set_normal(task, MIN_NICE);
+#else
+  {
+    struct sched_param param = { .sched_priority = prio };
+
+    if (prio > 0)
+      err = sched_setscheduler(task, SCHED_FIFO, &param);
+    else
+    {
+      err = sched_setscheduler(task, SCHED_NORMAL, &param);
+      set_user_nice(task, MIN_NICE);
+    }
+  }
+#endif
+
+  return err;
+
+} /* END: triple_worker_apply() */
+
+int triple_worker_start (USB2CAN_TRIPLE *adapter, const char *name)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  int err;
+
+  adapter->rx_ring = vzalloc(TRIPLE_RX_RING);
+  if (!adapter->rx_ring)
+    return -ENOMEM;
+
+  adapter->rx_head  = 0;
+  adapter->rx_tail  = 0;
+  adapter->rx_shead = 0;
+  adapter->rx_stail = 0;
+  adapter->rx_prev  = 0;
+  adapter->rx_stamp = 0;
+
+  adapter->worker = kthread_create_worker(0, "triplecan/%s", name);
+  if (IS_ERR(adapter->worker))
+  {
+    err = PTR_ERR(adapter->worker);
+    adapter->worker = NULL;
+    vfree(adapter->rx_ring);
+    adapter->rx_ring = NULL;
+    return err;
+  }
+
+  kthread_init_work(&adapter->tx_work, triple_transmit);
+  kthread_init_work(&adapter->rx_work, triple_receive);
+
+  err = triple_worker_apply(adapter->worker->task, worker_prio, worker_cpus);
+  if (err)
+    printk(KERN_WARNING "triple: %s: can't apply worker defaults (%d)\n", name, err);
+
+  return 0;
+
+} /* END: triple_worker_start() */
+
+void triple_worker_stop (USB2CAN_TRIPLE *adapter)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  if (!adapter->worker)
+    return;
+
+  /* Flushes pending RX/TX work before the thread goes away. */
+  kthread_destroy_worker(adapter->worker);
+  adapter->worker = NULL;
+
+  vfree(adapter->rx_ring);
+  adapter->rx_ring = NULL;
+
+} /* END: triple_worker_stop() */
+
+int triple_worker_config (USB2CAN_TRIPLE *adapter, const struct triple_worker_cfg *cfg)
+{
+  /*=======================================================*/
+  print_func_trace(trace_func_main, __LINE__, __FUNCTION__);
+  /*=======================================================*/
+
+  char cpus[TRIPLE_CPULIST_LEN];
+
+  if (!adapter->worker)
+    return -ENODEV;
+
+  memcpy(cpus, cfg->cpus, sizeof(cpus));
+  cpus[sizeof(cpus) - 1] = '\0';
+
+  return triple_worker_apply(adapter->worker->task, cfg->prio, cpus);
+
+} /* END: triple_worker_config() */
+
+/*
+ * Called from the ldisc receive path: copy, don't decode, kick the worker.
+ * stamp is the arrival time of the whole chunk, the worker hands it to
+ * every frame that ends inside it.
+ */
+void triple_rx_queue (USB2CAN_TRIPLE *adapter, const unsigned char *cp, int count, ktime_t stamp)
+{
+  unsigned int head = adapter->rx_head;
+  unsigned int tail = smp_load_acquire(&adapter->rx_tail);
+  unsigned int room = TRIPLE_RX_RING - (head - tail);
+  unsigned int shead = adapter->rx_shead;
+  unsigned int chunk;
+
+  if (count > room)
+  {
+    adapter->devs[0]->stats.rx_over_errors++;
+    adapter->devs[1]->stats.rx_over_errors++;
+    adapter->devs[2]->stats.rx_over_errors++;
+    count = room;
+  }
+
+  while (count > 0)
+  {
+    chunk = min_t(unsigned int, count, TRIPLE_RX_RING - (head & (TRIPLE_RX_RING - 1)));
+    memcpy(adapter->rx_ring + (head & (TRIPLE_RX_RING - 1)), cp, chunk);
+    head  += chunk;
+    cp    += chunk;
+    count -= chunk;
+  }
+
+  /* Publish the stamp before the bytes; no free slot -> worker reads the clock itself */
+  if (head != adapter->rx_head && shead - smp_load_acquire(&adapter->rx_stail) < TRIPLE_RX_STAMPS)
+  {
+    adapter->rx_chunk[shead & (TRIPLE_RX_STAMPS - 1)].end   = head;
+    adapter->rx_chunk[shead & (TRIPLE_RX_STAMPS - 1)].stamp = stamp;
+    smp_store_release(&adapter->rx_shead, shead + 1);
+  }
+
+  smp_store_release(&adapter->rx_head, head);
+  kthread_queue_work(adapter->worker, &adapter->rx_work);
+
+} /* END: triple_rx_queue() */
@@ -0,0 +1,164 @@
+/*
+ * bench.c - libtriple throughput
+ *
+ *   triple_bench [frames]
+ *
+ * Encodes and decodes a mix of CAN 2.0 and CAN FD frames in batches, then
+ * pushes them through two adapter handles joined by a socketpair to time
+ * the whole non-blocking send/recv path without hardware.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "libtriple.h"
+#include "triple_codec.h"
+
+#define  BENCH_BATCH                256
+
+static TRIPLE_FRAME frames[BENCH_BATCH];
+static TRIPLE_FRAME decoded[BENCH_BATCH];
+static unsigned char wire[BENCH_BATCH * TRIPLE_CODEC_MAX_FRAME];
+
+static double now (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_frames (void)
+{
+  int i;
+  int j;
+
+  for (i = 0; i < BENCH_BATCH; i++)
+  {
+    memset(&frames[i], 0, sizeof(frames[i]));
+    frames[i].channel   = i % 3;
+    frames[i].fd        = frames[i].channel == 2 && (i & 4);
+    frames[i].cf.can_id = i & 1 ? (0x18DAF100U + i) | CAN_EFF_FLAG : 0x100U + i;
+    frames[i].cf.len    = frames[i].fd ? 64 : 8;
+    for (j = 0; j < frames[i].cf.len; j++)
+      frames[i].cf.data[j] = i + j;    /* hits the framing bytes now and then */
+  }
+}
+
+static void report (const char *what, unsigned long n, double t, size_t bytes)
+{
+  printf("%-8s %10lu frames %8.3f s %12.0f frames/s", what, n, t, n / t);
+  if (bytes)
+    printf(" %8.1f MB/s", bytes / t / 1e6);
+  printf("\n");
+}
+
+int main (int argc, char *argv[])
+{
+  TRIPLE_ADAPTER *tx;
+  TRIPLE_ADAPTER *rx;
+  TRIPLE_DECODER  dec;
+  struct pollfd   pfd[2];
+  unsigned long   total = argc > 1 ? strtoul(argv[1], NULL, 0) : 10000000;
+  unsigned long   sent;
+  unsigned long   got;
+  unsigned long   n;
+  size_t          len = 0;
+  size_t          bytes = 0;
+  double          t;
+  int             used;
+  int             off;
+  int             sv[2];
+  int             ret;
+
+  bench_frames();
+
+  /* encode */
+  t = now();
+  for (n = 0; n < total; n += BENCH_BATCH)
+  {
+    triple_encode_batch(frames, BENCH_BATCH, wire, sizeof(wire), &len);
+    bytes += len;
+  }
+  report("encode", n, now() - t, bytes);
+
+  /* decode, the last encoded batch over and over */
+  triple_decoder_init(&dec);
+  t = now();
+  for (n = 0; n < total;)
+  {
+    for (off = 0; off < (int) len; off += used)
+      n += triple_decode(&dec, wire + off, len - off, &used, decoded, BENCH_BATCH);
+  }
+  report("decode", n, now() - t, (size_t) (n / BENCH_BATCH) * len);
+
+  if (dec.errors || memcmp(&decoded[BENCH_BATCH - 1].cf, &frames[BENCH_BATCH - 1].cf, sizeof(struct canfd_frame)))
+  {
+    fprintf(stderr, "decode mismatch (%lu errors)\n", dec.errors);
+    return EXIT_FAILURE;
+  }
+
+  /* the whole path through a socketpair */
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+  {
+    perror("socketpair");
+    return EXIT_FAILURE;
+  }
+
+  tx = triple_attach(sv[0]);
+  rx = triple_attach(sv[1]);
+  if (!tx || !rx)
+  {
+    perror("triple_attach");
+    return EXIT_FAILURE;
+  }
+
+  sent = got = 0;
+  t = now();
+  while (got < total)
+  {
+    pfd[0].fd     = triple_fd(tx);
+    pfd[0].events = sent < total || triple_pending(tx) ? POLLOUT : 0;
+    pfd[1].fd     = triple_fd(rx);
+    pfd[1].events = POLLIN;
+    if (poll(pfd, 2, 1000) <= 0)
+      break;
+
+    if (pfd[0].revents & POLLOUT)
+    {
+      ret = sent < total ? triple_send(tx, frames, BENCH_BATCH) : triple_flush(tx);
+      if (ret < 0 && errno != EAGAIN)
+        break;
+      if (ret > 0 && sent < total)
+        sent += ret;
+    }
+
+    if (pfd[1].revents & POLLIN)
+    {
+      do
+      {
+        ret = triple_recv(rx, decoded, BENCH_BATCH);
+        if (ret > 0)
+          got += ret;
+      } while (ret == BENCH_BATCH);
+      if (ret < 0)
+        break;
+    }
+  }
+  report("adapter", got, now() - t, 0);
+
+  triple_close(tx);
+  triple_close(rx);
+
+  return got < total ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,108 @@
+#ifndef __LIBTRIPLE_H__
+#define __LIBTRIPLE_H__
+
+/*
+ * libtriple - talk to a USB2CAN Triple adapter directly, without the line
+ * discipline and SocketCAN.
+ *
+ * All calls are non-blocking: the tty is opened O_NONBLOCK and
+ * triple_fd() can be put into any poll/epoll/io_uring loop. Wait for
+ * readable and call triple_recv() until it returns fewer frames than
+ * asked for; bytes already read stay buffered and don't wake the fd
+ * again. When triple_send() took fewer frames than offered or
+ * triple_pending() is not 0, wait for writable and call triple_flush().
+ *
+ * Errors are returned as -1 with errno set, nothing here prints or exits.
+ *
+ * This header needs nothing else from the tree, "make install" puts it
+ * and the libraries under PREFIX; link -ltriple.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <linux/can.h>
+
+/* one frame from or to the adapter, same as in triple_codec.h */
+#ifndef __TRIPLE_FRAME_T__
+#define __TRIPLE_FRAME_T__
+typedef struct
+{
+  int                 channel;          /* 0 - 2                     */
+  bool                fd;               /* frame is a CAN FD frame   */
+  struct canfd_frame  cf;               /* struct can_frame layout when !fd */
+} TRIPLE_FRAME;
+#endif
+
+#define  LIBTRIPLE_VERSION          "1.0"
+
+typedef struct triple_adapter TRIPLE_ADAPTER;
+
+/* CAN FD bit timing of port 3, register values of the MCP2517FD (tripled -c) */
+typedef struct
+{
+  unsigned int  nbrp;
+  unsigned int  ntseg1;
+  unsigned int  ntseg2;
+  unsigned int  nsjw;
+  unsigned int  dbrp;
+  unsigned int  dtseg1;
+  unsigned int  dtseg2;
+  unsigned int  dsjw;
+  unsigned int  tdco;
+  unsigned int  tdcv;
+  unsigned int  tdcmod;                 /* 0 off, 1 manual, 2 auto   */
+} TRIPLE_BITTIMING;
+
+typedef struct
+{
+  unsigned long long  rx_frames;
+  unsigned long long  rx_bytes;
+  unsigned long long  rx_other;         /* status, version, marker answers */
+  unsigned long long  rx_errors;        /* malformed or overlong frames */
+  unsigned long long  tx_frames;
+  unsigned long long  tx_bytes;
+} TRIPLE_STATS;
+
+/* Open and set up a tty (raw, 115200) or take over an already set up fd */
+TRIPLE_ADAPTER *triple_open   (const char *tty);
+TRIPLE_ADAPTER *triple_attach (int fd);
+void            triple_close  (TRIPLE_ADAPTER *a);
+int             triple_fd     (const TRIPLE_ADAPTER *a);
+
+/*
+ * Adapter configuration, queued like frames; 0 or -1. speed is a value of
+ * enum CAN_SPEED (kbit/s, e.g. 500) or enum CAN_FD_SPEED (nominal and data
+ * rate, e.g. 5002000 for 500k / 2M) of tripled_helper.h.
+ */
+int triple_set_speed     (TRIPLE_ADAPTER *a, int port, int speed, bool listen_only);
+int triple_set_fd_speed  (TRIPLE_ADAPTER *a, int speed, bool listen_only, bool esi, bool iso_crc);
+int triple_set_bittiming (TRIPLE_ADAPTER *a, const TRIPLE_BITTIMING *bt, bool listen_only, bool esi, bool iso_crc);
+int triple_set_timestamp (TRIPLE_ADAPTER *a, bool on);
+int triple_get_version   (TRIPLE_ADAPTER *a);
+
+/*
+ * Frames. triple_recv() returns up to max received frames, 0 when nothing
+ * is waiting; triple_send() returns how many of the n frames were taken,
+ * 0 with errno EAGAIN when the send buffer is full. Taken frames are sent,
+ * a write error after taking them is returned by the next triple_send().
+ */
+int    triple_recv    (TRIPLE_ADAPTER *a, TRIPLE_FRAME *out, int max);
+int    triple_send    (TRIPLE_ADAPTER *a, const TRIPLE_FRAME *f, int n);
+int    triple_flush   (TRIPLE_ADAPTER *a);
+size_t triple_pending (const TRIPLE_ADAPTER *a);
+
+void triple_get_stats (const TRIPLE_ADAPTER *a, TRIPLE_STATS *st);
+
+/* Encode frames back to back into buf, no adapter needed; returns the frames encoded */
+int triple_encode_batch (const TRIPLE_FRAME *f, int n, unsigned char *buf, size_t size, size_t *len);
+
+/*
+ * Write bytes from triple_encode_batch() straight from buf, one write()
+ * for many frames. Returns the bytes taken, 0 with errno EAGAIN when the
+ * tty or the queue of triple_send() is full; the rest has to be offered
+ * again from where it stopped. Counted in tx_bytes only.
+ */
+ssize_t triple_write_encoded (TRIPLE_ADAPTER *a, const unsigned char *buf, size_t len);
+
+#endif //__LIBTRIPLE_H__
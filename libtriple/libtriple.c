@@ -0,0 +1,391 @@
+/*
+ * libtriple.c - USB2CAN Triple adapter protocol library
+ *
+ * The frame codec is the one of the tripled bridge (utility/triple_codec.c),
+ * this file adds the adapter handle: a non-blocking tty, a receive buffer
+ * the decoder works on and a send buffer frames and commands are encoded
+ * into and written from.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include "libtriple.h"
+#include "triple_codec.h"
+
+#define  TRIPLE_RX_BUF              16384
+#define  TRIPLE_TX_BUF              65536
+
+struct triple_adapter
+{
+  int             fd;
+  bool            own_fd;
+
+  TRIPLE_DECODER  dec;
+  unsigned char   rx[TRIPLE_RX_BUF];
+  int             rx_off;               /* next byte to decode       */
+  int             rx_len;
+
+  unsigned char   tx[TRIPLE_TX_BUF];
+  size_t          tx_head;              /* first byte not yet written */
+  size_t          tx_tail;
+  int             tx_err;               /* errno of a write after frames were taken */
+
+  TRIPLE_STATS    st;
+};
+
+TRIPLE_ADAPTER *triple_attach (int fd)
+{
+  TRIPLE_ADAPTER *a;
+  int             flags;
+
+  flags = fcntl(fd, F_GETFL);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    return NULL;
+
+  a = calloc(1, sizeof(*a));
+  if (!a)
+    return NULL;
+
+  a->fd = fd;
+  triple_decoder_init(&a->dec);
+
+  return a;
+}
+
+TRIPLE_ADAPTER *triple_open (const char *tty)
+{
+  TRIPLE_ADAPTER *a;
+  struct termios  tios;
+  int             fd;
+  int             err;
+
+  fd = open(tty, O_RDWR | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+
+  /* same line settings as tripled */
+  if (tcgetattr(fd, &tios) < 0)
+    goto fail;
+
+  cfmakeraw(&tios);
+  tios.c_iflag &= ~IXOFF;
+  tios.c_cflag &= ~CRTSCTS;
+  cfsetispeed(&tios, B115200);
+  cfsetospeed(&tios, B115200);
+
+  if (tcsetattr(fd, TCSADRAIN, &tios) < 0)
+    goto fail;
+
+  a = triple_attach(fd);
+  if (!a)
+    goto fail;
+
+  a->own_fd = true;
+  return a;
+
+fail:
+  err = errno;
+  close(fd);
+  errno = err;
+  return NULL;
+}
+
+void triple_close (TRIPLE_ADAPTER *a)
+{
+  if (!a)
+    return;
+
+  if (a->own_fd)
+    close(a->fd);
+  free(a);
+}
+
+int triple_fd (const TRIPLE_ADAPTER *a)
+{
+  return a->fd;
+}
+
+size_t triple_pending (const TRIPLE_ADAPTER *a)
+{
+  return a->tx_tail - a->tx_head;
+}
+
+/* Write what is queued; returns the bytes still pending or -1 */
+int triple_flush (TRIPLE_ADAPTER *a)
+{
+  ssize_t len;
+
+  while (a->tx_head < a->tx_tail)
+  {
+    len = write(a->fd, a->tx + a->tx_head, a->tx_tail - a->tx_head);
+    if (len < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN)
+        break;
+      return -1;
+    }
+
+    a->tx_head     += len;
+    a->st.tx_bytes += len;
+  }
+
+  if (a->tx_head == a->tx_tail)
+    a->tx_head = a->tx_tail = 0;
+
+  return a->tx_tail - a->tx_head;
+}
+
+/* Make room for len more bytes at the tail, 0 or -1 with EAGAIN */
+static int triple_tx_room (TRIPLE_ADAPTER *a, size_t len)
+{
+  if (TRIPLE_TX_BUF - a->tx_tail >= len)
+    return 0;
+
+  if (a->tx_head)
+  {
+    memmove(a->tx, a->tx + a->tx_head, a->tx_tail - a->tx_head);
+    a->tx_tail -= a->tx_head;
+    a->tx_head  = 0;
+  }
+
+  if (TRIPLE_TX_BUF - a->tx_tail >= len)
+    return 0;
+
+  errno = EAGAIN;
+  return -1;
+}
+
+/* FIRST, length, cmd, escaped payload, LAST */
+static int triple_cmd (TRIPLE_ADAPTER *a, unsigned char cmd, const unsigned char *payload, int n)
+{
+  unsigned char *p;
+  int            length = 3;
+  int            i;
+
+  if (triple_tx_room(a, 4 + 2 * n) < 0)
+    return -1;
+
+  p    = a->tx + a->tx_tail;
+  p[0] = U2C_TR_FIRST_BYTE;
+  p[2] = cmd;
+  for (i = 0; i < n; i++)
+    length += USB2CAN_TRIPLE_PushByte(payload[i], p + length);
+  p[length++] = U2C_TR_LAST_BYTE;
+  p[1] = length;
+
+  a->tx_tail += length;
+
+  return triple_flush(a) < 0 ? -1 : 0;
+}
+
+int triple_set_speed (TRIPLE_ADAPTER *a, int port, int speed, bool listen_only)
+{
+  unsigned char p[4];
+
+  if (port < 1 || port > 3)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  p[0] = port;
+  p[1] = (unsigned int) speed >> 8;
+  p[2] = speed;
+  p[3] = listen_only;
+
+  return triple_cmd(a, U2C_TR_CMD_SETTINGS, p, sizeof(p));
+}
+
+int triple_set_fd_speed (TRIPLE_ADAPTER *a, int speed, bool listen_only, bool esi, bool iso_crc)
+{
+  unsigned char p[8];
+
+  p[0] = 3;
+  p[1] = (unsigned int) speed >> 24;
+  p[2] = (unsigned int) speed >> 16;
+  p[3] = (unsigned int) speed >> 8;
+  p[4] = speed;
+  p[5] = listen_only;
+  p[6] = iso_crc;
+  p[7] = esi;
+
+  return triple_cmd(a, U2C_TR_CMD_SETTINGS, p, sizeof(p));
+}
+
+int triple_set_bittiming (TRIPLE_ADAPTER *a, const TRIPLE_BITTIMING *bt, bool listen_only, bool esi, bool iso_crc)
+{
+  unsigned int  v[11];
+  unsigned char p[1 + 2 * 11 + 3];
+  int           n = 0;
+  int           i;
+
+  v[0]  = bt->nbrp;
+  v[1]  = bt->ntseg1;
+  v[2]  = bt->ntseg2;
+  v[3]  = bt->nsjw;
+  v[4]  = bt->dbrp;
+  v[5]  = bt->dtseg1;
+  v[6]  = bt->dtseg2;
+  v[7]  = bt->dsjw;
+  v[8]  = bt->tdco;
+  v[9]  = bt->tdcv;
+  v[10] = bt->tdcmod;
+
+  p[n++] = 3;
+  for (i = 0; i < 11; i++)
+  {
+    if (v[i] > 0xFFFF)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+    p[n++] = v[i] >> 8;
+    p[n++] = v[i];
+  }
+  p[n++] = listen_only;
+  p[n++] = iso_crc;
+  p[n++] = esi;
+
+  return triple_cmd(a, U2C_TR_CMD_BITTIMING, p, n);
+}
+
+int triple_set_timestamp (TRIPLE_ADAPTER *a, bool on)
+{
+  unsigned char p = on;
+
+  return triple_cmd(a, U2C_TR_CMD_TIMESTAMP, &p, 1);
+}
+
+int triple_get_version (TRIPLE_ADAPTER *a)
+{
+  return triple_cmd(a, U2C_TR_CMD_FW_VER, NULL, 0);
+}
+
+int triple_encode_batch (const TRIPLE_FRAME *f, int n, unsigned char *buf, size_t size, size_t *len)
+{
+  size_t  used = 0;
+  int     i;
+
+  for (i = 0; i < n && size - used >= TRIPLE_CODEC_MAX_FRAME; i++)
+    used += triple_encode(buf + used, &f[i]);
+
+  *len = used;
+  return i;
+}
+
+int triple_send (TRIPLE_ADAPTER *a, const TRIPLE_FRAME *f, int n)
+{
+  size_t  len;
+  int     done;
+
+  /* the last call took its frames and then failed to write */
+  if (a->tx_err)
+  {
+    errno     = a->tx_err;
+    a->tx_err = 0;
+    return -1;
+  }
+
+  triple_tx_room(a, TRIPLE_CODEC_MAX_FRAME);
+
+  done = triple_encode_batch(f, n, a->tx + a->tx_tail, TRIPLE_TX_BUF - a->tx_tail, &len);
+  a->tx_tail     += len;
+  a->st.tx_frames += done;
+
+  /* taken frames are queued, a retry would send them twice */
+  if (triple_flush(a) < 0)
+  {
+    if (!done)
+      return -1;
+    a->tx_err = errno;
+  }
+
+  if (!done && n)
+    errno = EAGAIN;
+
+  return done;
+}
+
+ssize_t triple_write_encoded (TRIPLE_ADAPTER *a, const unsigned char *buf, size_t len)
+{
+  ssize_t done;
+
+  /* queued commands and frames go first */
+  done = triple_flush(a);
+  if (done)
+  {
+    if (done > 0)
+      errno = EAGAIN;
+    return done > 0 ? 0 : -1;
+  }
+
+  do
+    done = write(a->fd, buf, len);
+  while (done < 0 && errno == EINTR);
+
+  if (done < 0)
+    return errno == EAGAIN ? 0 : -1;
+
+  a->st.tx_bytes += done;
+  return done;
+}
+
+int triple_recv (TRIPLE_ADAPTER *a, TRIPLE_FRAME *out, int max)
+{
+  ssize_t  len;
+  int      got = 0;
+  int      used;
+
+  while (got < max)
+  {
+    if (a->rx_off == a->rx_len)
+    {
+      len = read(a->fd, a->rx, TRIPLE_RX_BUF);
+      if (len < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        if (errno == EAGAIN)
+          break;
+        return got ? got : -1;
+      }
+      if (len == 0)
+      {
+        if (got)
+          break;
+        errno = EPIPE;
+        return -1;
+      }
+
+      a->rx_off       = 0;
+      a->rx_len       = len;
+      a->st.rx_bytes += len;
+    }
+
+    /* bytes left over when out is full are decoded by the next call */
+    got += triple_decode(&a->dec, a->rx + a->rx_off, a->rx_len - a->rx_off, &used, out + got, max - got);
+    a->rx_off += used;
+  }
+
+  return got;
+}
+
+void triple_get_stats (const TRIPLE_ADAPTER *a, TRIPLE_STATS *st)
+{
+  *st           = a->st;
+  st->rx_frames = a->dec.frames;
+  st->rx_other  = a->dec.other;
+  st->rx_errors = a->dec.errors;
+}
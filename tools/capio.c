@@ -0,0 +1,392 @@
+/*
+ * capio.c - capture input of the offline tools
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "capio.h"
+#include "triple_codec.h"
+#include "tcap.h"
+
+#define  CAP_PCAP_NS                0xA1B23C4D
+#define  CAP_PCAP_US                0xA1B2C3D4
+#define  CAP_PCAP_HDR               24
+#define  CAP_PCAP_REC               16
+#define  CAP_LINKTYPE_USER0         147
+
+static uint32_t cap_u32 (const unsigned char *p)
+{
+  uint32_t v;
+
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+int cap_open (CAP_FILE *c, const char *path)
+{
+  struct stat st;
+
+  memset(c, 0, sizeof(*c));
+  c->fd = open(path, O_RDONLY);
+  if (c->fd < 0)
+    return -1;
+
+  if (fstat(c->fd, &st) < 0)
+    goto fail;
+
+  c->len = st.st_size;
+  if (c->len)
+  {
+    c->p = mmap(NULL, c->len, PROT_READ, MAP_SHARED, c->fd, 0);
+    if (c->p == MAP_FAILED)
+    {
+      c->p = NULL;
+      goto fail;
+    }
+    madvise((void *) c->p, c->len, MADV_SEQUENTIAL);
+  }
+
+  c->fmt = CAP_FMT_RAW;
+  if (c->len >= CAP_BIN_HDR && !memcmp(c->p, CAP_BIN_MAGIC, CAP_BIN_HDR))
+  {
+    c->fmt      = CAP_FMT_BIN;
+    c->rec_from = CAP_BIN_HDR;
+    c->rec_to   = c->len;
+  }
+  else if (c->len >= TCAP_HDR_SIZE && !memcmp(c->p, TCAP_MAGIC, sizeof(((TCAP_HDR *) 0)->magic)))
+  {
+    const TCAP_HDR *h = (const TCAP_HDR *) c->p;
+
+    if (h->version != TCAP_VERSION || h->frame_size != sizeof(struct triple_rxring_frame) ||
+        h->hdr_size < TCAP_HDR_SIZE || h->hdr_size > c->len)
+    {
+      errno = EPROTONOSUPPORT;
+      goto fail;
+    }
+
+    /* unfinished: whatever records made it to the file */
+    c->fmt      = CAP_FMT_TCAP;
+    c->rec_from = h->hdr_size;
+    c->rec_to   = h->frames ? h->index_off : c->len;
+    if (c->rec_to > c->len || c->rec_to < c->rec_from)
+    {
+      errno = EINVAL;
+      goto fail;
+    }
+  }
+  else if (c->len >= CAP_PCAP_HDR && (cap_u32(c->p) == CAP_PCAP_NS || cap_u32(c->p) == CAP_PCAP_US))
+  {
+    if (cap_u32(c->p + 20) != CAP_LINKTYPE_USER0)
+    {
+      errno = EPROTONOSUPPORT;      /* a pcap, but not from the tap */
+      goto fail;
+    }
+    c->fmt = CAP_FMT_TAP;
+  }
+
+  return 0;
+
+fail:
+  cap_close(c);
+  return -1;
+}
+
+void cap_close (CAP_FILE *c)
+{
+  if (c->p)
+    munmap((void *) c->p, c->len);
+  if (c->fd >= 0)
+    close(c->fd);
+  c->p  = NULL;
+  c->fd = -1;
+}
+
+const char *cap_fmt_name (int fmt)
+{
+  switch (fmt)
+  {
+  case CAP_FMT_RAW: return "raw";
+  case CAP_FMT_TAP: return "tap pcap";
+  case CAP_FMT_BIN: return "bin";
+  case CAP_FMT_TCAP: return "tcap";
+  }
+  return "?";
+}
+
+#define  CAP_RESYNC_CHAIN           8
+
+/* Length of a frame that plausibly starts at off, 0 if none does */
+static size_t cap_raw_frame (const CAP_FILE *c, size_t off)
+{
+  size_t len;
+
+  if (off + 1 >= c->len || c->p[off] != U2C_TR_FIRST_BYTE)
+    return 0;
+
+  /* the length byte is never escaped, so it can be FIRST itself */
+  len = c->p[off + 1];
+  if (len < 4 || off + len > c->len || c->p[off + len - 1] != U2C_TR_LAST_BYTE)
+    return 0;
+
+  return len;
+}
+
+/*
+ * First frame start at or after off. A start is not an escaped data byte
+ * and is followed by a chain of frames whose lengths meet up, which data
+ * that merely looks like a frame does not keep up for long.
+ */
+static size_t cap_raw_resync (const CAP_FILE *c, size_t off)
+{
+  const unsigned char *q;
+  size_t               esc;
+  size_t               next;
+  size_t               len;
+  int                  k;
+
+  /* off right after a FIRST would find its length byte first */
+  if (off)
+    off--;
+
+  while (off < c->len)
+  {
+    q = memchr(c->p + off, U2C_TR_FIRST_BYTE, c->len - off);
+    if (!q)
+      return c->len;
+
+    off = q - c->p;
+
+    /* an odd run of escape bytes in front makes it data */
+    for (esc = 0; esc < off && c->p[off - 1 - esc] == U2C_TR_SPEC_BYTE; esc++)
+      ;
+
+    for (k = 0, next = off; !(esc & 1) && k < CAP_RESYNC_CHAIN && next < c->len; k++, next += len)
+    {
+      len = cap_raw_frame(c, next);
+      if (!len)
+        break;
+    }
+    if (!(esc & 1) && (k == CAP_RESYNC_CHAIN || next == c->len))
+      return off;
+
+    off++;
+  }
+
+  return c->len;
+}
+
+int cap_chunks (const CAP_FILE *c, CAP_CHUNK *chunks, int max, size_t min_size)
+{
+  size_t  rec = sizeof(struct triple_rxring_frame);
+  size_t  from;
+  size_t  to;
+  size_t  records;
+  int     want;
+  int     n = 0;
+  int     k;
+
+  want = min_size ? c->len / min_size : 1;
+  if (want > max)
+    want = max;
+  if (want < 1 || c->fmt == CAP_FMT_TAP)
+    want = 1;
+
+  if (c->fmt == CAP_FMT_TCAP)
+    return tcap_chunks(c, chunks, max, min_size);
+
+  if (c->fmt == CAP_FMT_BIN)
+  {
+    records = (c->rec_to - c->rec_from) / rec;
+    for (k = 0; k < want; k++)
+    {
+      chunks[n].from = c->rec_from + records * k / want * rec;
+      chunks[n].to   = c->rec_from + records * (k + 1) / want * rec;
+      if (chunks[n].to > chunks[n].from)
+        n++;
+    }
+    return n;
+  }
+
+  for (from = 0, k = 1; from < c->len; from = to, k++)
+  {
+    to = k < want ? cap_raw_resync(c, c->len / want * k) : c->len;
+    if (to <= from)
+      continue;
+
+    chunks[n].from = from;
+    chunks[n].to   = to;
+    n++;
+  }
+
+  return n;
+}
+
+static int cap_decode_raw (const CAP_FILE *c, const CAP_OPTS *o, const CAP_CHUNK *r, CAP_FRAME_CB cb, void *ctx, CAP_STATS *st)
+{
+  TRIPLE_DECODER  d;
+  CAP_FRAME       f;
+  size_t          off = r->from;
+  int             used;
+  int             ret = 0;
+
+  triple_decoder_init(&d);
+  memset(&f, 0, sizeof(f));
+
+  while (off < r->to)
+  {
+    if (!triple_decode(&d, c->p + off, r->to - off, &used, &f.f, 1))
+    {
+      off += used;
+      continue;
+    }
+    off += used;
+
+    /* end of the frame on the wire, 10 bits per byte */
+    f.ts_ns = o->baud ? o->t0_ns + (uint64_t) ((double) off * 10 * 1e9 / o->baud) : o->t0_ns;
+
+    ret = cb(ctx, &f);
+    if (ret)
+      break;
+  }
+
+  st->frames += d.frames;
+  st->other  += d.other;
+  st->errors += d.errors;
+  st->bytes  += off - r->from;
+
+  return ret;
+}
+
+static int cap_decode_tap (const CAP_FILE *c, const CAP_OPTS *o, CAP_FRAME_CB cb, void *ctx, CAP_STATS *st)
+{
+  TRIPLE_DECODER        d[2];
+  CAP_FRAME             f;
+  const unsigned char  *p;
+  bool                  ns = cap_u32(c->p) == CAP_PCAP_NS;
+  int                   dirs = o->dirs ? o->dirs : CAP_DIR_RX;
+  size_t                off = CAP_PCAP_HDR;
+  uint32_t              incl;
+  int                   dir;
+  int                   pos;
+  int                   used;
+  int                   ret = 0;
+
+  triple_decoder_init(&d[0]);
+  triple_decoder_init(&d[1]);
+  memset(&f, 0, sizeof(f));
+
+  while (!ret && off + CAP_PCAP_REC <= c->len)
+  {
+    incl = cap_u32(c->p + off + 8);
+    if (off + CAP_PCAP_REC + incl > c->len || !incl)
+      break;
+
+    p   = c->p + off + CAP_PCAP_REC;
+    dir = p[0] ? 1 : 0;
+    f.ts_ns = (uint64_t) cap_u32(c->p + off) * 1000000000ULL + (uint64_t) cap_u32(c->p + off + 4) * (ns ? 1 : 1000);
+    off += CAP_PCAP_REC + incl;
+    st->bytes += incl - 1;
+
+    if (!(dirs & (1 << dir)))
+      continue;
+
+    for (pos = 1; pos < (int) incl; pos += used)
+    {
+      if (triple_decode(&d[dir], p + pos, incl - pos, &used, &f.f, 1))
+      {
+        ret = cb(ctx, &f);
+        if (ret)
+          break;
+      }
+    }
+  }
+
+  st->frames += d[0].frames + d[1].frames;
+  st->other  += d[0].other + d[1].other;
+  st->errors += d[0].errors + d[1].errors;
+
+  return ret;
+}
+
+static int cap_decode_bin (const CAP_FILE *c, const CAP_CHUNK *r, CAP_FRAME_CB cb, void *ctx, CAP_STATS *st)
+{
+  struct triple_rxring_frame  rec;
+  CAP_FRAME                   f;
+  size_t                      off;
+  int                         ret = 0;
+
+  for (off = r->from; off + sizeof(rec) <= r->to; off += sizeof(rec))
+  {
+    memcpy(&rec, c->p + off, sizeof(rec));
+    cap_frame_from_bin(&f, &rec);
+    st->frames++;
+    st->bytes += sizeof(rec);
+
+    ret = cb(ctx, &f);
+    if (ret)
+      break;
+  }
+
+  return ret;
+}
+
+int cap_decode (const CAP_FILE *c, const CAP_OPTS *o, const CAP_CHUNK *range, CAP_FRAME_CB cb, void *ctx, CAP_STATS *st)
+{
+  switch (c->fmt)
+  {
+  case CAP_FMT_TAP:
+    return cap_decode_tap(c, o, cb, ctx, st);
+  case CAP_FMT_BIN:
+    return cap_decode_bin(c, range, cb, ctx, st);
+  case CAP_FMT_TCAP:
+    return tcap_decode(c, range, cb, ctx, st);
+  }
+
+  return cap_decode_raw(c, o, range, cb, ctx, st);
+}
+
+int cap_for_each (const CAP_FILE *c, const CAP_OPTS *o, CAP_FRAME_CB cb, void *ctx, CAP_STATS *st)
+{
+  CAP_CHUNK all;
+
+  all.from = c->rec_to ? c->rec_from : 0;
+  all.to   = c->rec_to ? c->rec_to : c->len;
+
+  return cap_decode(c, o, &all, cb, ctx, st);
+}
+
+void cap_frame_to_bin (struct triple_rxring_frame *r, const CAP_FRAME *f)
+{
+  memset(r, 0, sizeof(*r));
+  r->tstamp_ns = f->ts_ns;
+  r->can_id    = f->f.cf.can_id;
+  r->channel   = f->f.channel;
+  r->len       = f->f.cf.len;
+  r->flags     = (f->f.fd ? TRIPLE_RXRING_FD : 0) |
+                 (f->f.cf.flags & CANFD_BRS ? TRIPLE_RXRING_BRS : 0) |
+                 (f->f.cf.flags & CANFD_ESI ? TRIPLE_RXRING_ESI : 0);
+  memcpy(r->data, f->f.cf.data, r->len);
+}
+
+void cap_frame_from_bin (CAP_FRAME *f, const struct triple_rxring_frame *r)
+{
+  memset(f, 0, sizeof(*f));
+  f->ts_ns        = r->tstamp_ns;
+  f->f.channel    = r->channel;
+  f->f.fd         = (r->flags & TRIPLE_RXRING_FD) != 0;
+  f->f.cf.can_id  = r->can_id;
+  f->f.cf.len     = r->len > CANFD_MAX_DLEN ? CANFD_MAX_DLEN : r->len;
+  f->f.cf.flags   = (r->flags & TRIPLE_RXRING_BRS ? CANFD_BRS : 0) | (r->flags & TRIPLE_RXRING_ESI ? CANFD_ESI : 0);
+  memcpy(f->f.cf.data, r->data, f->f.cf.len);
+}
@@ -0,0 +1,241 @@
+/*
+ * capout.c - frame output of the offline tools
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "capout.h"
+
+#define  CAP_LINKTYPE_SOCKETCAN     227
+#define  CAP_SOCKETCAN_FDF          0x04  /* flags byte: CAN FD frame  */
+#define  CAP_SOCKETCAN_HDR          8
+
+static const char hexdigit[] = "0123456789ABCDEF";
+
+int cap_out_parse (const char *name)
+{
+  if (!strcmp(name, "pcap"))
+    return CAP_OUT_PCAP;
+  if (!strcmp(name, "pcapng"))
+    return CAP_OUT_PCAPNG;
+  if (!strcmp(name, "candump") || !strcmp(name, "log"))
+    return CAP_OUT_CANDUMP;
+  if (!strcmp(name, "bin"))
+    return CAP_OUT_BIN;
+  if (!strcmp(name, "tcap"))
+    return CAP_OUT_TCAP;
+  return -1;
+}
+
+void cap_buf_free (CAP_BUF *b)
+{
+  free(b->p);
+  memset(b, 0, sizeof(*b));
+}
+
+/* n more bytes at the end, the buffer grows by doubling */
+void *cap_buf_put (CAP_BUF *b, size_t n)
+{
+  void *p;
+
+  if (b->len + n > b->cap)
+  {
+    b->cap = b->cap ? b->cap * 2 : 1 << 20;
+    while (b->cap < b->len + n)
+      b->cap *= 2;
+
+    p = realloc(b->p, b->cap);
+    if (!p)
+    {
+      perror("cap_buf_put");
+      exit(EXIT_FAILURE);
+    }
+    b->p = p;
+  }
+
+  p = b->p + b->len;
+  b->len += n;
+  return p;
+}
+
+static void cap_put32 (CAP_BUF *b, uint32_t v)
+{
+  memcpy(cap_buf_put(b, 4), &v, 4);
+}
+
+static void cap_put16 (CAP_BUF *b, uint16_t v)
+{
+  memcpy(cap_buf_put(b, 2), &v, 2);
+}
+
+/* struct canfd_frame as SocketCAN hands it to libpcap, id in network order */
+static size_t cap_socketcan (unsigned char *p, const CAP_FRAME *f)
+{
+  uint32_t id = htonl(f->f.cf.can_id);
+  int      len = f->f.cf.len;
+
+  memcpy(p, &id, 4);
+  p[4] = len;
+  p[5] = f->f.fd ? CAP_SOCKETCAN_FDF | (f->f.cf.flags & (CANFD_BRS | CANFD_ESI)) : 0;
+  p[6] = 0;
+  p[7] = 0;
+  memcpy(p + CAP_SOCKETCAN_HDR, f->f.cf.data, len);
+
+  return CAP_SOCKETCAN_HDR + len;
+}
+
+static void cap_pcapng_idb (CAP_BUF *b, const char *name)
+{
+  size_t  nlen = strlen(name);
+  size_t  npad = (nlen + 3) & ~3UL;
+  size_t  len = 20 + 4 + npad + 4 + 4 + 4;
+  char   *p;
+
+  cap_put32(b, 1);                      /* interface description     */
+  cap_put32(b, len);
+  cap_put16(b, CAP_LINKTYPE_SOCKETCAN);
+  cap_put16(b, 0);
+  cap_put32(b, CAP_SOCKETCAN_HDR + CANFD_MAX_DLEN);
+
+  cap_put16(b, 2);                      /* if_name                   */
+  cap_put16(b, nlen);
+  p = cap_buf_put(b, npad);
+  memset(p, 0, npad);
+  memcpy(p, name, nlen);
+
+  cap_put16(b, 9);                      /* if_tsresol: 10^-9         */
+  cap_put16(b, 1);
+  p = cap_buf_put(b, 4);
+  memset(p, 0, 4);
+  p[0] = 9;
+
+  cap_put32(b, 0);                      /* opt_endofopt              */
+  cap_put32(b, len);
+}
+
+void cap_out_header (CAP_BUF *b, int fmt, char *name[3])
+{
+  int i;
+
+  switch (fmt)
+  {
+  case CAP_OUT_PCAP:
+    cap_put32(b, 0xA1B23C4D);
+    cap_put16(b, 2);
+    cap_put16(b, 4);
+    cap_put32(b, 0);
+    cap_put32(b, 0);
+    cap_put32(b, CAP_SOCKETCAN_HDR + CANFD_MAX_DLEN);
+    cap_put32(b, CAP_LINKTYPE_SOCKETCAN);
+    break;
+
+  case CAP_OUT_PCAPNG:
+    cap_put32(b, 0x0A0D0D0A);           /* section header            */
+    cap_put32(b, 28);
+    cap_put32(b, 0x1A2B3C4D);
+    cap_put16(b, 1);
+    cap_put16(b, 0);
+    cap_put32(b, 0xFFFFFFFF);           /* section length unknown    */
+    cap_put32(b, 0xFFFFFFFF);
+    cap_put32(b, 28);
+    for (i = 0; i < 3; i++)
+      cap_pcapng_idb(b, name[i]);
+    break;
+
+  case CAP_OUT_BIN:
+    memcpy(cap_buf_put(b, CAP_BIN_HDR), CAP_BIN_MAGIC, CAP_BIN_HDR);
+    break;
+  }
+}
+
+static size_t cap_candump (char *p, const CAP_FRAME *f, const char *name)
+{
+  canid_t  id = f->f.cf.can_id;
+  char    *s = p;
+  int      i;
+
+  s += sprintf(s, "(%llu.%06llu) %s ", (unsigned long long) (f->ts_ns / 1000000000ULL),
+               (unsigned long long) (f->ts_ns % 1000000000ULL / 1000), name);
+
+  if (id & CAN_EFF_FLAG)
+    s += sprintf(s, "%08X", id & CAN_EFF_MASK);
+  else
+    s += sprintf(s, "%03X", id & CAN_SFF_MASK);
+
+  *s++ = '#';
+  if (f->f.fd)
+  {
+    *s++ = '#';
+    *s++ = hexdigit[f->f.cf.flags & 0x0F];
+  }
+  else if (id & CAN_RTR_FLAG)
+  {
+    *s++ = 'R';
+    if (f->f.cf.len)
+      *s++ = hexdigit[f->f.cf.len & 0x0F];
+    *s++ = '\n';
+    return s - p;
+  }
+
+  for (i = 0; i < f->f.cf.len; i++)
+  {
+    *s++ = hexdigit[f->f.cf.data[i] >> 4];
+    *s++ = hexdigit[f->f.cf.data[i] & 0x0F];
+  }
+  *s++ = '\n';
+
+  return s - p;
+}
+
+void cap_out_frame (CAP_BUF *b, int fmt, const CAP_FRAME *f, char *name[3])
+{
+  unsigned char  pkt[CAP_SOCKETCAN_HDR + CANFD_MAX_DLEN];
+  char           line[64 + 2 * CANFD_MAX_DLEN];
+  size_t         len;
+  size_t         pad;
+
+  switch (fmt)
+  {
+  case CAP_OUT_PCAP:
+    len = cap_socketcan(pkt, f);
+    cap_put32(b, f->ts_ns / 1000000000ULL);
+    cap_put32(b, f->ts_ns % 1000000000ULL);
+    cap_put32(b, len);
+    cap_put32(b, len);
+    memcpy(cap_buf_put(b, len), pkt, len);
+    break;
+
+  case CAP_OUT_PCAPNG:
+    len = cap_socketcan(pkt, f);
+    pad = (len + 3) & ~3UL;
+    cap_put32(b, 6);                    /* enhanced packet           */
+    cap_put32(b, 32 + pad);
+    cap_put32(b, f->f.channel);
+    cap_put32(b, f->ts_ns >> 32);
+    cap_put32(b, f->ts_ns);
+    cap_put32(b, len);
+    cap_put32(b, len);
+    memset(pkt + len, 0, pad - len);
+    memcpy(cap_buf_put(b, pad), pkt, pad);
+    cap_put32(b, 32 + pad);
+    break;
+
+  case CAP_OUT_CANDUMP:
+    len = cap_candump(line, f, name[f->f.channel]);
+    memcpy(cap_buf_put(b, len), line, len);
+    break;
+
+  case CAP_OUT_BIN:
+  case CAP_OUT_TCAP:
+    cap_frame_to_bin(cap_buf_put(b, sizeof(struct triple_rxring_frame)), f);
+    break;
+  }
+}
@@ -0,0 +1,92 @@
+#ifndef __CAPIO_H__
+#define __CAPIO_H__
+
+/*
+ * Capture input of the offline tools.
+ *
+ * A capture is one of
+ *   raw   - Triple protocol bytes as read from the tty (adapter -> host)
+ *   tap   - pcap from debugfs triplecan/<tty>/tap (LINKTYPE_USER0,
+ *           direction byte + raw bytes)
+ *   bin   - "TRIPFRM1" + struct triple_rxring_frame records (tripledump -f bin)
+ *   tcap  - indexed records, see tcap.h
+ *
+ * Files are mapped whole. Raw, bin and tcap captures can be cut into chunks
+ * that decode independently, raw ones at a frame start that is not escaped.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "libtriple.h"
+#include "triple_rxring.h"
+
+#define  CAP_BIN_MAGIC              "TRIPFRM1"
+#define  CAP_BIN_HDR                8
+
+enum
+{
+  CAP_FMT_RAW = 0,
+  CAP_FMT_TAP,
+  CAP_FMT_BIN,
+  CAP_FMT_TCAP,
+};
+
+#define  CAP_DIR_RX                 0x01  /* adapter -> host           */
+#define  CAP_DIR_TX                 0x02  /* host -> adapter, tap only */
+
+/* one decoded frame and when it arrived */
+typedef struct
+{
+  uint64_t      ts_ns;                  /* CLOCK_REALTIME, 0 when unknown */
+  TRIPLE_FRAME  f;
+} CAP_FRAME;
+
+typedef struct
+{
+  int                   fd;
+  const unsigned char  *p;
+  size_t                len;
+  int                   fmt;            /* CAP_FMT_*                 */
+  size_t                rec_from;       /* bin, tcap: the records    */
+  size_t                rec_to;
+} CAP_FILE;
+
+typedef struct
+{
+  size_t  from;
+  size_t  to;
+} CAP_CHUNK;
+
+typedef struct
+{
+  unsigned int  baud;                   /* raw: stamp frames by byte offset at this link rate, 0 -> no time */
+  uint64_t      t0_ns;                  /* raw: time of the first byte */
+  int           dirs;                   /* tap: CAP_DIR_*, 0 -> CAP_DIR_RX */
+} CAP_OPTS;
+
+/* stats of one decode run, summed over chunks */
+typedef struct
+{
+  unsigned long long  frames;
+  unsigned long long  other;            /* status, version, marker answers */
+  unsigned long long  errors;           /* malformed or overlong frames */
+  unsigned long long  bytes;
+} CAP_STATS;
+
+/* nonzero stops the decode */
+typedef int (*CAP_FRAME_CB) (void *ctx, const CAP_FRAME *f);
+
+int         cap_open   (CAP_FILE *c, const char *path);
+void        cap_close  (CAP_FILE *c);
+const char *cap_fmt_name (int fmt);
+int         cap_chunks (const CAP_FILE *c, CAP_CHUNK *chunks, int max, size_t min_size);
+int         cap_decode (const CAP_FILE *c, const CAP_OPTS *o, const CAP_CHUNK *range, CAP_FRAME_CB cb, void *ctx, CAP_STATS *st);
+
+/* whole file in one go */
+int         cap_for_each (const CAP_FILE *c, const CAP_OPTS *o, CAP_FRAME_CB cb, void *ctx, CAP_STATS *st);
+
+void        cap_frame_to_bin   (struct triple_rxring_frame *r, const CAP_FRAME *f);
+void        cap_frame_from_bin (CAP_FRAME *f, const struct triple_rxring_frame *r);
+
+#endif //__CAPIO_H__
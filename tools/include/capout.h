@@ -0,0 +1,41 @@
+#ifndef __CAPOUT_H__
+#define __CAPOUT_H__
+
+/*
+ * Frame output of the offline tools, formatted into memory buffers so
+ * chunks decoded in parallel can be written out in order.
+ *
+ *   pcap     LINKTYPE_CAN_SOCKETCAN, nanosecond stamps, no channel
+ *   pcapng   one LINKTYPE_CAN_SOCKETCAN interface per channel
+ *   candump  candump -l log lines
+ *   bin      CAP_BIN_MAGIC + struct triple_rxring_frame records
+ *   tcap     bare records here, the caller passes them to a TCAP_WRITER
+ */
+
+#include <stddef.h>
+
+#include "capio.h"
+
+enum
+{
+  CAP_OUT_PCAP = 0,
+  CAP_OUT_PCAPNG,
+  CAP_OUT_CANDUMP,
+  CAP_OUT_BIN,
+  CAP_OUT_TCAP,
+};
+
+typedef struct
+{
+  unsigned char  *p;
+  size_t          len;
+  size_t          cap;
+} CAP_BUF;
+
+int   cap_out_parse  (const char *name);
+void  cap_buf_free   (CAP_BUF *b);
+void *cap_buf_put    (CAP_BUF *b, size_t n);
+void  cap_out_header (CAP_BUF *b, int fmt, char *name[3]);
+void  cap_out_frame  (CAP_BUF *b, int fmt, const CAP_FRAME *f, char *name[3]);
+
+#endif //__CAPOUT_H__
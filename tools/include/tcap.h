@@ -0,0 +1,122 @@
+#ifndef __TCAP_H__
+#define __TCAP_H__
+
+/*
+ * tcap - indexed capture of all three ports, mapped and queried in place.
+ *
+ *   0                 TCAP_HDR
+ *   hdr_size          blocks in arrival order, each a TCAP_BLKHDR and up to
+ *                     block_frames records back to back
+ *   index_off         TCAP_BLOCK[blocks]     offset, time and ID range
+ *   ids_off           TCAP_ID[n_ids]         sorted by key
+ *   postings_off      uint32_t block numbers, TCAP_ID.first .. + blocks
+ *
+ * A record is the head of a struct triple_rxring_frame followed by its len
+ * data bytes, unaligned: 24 bytes for a classic frame with 8 data bytes,
+ * 80 for a 64 byte CAN FD frame.
+ *
+ * The header is rewritten last. A capture cut short (frames == 0) still
+ * reads block by block up to the end of the file, only without index.
+ * The per-ID posting list is optional, the writer drops it once a capture
+ * holds more than TCAP_MAX_IDS distinct IDs; then ID queries fall back to
+ * the block ID ranges.
+ *
+ * All fields are little endian.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "capio.h"
+
+#define  TCAP_MAGIC                 "TRIPCAP1"
+#define  TCAP_VERSION               2
+#define  TCAP_HDR_SIZE              128
+#define  TCAP_BLKHDR_MAGIC          "TBLK"
+#define  TCAP_BLOCK_FRAMES          4096
+#define  TCAP_REC_HDR               16        /* record up to the data */
+#define  TCAP_REC_SIZE(len)         (TCAP_REC_HDR + (len))
+#define  TCAP_MAX_IDS               65536
+
+/* ID key of a frame: the CAN ID with CAN_EFF_FLAG, RTR and ERR masked off */
+#define  TCAP_KEY(id)               ((id) & (CAN_EFF_FLAG | CAN_EFF_MASK))
+
+typedef struct
+{
+  char      magic[8];
+  uint32_t  version;
+  uint32_t  hdr_size;                   /* first record              */
+  uint32_t  frame_size;                 /* largest record, sizeof(struct triple_rxring_frame) */
+  uint32_t  block_frames;
+  uint64_t  frames;                     /* 0 while recording         */
+  uint64_t  blocks;
+  uint64_t  index_off;
+  uint64_t  ids_off;                    /* 0 -> no posting list      */
+  uint64_t  n_ids;
+  uint64_t  postings_off;
+  uint64_t  t_first;                    /* CLOCK_REALTIME ns         */
+  uint64_t  t_last;
+  uint64_t  dropped;                    /* frames the source lost    */
+  uint64_t  chan_frames[3];
+  uint8_t   reserved[8];
+} TCAP_HDR;
+
+typedef struct
+{
+  char      magic[4];
+  uint32_t  frames;
+  uint32_t  bytes;                      /* of the records that follow */
+  uint32_t  reserved;
+} TCAP_BLKHDR;
+
+typedef struct
+{
+  uint64_t  offset;                     /* of the TCAP_BLKHDR        */
+  uint32_t  bytes;                      /* of its records            */
+  uint32_t  reserved;
+  uint64_t  t_min;
+  uint64_t  t_max;
+  uint32_t  key_min;
+  uint32_t  key_max;
+  uint32_t  frames;
+  uint32_t  chan_mask;                  /* bit n -> channel n        */
+} TCAP_BLOCK;
+
+typedef struct
+{
+  uint32_t  key;
+  uint32_t  blocks;                     /* length of the posting list */
+  uint64_t  frames;
+  uint64_t  first;                      /* first posting             */
+} TCAP_ID;
+
+typedef struct TCAP_WRITER TCAP_WRITER;
+
+/* what a query keeps, 0 / NULL for no limit */
+typedef struct
+{
+  uint64_t         t_from;
+  uint64_t         t_to;
+  const uint32_t  *keys;
+  int              n_keys;
+  unsigned int     channels;            /* bit n -> channel n, 0 -> all */
+} TCAP_QUERY;
+
+TCAP_WRITER *tcap_writer_open  (const char *path, uint32_t block_frames);
+int          tcap_write        (TCAP_WRITER *w, const struct triple_rxring_frame *r);
+void         tcap_writer_drops (TCAP_WRITER *w, uint64_t dropped);
+int          tcap_writer_close (TCAP_WRITER *w);
+
+/* capio of CAP_FMT_TCAP, by block */
+int tcap_chunks (const CAP_FILE *c, CAP_CHUNK *chunks, int max, size_t min_size);
+int tcap_decode (const CAP_FILE *c, const CAP_CHUNK *range, CAP_FRAME_CB cb, void *ctx, CAP_STATS *st);
+
+/* header of a finished capture, NULL without index */
+const TCAP_HDR   *tcap_hdr    (const CAP_FILE *c);
+const TCAP_BLOCK *tcap_blocks (const CAP_FILE *c);
+const TCAP_ID    *tcap_ids    (const CAP_FILE *c);
+
+bool tcap_match  (const TCAP_QUERY *q, const CAP_FRAME *f);
+int  tcap_select (const CAP_FILE *c, const TCAP_QUERY *q, CAP_CHUNK *chunks, int max, size_t min_size);
+
+#endif //__TCAP_H__
@@ -0,0 +1,663 @@
+/*
+ * tcap.c - indexed capture format, writer and index queries
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "tcap.h"
+
+_Static_assert(sizeof(TCAP_HDR) == TCAP_HDR_SIZE, "TCAP_HDR size");
+_Static_assert(sizeof(TCAP_BLKHDR) == TCAP_REC_HDR, "TCAP_BLKHDR size");
+_Static_assert(sizeof(TCAP_BLOCK) == 48, "TCAP_BLOCK size");
+_Static_assert(sizeof(TCAP_ID) == 24, "TCAP_ID size");
+
+/* one ID while writing, open addressing on key */
+typedef struct
+{
+  uint32_t   key;
+  uint32_t   last;                      /* last block + 1, 0 -> unused slot */
+  uint64_t   frames;
+  uint32_t   n;
+  uint32_t   cap;
+  uint32_t  *blocks;
+} TCAP_IDENT;
+
+struct TCAP_WRITER
+{
+  int                          fd;
+  TCAP_HDR                     hdr;
+
+  unsigned char               *buf;     /* records of the block being filled */
+  uint32_t                     fill;
+  uint32_t                     used;    /* bytes in buf              */
+  uint64_t                     off;     /* where the block goes      */
+  TCAP_BLOCK                  *index;
+  uint64_t                     index_cap;
+
+  TCAP_IDENT                  *ids;     /* NULL once there are too many */
+  uint32_t                     ids_size;
+  uint32_t                     n_ids;
+
+  int                          err;
+};
+
+static int tcap_write_all (int fd, const void *p, size_t n, off_t off)
+{
+  ssize_t r;
+
+  while (n)
+  {
+    r = off < 0 ? write(fd, p, n) : pwrite(fd, p, n, off);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return -1;
+
+    p  = (const char *) p + r;
+    n -= r;
+    if (off >= 0)
+      off += r;
+  }
+
+  return 0;
+}
+
+static uint32_t tcap_hash (uint32_t key)
+{
+  return (key * 2654435761U) ^ (key >> 15);
+}
+
+static void tcap_ids_free (TCAP_WRITER *w)
+{
+  uint32_t i;
+
+  if (!w->ids)
+    return;
+
+  for (i = 0; i < w->ids_size; i++)
+    free(w->ids[i].blocks);
+  free(w->ids);
+  w->ids = NULL;
+}
+
+static TCAP_IDENT *tcap_ident (TCAP_WRITER *w, uint32_t key)
+{
+  TCAP_IDENT *old = w->ids;
+  TCAP_IDENT *e;
+  uint32_t    size = w->ids_size;
+  uint32_t    i;
+
+  for (i = tcap_hash(key) & (size - 1); old[i].last; i = (i + 1) & (size - 1))
+  {
+    if (old[i].key == key)
+      return &old[i];
+  }
+
+  if (w->n_ids >= TCAP_MAX_IDS)
+  {
+    tcap_ids_free(w);                   /* block ID ranges have to do */
+    return NULL;
+  }
+
+  if ((w->n_ids + 1) * 2 <= size)
+  {
+    w->n_ids++;
+    old[i].key = key;
+    return &old[i];
+  }
+
+  /* grow, the new entry goes in with the rest */
+  w->ids = calloc(size * 2, sizeof(*w->ids));
+  if (!w->ids)
+  {
+    w->ids = old;
+    tcap_ids_free(w);
+    return NULL;
+  }
+  w->ids_size = size * 2;
+
+  for (i = 0; i < size; i++)
+  {
+    if (!old[i].last)
+      continue;
+    for (e = &w->ids[tcap_hash(old[i].key) & (w->ids_size - 1)]; e->last; )
+      e = e == &w->ids[w->ids_size - 1] ? w->ids : e + 1;
+    *e = old[i];
+  }
+  free(old);
+
+  return tcap_ident(w, key);
+}
+
+TCAP_WRITER *tcap_writer_open (const char *path, uint32_t block_frames)
+{
+  TCAP_WRITER *w;
+
+  w = calloc(1, sizeof(*w));
+  if (!w)
+    return NULL;
+
+  w->hdr.version      = TCAP_VERSION;
+  w->hdr.hdr_size     = TCAP_HDR_SIZE;
+  w->hdr.frame_size   = sizeof(struct triple_rxring_frame);
+  w->hdr.block_frames = block_frames ? block_frames : TCAP_BLOCK_FRAMES;
+  memcpy(w->hdr.magic, TCAP_MAGIC, sizeof(w->hdr.magic));
+
+  w->ids_size = 1024;
+  w->ids      = calloc(w->ids_size, sizeof(*w->ids));
+  w->buf      = malloc((size_t) w->hdr.block_frames * TCAP_REC_SIZE(CANFD_MAX_DLEN));
+  if (!w->ids || !w->buf)
+    goto fail;
+
+  w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (w->fd < 0)
+    goto fail;
+
+  /* frames == 0 until closed: readable as plain records meanwhile */
+  if (tcap_write_all(w->fd, &w->hdr, sizeof(w->hdr), -1) < 0)
+  {
+    close(w->fd);
+    goto fail;
+  }
+  w->off = sizeof(w->hdr);
+
+  return w;
+
+fail:
+  tcap_ids_free(w);
+  free(w->buf);
+  free(w);
+  return NULL;
+}
+
+/* the records behind a block header out */
+static int tcap_flush (TCAP_WRITER *w)
+{
+  TCAP_BLKHDR  bh;
+  TCAP_BLOCK  *b = &w->index[w->hdr.blocks];
+
+  memset(&bh, 0, sizeof(bh));
+  memcpy(bh.magic, TCAP_BLKHDR_MAGIC, sizeof(bh.magic));
+  bh.frames = w->fill;
+  bh.bytes  = w->used;
+
+  b->offset = w->off;
+  b->bytes  = w->used;
+
+  if (tcap_write_all(w->fd, &bh, sizeof(bh), -1) < 0 ||
+      tcap_write_all(w->fd, w->buf, w->used, -1) < 0)
+    return -1;
+
+  w->off += sizeof(bh) + w->used;
+  w->hdr.blocks++;
+  w->fill = 0;
+  w->used = 0;
+  return 0;
+}
+
+int tcap_write (TCAP_WRITER *w, const struct triple_rxring_frame *r)
+{
+  struct triple_rxring_frame  rec;
+  TCAP_BLOCK                 *b;
+  TCAP_IDENT                 *e;
+  uint32_t                    key = TCAP_KEY(r->can_id);
+  uint32_t                   *blocks;
+
+  if (w->err)
+    return -1;
+
+  /* a block is indexed from its first frame on */
+  if (!w->fill)
+  {
+    if (w->hdr.blocks == w->index_cap)
+    {
+      w->index_cap = w->index_cap ? w->index_cap * 2 : 1024;
+      b = realloc(w->index, w->index_cap * sizeof(*b));
+      if (!b)
+        goto fail;
+      w->index = b;
+    }
+
+    b = &w->index[w->hdr.blocks];
+    memset(b, 0, sizeof(*b));
+    b->t_min   = r->tstamp_ns;
+    b->key_min = key;
+    b->key_max = key;
+  }
+
+  b = &w->index[w->hdr.blocks];
+  if (r->tstamp_ns < b->t_min)
+    b->t_min = r->tstamp_ns;
+  if (r->tstamp_ns > b->t_max)
+    b->t_max = r->tstamp_ns;
+  if (key < b->key_min)
+    b->key_min = key;
+  if (key > b->key_max)
+    b->key_max = key;
+  b->frames++;
+  b->chan_mask |= 1 << (r->channel & 3);
+
+  if (!w->hdr.frames || r->tstamp_ns < w->hdr.t_first)
+    w->hdr.t_first = r->tstamp_ns;
+  if (r->tstamp_ns > w->hdr.t_last)
+    w->hdr.t_last = r->tstamp_ns;
+  if (r->channel < 3)
+    w->hdr.chan_frames[r->channel]++;
+  w->hdr.frames++;
+
+  e = w->ids ? tcap_ident(w, key) : NULL;
+  if (e)
+  {
+    e->frames++;
+    if (e->last != w->hdr.blocks + 1)
+    {
+      if (e->n == e->cap)
+      {
+        e->cap = e->cap ? e->cap * 2 : 4;
+        blocks = realloc(e->blocks, e->cap * sizeof(*blocks));
+        if (!blocks)
+          goto fail;
+        e->blocks = blocks;
+      }
+      e->blocks[e->n++] = w->hdr.blocks;
+      e->last = w->hdr.blocks + 1;
+    }
+  }
+
+  rec = *r;
+  if (rec.len > CANFD_MAX_DLEN)
+    rec.len = CANFD_MAX_DLEN;
+
+  memcpy(w->buf + w->used, &rec, TCAP_REC_SIZE(rec.len));
+  w->used += TCAP_REC_SIZE(rec.len);
+  w->fill++;
+
+  if (w->fill == w->hdr.block_frames && tcap_flush(w) < 0)
+    goto fail;
+
+  return 0;
+
+fail:
+  w->err = errno ? errno : EIO;
+  return -1;
+}
+
+void tcap_writer_drops (TCAP_WRITER *w, uint64_t dropped)
+{
+  w->hdr.dropped += dropped;
+}
+
+static int tcap_key_cmp (const void *a, const void *b)
+{
+  uint32_t ka = ((const TCAP_IDENT *) a)->key;
+  uint32_t kb = ((const TCAP_IDENT *) b)->key;
+
+  return ka < kb ? -1 : ka > kb;
+}
+
+static int tcap_write_ids (TCAP_WRITER *w)
+{
+  TCAP_ID   *ids;
+  uint64_t   first = 0;
+  uint32_t   n = 0;
+  uint32_t   i;
+  int        ret = -1;
+
+  /* pack the used slots and sort them */
+  for (i = 0; i < w->ids_size; i++)
+  {
+    if (!w->ids[i].last)
+      continue;
+    if (n != i)
+    {
+      w->ids[n] = w->ids[i];
+      w->ids[i].blocks = NULL;
+    }
+    n++;
+  }
+  qsort(w->ids, n, sizeof(*w->ids), tcap_key_cmp);
+
+  ids = calloc(n ? n : 1, sizeof(*ids));
+  if (!ids)
+    return -1;
+
+  for (i = 0; i < n; i++)
+  {
+    ids[i].key    = w->ids[i].key;
+    ids[i].blocks = w->ids[i].n;
+    ids[i].frames = w->ids[i].frames;
+    ids[i].first  = first;
+    first += w->ids[i].n;
+  }
+
+  w->hdr.ids_off      = w->hdr.index_off + w->hdr.blocks * sizeof(TCAP_BLOCK);
+  w->hdr.n_ids        = n;
+  w->hdr.postings_off = w->hdr.ids_off + (uint64_t) n * sizeof(*ids);
+
+  if (tcap_write_all(w->fd, ids, (size_t) n * sizeof(*ids), -1) < 0)
+    goto out;
+
+  for (i = 0; i < n; i++)
+  {
+    if (tcap_write_all(w->fd, w->ids[i].blocks, (size_t) w->ids[i].n * sizeof(uint32_t), -1) < 0)
+      goto out;
+  }
+
+  ret = 0;
+
+out:
+  free(ids);
+  return ret;
+}
+
+int tcap_writer_close (TCAP_WRITER *w)
+{
+  int err = w->err;
+
+  if (!err && w->fill && tcap_flush(w) < 0)
+    err = errno;
+
+  if (!err)
+  {
+    w->hdr.index_off = w->off;
+    if (tcap_write_all(w->fd, w->index, w->hdr.blocks * sizeof(TCAP_BLOCK), -1) < 0)
+      err = errno;
+  }
+
+  if (!err && w->ids && tcap_write_ids(w) < 0)
+    err = errno ? errno : ENOMEM;
+
+  /* the header last: an index only counts once it is complete */
+  if (!err && tcap_write_all(w->fd, &w->hdr, sizeof(w->hdr), 0) < 0)
+    err = errno;
+
+  if (close(w->fd) < 0 && !err)
+    err = errno;
+
+  tcap_ids_free(w);
+  free(w->index);
+  free(w->buf);
+  free(w);
+
+  errno = err;
+  return err ? -1 : 0;
+}
+
+const TCAP_HDR *tcap_hdr (const CAP_FILE *c)
+{
+  const TCAP_HDR *h = (const TCAP_HDR *) c->p;
+
+  if (c->fmt != CAP_FMT_TCAP || !h->frames || !h->block_frames)
+    return NULL;
+
+  if (h->index_off + h->blocks * sizeof(TCAP_BLOCK) > c->len ||
+      h->blocks != (h->frames + h->block_frames - 1) / h->block_frames)
+    return NULL;
+
+  if (h->ids_off && (h->ids_off + h->n_ids * sizeof(TCAP_ID) > c->len || h->postings_off > c->len))
+    return NULL;
+
+  return h;
+}
+
+const TCAP_BLOCK *tcap_blocks (const CAP_FILE *c)
+{
+  const TCAP_HDR *h = tcap_hdr(c);
+
+  return h ? (const TCAP_BLOCK *) (c->p + h->index_off) : NULL;
+}
+
+const TCAP_ID *tcap_ids (const CAP_FILE *c)
+{
+  const TCAP_HDR *h = tcap_hdr(c);
+
+  return h && h->ids_off ? (const TCAP_ID *) (c->p + h->ids_off) : NULL;
+}
+
+static int tcap_u32_cmp (const void *a, const void *b)
+{
+  uint32_t ka = *(const uint32_t *) a;
+  uint32_t kb = *(const uint32_t *) b;
+
+  return ka < kb ? -1 : ka > kb;
+}
+
+/* index of the first of the sorted keys >= key */
+static int tcap_lower (const uint32_t *keys, int n, uint32_t key)
+{
+  int lo = 0;
+  int hi = n;
+  int mid;
+
+  while (lo < hi)
+  {
+    mid = (lo + hi) / 2;
+    if (keys[mid] < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+/* q->keys sorted ascending */
+bool tcap_match (const TCAP_QUERY *q, const CAP_FRAME *f)
+{
+  uint32_t key;
+  int      k;
+
+  if (q->channels && !(q->channels & (1 << f->f.channel)))
+    return false;
+  if (f->ts_ns < q->t_from || (q->t_to && f->ts_ns > q->t_to))
+    return false;
+
+  if (q->n_keys)
+  {
+    key = TCAP_KEY(f->f.cf.can_id);
+    k   = tcap_lower(q->keys, q->n_keys, key);
+    if (k == q->n_keys || q->keys[k] != key)
+      return false;
+  }
+
+  return true;
+}
+
+/*
+ * Chunks covering the blocks a query can match, runs of neighbouring
+ * blocks merged up to min_size. Without an index all of the capture.
+ */
+int tcap_select (const CAP_FILE *c, const TCAP_QUERY *q, CAP_CHUNK *chunks, int max, size_t min_size)
+{
+  const TCAP_HDR    *h = tcap_hdr(c);
+  const TCAP_BLOCK  *b = tcap_blocks(c);
+  const TCAP_ID     *ids = tcap_ids(c);
+  const uint32_t    *post;
+  uint64_t           n_post;
+  unsigned char     *mark;
+  size_t             from;
+  size_t             to;
+  uint64_t           i;
+  uint64_t           p;
+  int                n = 0;
+  int                k;
+
+  if (!h)
+    return cap_chunks(c, chunks, max, min_size);
+
+  mark = calloc(h->blocks ? h->blocks : 1, 1);
+  if (!mark)
+    return -1;
+
+  /* IDs with a posting list name their blocks directly */
+  if (q->n_keys && ids)
+  {
+    post   = (const uint32_t *) (c->p + h->postings_off);
+    n_post = (c->len - h->postings_off) / sizeof(*post);
+    for (k = 0; k < q->n_keys; k++)
+    {
+      const TCAP_ID key = { .key = q->keys[k] };
+      const TCAP_ID *id = bsearch(&key, ids, h->n_ids, sizeof(*ids), tcap_u32_cmp);
+
+      for (p = 0; id && p < id->blocks && id->first + p < n_post; p++)
+      {
+        if (post[id->first + p] < h->blocks)
+          mark[post[id->first + p]] = 1;
+      }
+    }
+  }
+  else
+    memset(mark, 1, h->blocks);
+
+  for (i = 0; i < h->blocks; i++)
+  {
+    if (!mark[i])
+      continue;
+
+    if (b[i].t_max < q->t_from || (q->t_to && b[i].t_min > q->t_to) ||
+        (q->channels && !(b[i].chan_mask & q->channels)))
+      mark[i] = 0;
+    else if (q->n_keys && !ids)
+    {
+      k = tcap_lower(q->keys, q->n_keys, b[i].key_min);
+      if (k == q->n_keys || q->keys[k] > b[i].key_max)
+        mark[i] = 0;
+    }
+  }
+
+  for (i = 0; i < h->blocks; i++)
+  {
+    if (!mark[i])
+      continue;
+
+    /* an index pointing past the end of the file names no records */
+    if (b[i].offset > c->len || c->len - b[i].offset < sizeof(TCAP_BLKHDR) ||
+        b[i].bytes > c->len - b[i].offset - sizeof(TCAP_BLKHDR))
+      continue;
+
+    from = b[i].offset;
+    to   = from + sizeof(TCAP_BLKHDR) + b[i].bytes;
+
+    if (n && chunks[n - 1].to == from && chunks[n - 1].to - chunks[n - 1].from < min_size)
+      n--;
+    else if (n == max)
+      n--;                              /* out of chunks, the last one spans the gap */
+    else
+      chunks[n].from = from;
+
+    chunks[n].to = to;
+    n++;
+  }
+
+  free(mark);
+  return n;
+}
+
+/* the block at off and where its records end, 0 when there is none */
+static size_t tcap_block_at (const CAP_FILE *c, size_t off, size_t to, TCAP_BLKHDR *bh)
+{
+  size_t end;
+
+  if (to > c->len)
+    to = c->len;
+  if (off > to || to - off < sizeof(*bh))
+    return 0;
+
+  memcpy(bh, c->p + off, sizeof(*bh));
+  if (memcmp(bh->magic, TCAP_BLKHDR_MAGIC, sizeof(bh->magic)) ||
+      bh->bytes < (uint64_t) bh->frames * TCAP_REC_SIZE(0) ||
+      bh->bytes > (uint64_t) bh->frames * TCAP_REC_SIZE(CANFD_MAX_DLEN))
+    return 0;
+
+  /* a capture cut short ends in a partial block, bytes says more than there is */
+  end = off + sizeof(*bh) + bh->bytes;
+  if (end > to)
+  {
+    bh->bytes = to - off - sizeof(*bh);
+    end = to;
+  }
+
+  return end;
+}
+
+/* Blocks grouped into chunks of about min_size, from the index or a walk over the block headers */
+int tcap_chunks (const CAP_FILE *c, CAP_CHUNK *chunks, int max, size_t min_size)
+{
+  const TCAP_QUERY  all = { 0 };
+  TCAP_BLKHDR       bh;
+  size_t            off;
+  size_t            end;
+  size_t            size;
+  int               n = 0;
+
+  if (tcap_hdr(c))
+  {
+    size = (c->rec_to - c->rec_from) / max + 1;
+    return tcap_select(c, &all, chunks, max, size > min_size ? size : min_size);
+  }
+
+  for (off = c->rec_from; (end = tcap_block_at(c, off, c->rec_to, &bh)); off = end)
+  {
+    if (n && (chunks[n - 1].to - chunks[n - 1].from < min_size || n == max))
+      n--;
+    else
+      chunks[n].from = off;
+
+    chunks[n].to = end;
+    n++;
+  }
+
+  return n;
+}
+
+int tcap_decode (const CAP_FILE *c, const CAP_CHUNK *range, CAP_FRAME_CB cb, void *ctx, CAP_STATS *st)
+{
+  struct triple_rxring_frame  rec;
+  TCAP_BLKHDR                 bh;
+  CAP_FRAME                   f;
+  const unsigned char        *p;
+  const unsigned char        *pend;
+  size_t                      off;
+  size_t                      end;
+  uint32_t                    i;
+  int                         ret = 0;
+
+  for (off = range->from; !ret && (end = tcap_block_at(c, off, range->to, &bh)); off = end)
+  {
+    p    = c->p + off + sizeof(bh);
+    pend = c->p + end;
+    st->bytes += end - off;
+
+    for (i = 0; i < bh.frames && p + TCAP_REC_HDR <= pend; i++, p += TCAP_REC_SIZE(rec.len))
+    {
+      memcpy(&rec, p, TCAP_REC_HDR);
+      if (rec.len > CANFD_MAX_DLEN)
+      {
+        st->errors++;                   /* where the next record starts is lost */
+        break;
+      }
+      if (p + TCAP_REC_SIZE(rec.len) > pend)
+        break;                          /* cut short */
+      memcpy(rec.data, p + TCAP_REC_HDR, rec.len);
+
+      cap_frame_from_bin(&f, &rec);
+      st->frames++;
+
+      ret = cb(ctx, &f);
+      if (ret)
+        break;
+    }
+  }
+
+  return ret;
+}
@@ -0,0 +1,955 @@
+/*
+ * tripleanalyze.c - bus statistics of captures
+ *
+ *   tripleanalyze [options] <capture>
+ *
+ * Bus load, DLC distribution, error frames and gaps per port, period and
+ * jitter per ID. Frames are timed with the model of the driver busload
+ * (triple_frametime.h) at the bit rates of the tripled speed codes. The
+ * capture is cut into chunks that are analysed on all cores; the partial
+ * statistics are merged in file order, the periods and gaps across chunk
+ * boundaries included, so the result does not depend on -j.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <math.h>
+
+#include "capio.h"
+#include "tcap.h"
+#include "triple_speed.h"
+#include "triple_frametime.h"
+
+#define  ANA_MAX_CHUNKS             4096
+#define  ANA_CHUNK_SIZE             (16UL << 20)
+#define  ANA_MAX_THREADS            256
+#define  ANA_MAX_IDS                4096
+#define  ANA_MAX_WINDOWS            (1UL << 24)
+#define  ANA_BOUNDS                 27
+#define  ANA_HIST                   (ANA_BOUNDS + 1)
+#define  ANA_LOAD_HIST              10
+#define  ANA_FREE                   UINT64_MAX
+#define  ANA_NONE                   UINT64_MAX
+
+/* histogram bucket n counts values from ana_bounds[n - 1], 1-2-5 steps from 1 us to 500 s */
+static const uint64_t ana_bounds[ANA_BOUNDS] =
+{
+  1000ULL,         2000ULL,         5000ULL,
+  10000ULL,        20000ULL,        50000ULL,
+  100000ULL,       200000ULL,       500000ULL,
+  1000000ULL,      2000000ULL,      5000000ULL,
+  10000000ULL,     20000000ULL,     50000000ULL,
+  100000000ULL,    200000000ULL,    500000000ULL,
+  1000000000ULL,   2000000000ULL,   5000000000ULL,
+  10000000000ULL,  20000000000ULL,  50000000000ULL,
+  100000000000ULL, 200000000000ULL, 500000000000ULL,
+};
+
+/* one ID on one port, times in ns */
+typedef struct
+{
+  uint64_t            key;              /* port << 32 | TCAP_KEY, ANA_FREE */
+  unsigned long long  frames;
+  uint64_t            t_first;          /* 0 -> no time              */
+  uint64_t            t_last;
+  uint64_t            first_period;     /* ANA_NONE until two frames */
+  uint64_t            last_period;
+  unsigned long long  periods;
+  uint64_t            sum;
+  long double         sum2;
+  uint64_t            p_min;
+  uint64_t            p_max;
+  uint64_t            jit_max;          /* cycle to cycle            */
+  uint32_t            dlc_mask;         /* bit n -> DLC n seen       */
+  unsigned int        hist[ANA_HIST];   /* periods                   */
+  unsigned int        jit[ANA_HIST];    /* |period - previous period| */
+} ANA_ID;
+
+typedef struct
+{
+  ANA_ID  *ids;
+  size_t   size;                        /* power of two              */
+  size_t   used;
+} ANA_IDS;
+
+typedef struct
+{
+  unsigned long long  frames;
+  unsigned long long  fd;
+  unsigned long long  brs;
+  unsigned long long  rtr;
+  unsigned long long  eff;
+  unsigned long long  err;              /* CAN_ERR_FLAG frames       */
+  unsigned long long  dlc[16];
+  uint64_t            wire_ps;
+  uint64_t            t_first;          /* 0 -> no time              */
+  uint64_t            t_last;
+  uint64_t            gap_max;
+  uint64_t            gap_at;           /* start of the largest gap  */
+  unsigned long long  gaps;             /* at least -g long          */
+  unsigned long long  no_win;           /* load samples past ANA_MAX_WINDOWS */
+  uint64_t            win_base;         /* first window of win[]     */
+  uint64_t           *win;              /* wire ps per window        */
+  size_t              n_win;
+  size_t              max_win;
+} ANA_CHAN;
+
+typedef struct
+{
+  ANA_CHAN  chan[3];
+  ANA_IDS   ids;
+  int       oom;
+} ANA_PART;
+
+typedef struct
+{
+  const CAP_FILE   *c;
+  const CAP_OPTS   *o;
+  const TCAP_QUERY *q;
+  CAP_CHUNK         range;
+  uint32_t          bit_ps[3][2];       /* nominal, data             */
+  uint32_t          flags;              /* TRIPLE_FT_EXACT           */
+  uint64_t          window;
+  uint64_t          gap;
+  ANA_PART          part;
+  CAP_STATS         st;
+} ANA_JOB;
+
+static int ana_bucket (uint64_t v)
+{
+  int i;
+
+  for (i = 0; i < ANA_BOUNDS && v >= ana_bounds[i]; i++)
+    ;
+
+  return i;
+}
+
+static size_t ana_hash (uint64_t key, size_t mask)
+{
+  return (size_t) ((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+}
+
+static int ana_ids_grow (ANA_IDS *t)
+{
+  ANA_IDS  n;
+  size_t   i;
+  size_t   k;
+
+  n.size = t->size ? 2 * t->size : 1024;
+  n.used = t->used;
+  n.ids  = malloc(n.size * sizeof(*n.ids));
+  if (!n.ids)
+    return -1;
+
+  for (i = 0; i < n.size; i++)
+    n.ids[i].key = ANA_FREE;
+
+  for (i = 0; i < t->size; i++)
+  {
+    if (t->ids[i].key == ANA_FREE)
+      continue;
+
+    for (k = ana_hash(t->ids[i].key, n.size - 1); n.ids[k].key != ANA_FREE; k = (k + 1) & (n.size - 1))
+      ;
+    n.ids[k] = t->ids[i];
+  }
+
+  free(t->ids);
+  *t = n;
+  return 0;
+}
+
+/* entry of key, created on first use */
+static ANA_ID *ana_id (ANA_IDS *t, uint64_t key)
+{
+  ANA_ID *d;
+  size_t  i;
+
+  if (2 * (t->used + 1) > t->size && ana_ids_grow(t) < 0)
+    return NULL;
+
+  for (i = ana_hash(key, t->size - 1); t->ids[i].key != ANA_FREE; i = (i + 1) & (t->size - 1))
+  {
+    if (t->ids[i].key == key)
+      return &t->ids[i];
+  }
+
+  d = &t->ids[i];
+  memset(d, 0, sizeof(*d));
+  d->key          = key;
+  d->first_period = ANA_NONE;
+  d->last_period  = ANA_NONE;
+  d->p_min        = UINT64_MAX;
+  t->used++;
+
+  return d;
+}
+
+/*
+ * Add wire time to a window. The windows of a port are kept as one array
+ * from the first to the last window seen; it grows to either side.
+ */
+static int ana_win_add (ANA_CHAN *ch, uint64_t w, uint64_t ps)
+{
+  uint64_t  from = ch->n_win && ch->win_base < w ? ch->win_base : w;
+  uint64_t  to   = ch->n_win && ch->win_base + ch->n_win > w + 1 ? ch->win_base + ch->n_win : w + 1;
+  uint64_t *p;
+  size_t    max;
+
+  if (to - from > ANA_MAX_WINDOWS)
+    return -1;
+
+  if (to - from > ch->max_win || (ch->n_win && from < ch->win_base))
+  {
+    max = 2 * ch->max_win > to - from ? 2 * ch->max_win : to - from;
+    if (max > ANA_MAX_WINDOWS)
+      max = ANA_MAX_WINDOWS;
+
+    p = calloc(max, sizeof(*p));
+    if (!p)
+      return -1;
+    if (ch->n_win)
+      memcpy(p + (ch->win_base - from), ch->win, ch->n_win * sizeof(*p));
+
+    free(ch->win);
+    ch->win     = p;
+    ch->max_win = max;
+  }
+
+  ch->win_base = from;
+  ch->n_win    = to - from;
+  ch->win[w - from] += ps;
+
+  return 0;
+}
+
+/* one more period of an ID, the first one of a part has no jitter yet */
+static void ana_period (ANA_ID *d, uint64_t p)
+{
+  uint64_t j;
+  int      b = ana_bucket(p);
+
+  if (d->last_period == ANA_NONE)
+    d->first_period = p;
+  else
+  {
+    j = p > d->last_period ? p - d->last_period : d->last_period - p;
+    d->jit[ana_bucket(j)]++;
+    if (j > d->jit_max)
+      d->jit_max = j;
+  }
+
+  d->last_period = p;
+  d->periods++;
+  d->sum  += p;
+  d->sum2 += (long double) p * p;
+  d->hist[b]++;
+  if (p < d->p_min)
+    d->p_min = p;
+  if (p > d->p_max)
+    d->p_max = p;
+}
+
+/* silence on a port from t_last to ts */
+static void ana_gap (ANA_CHAN *ch, uint64_t ts, uint64_t min)
+{
+  uint64_t gap = ts > ch->t_last ? ts - ch->t_last : 0;
+
+  if (gap > ch->gap_max)
+  {
+    ch->gap_max = gap;
+    ch->gap_at  = ch->t_last;
+  }
+  if (min && gap >= min)
+    ch->gaps++;
+}
+
+static int ana_frame (void *ctx, const CAP_FRAME *f)
+{
+  ANA_JOB                  *j = ctx;
+  ANA_CHAN                 *ch;
+  ANA_ID                   *d;
+  struct triple_frame_bits  b;
+  canid_t                   id = f->f.cf.can_id;
+  uint32_t                  flags = j->flags;
+  uint64_t                  ps;
+  int                       n = f->f.channel;
+  int                       dlc;
+
+  if (n < 0 || n >= 3 || !tcap_match(j->q, f))
+    return 0;
+
+  ch = &j->part.chan[n];
+  ch->frames++;
+
+  /* error frames are reports of the controller, no frame on the wire */
+  if (id & CAN_ERR_FLAG)
+  {
+    ch->err++;
+    return 0;
+  }
+
+  if (f->f.fd)
+  {
+    ch->fd++;
+    flags |= TRIPLE_FT_FD;
+    if (f->f.cf.flags & CANFD_BRS)
+    {
+      ch->brs++;
+      flags |= TRIPLE_FT_BRS;
+    }
+    if (f->f.cf.flags & CANFD_ESI)
+      flags |= TRIPLE_FT_ESI;
+    dlc = triple_ft_dlc(f->f.cf.len);
+  }
+  else
+    dlc = f->f.cf.len > 15 ? 15 : f->f.cf.len;
+
+  if (id & CAN_RTR_FLAG)
+    ch->rtr++;
+  if (id & CAN_EFF_FLAG)
+    ch->eff++;
+  ch->dlc[dlc]++;
+
+  b  = triple_frame_bits(id, f->f.cf.data, f->f.cf.len, flags);
+  ps = triple_frame_ps(b, j->bit_ps[n][0], j->bit_ps[n][1]);
+  ch->wire_ps += ps;
+
+  d = ana_id(&j->part.ids, (uint64_t) n << 32 | TCAP_KEY(id));
+  if (!d)
+  {
+    j->part.oom = 1;
+    return 1;
+  }
+  d->frames++;
+  d->dlc_mask |= 1U << dlc;
+
+  /* raw captures without -b carry no time */
+  if (!f->ts_ns)
+    return 0;
+
+  if (ch->t_last)
+    ana_gap(ch, f->ts_ns, j->gap);
+  else
+    ch->t_first = f->ts_ns;
+  ch->t_last = f->ts_ns;
+
+  if (ana_win_add(ch, f->ts_ns / j->window, ps) < 0)
+    ch->no_win++;
+
+  if (d->t_last)
+    ana_period(d, f->ts_ns > d->t_last ? f->ts_ns - d->t_last : 0);
+  else
+    d->t_first = f->ts_ns;
+  d->t_last = f->ts_ns;
+
+  return 0;
+}
+
+static void *ana_thread (void *arg)
+{
+  ANA_JOB *j = arg;
+
+  cap_decode(j->c, j->o, &j->range, ana_frame, j, &j->st);
+  return NULL;
+}
+
+static void ana_part_free (ANA_PART *p)
+{
+  int i;
+
+  for (i = 0; i < 3; i++)
+    free(p->chan[i].win);
+  free(p->ids.ids);
+  memset(p, 0, sizeof(*p));
+}
+
+/* append port statistics of the next part */
+static void ana_chan_merge (ANA_CHAN *g, const ANA_CHAN *e, uint64_t gap)
+{
+  size_t i;
+
+  g->frames  += e->frames;
+  g->fd      += e->fd;
+  g->brs     += e->brs;
+  g->rtr     += e->rtr;
+  g->eff     += e->eff;
+  g->err     += e->err;
+  g->wire_ps += e->wire_ps;
+  g->gaps    += e->gaps;
+  g->no_win  += e->no_win;
+  for (i = 0; i < 16; i++)
+    g->dlc[i] += e->dlc[i];
+
+  if (e->t_first)
+  {
+    /* the gap across the boundary comes before the ones inside e */
+    if (g->t_last)
+      ana_gap(g, e->t_first, gap);
+    else
+      g->t_first = e->t_first;
+    if (e->gap_max > g->gap_max)
+    {
+      g->gap_max = e->gap_max;
+      g->gap_at  = e->gap_at;
+    }
+    g->t_last = e->t_last;
+  }
+
+  if (!e->n_win)
+    return;
+
+  /* both ends first, the array grows once */
+  if (ana_win_add(g, e->win_base, 0) < 0 || ana_win_add(g, e->win_base + e->n_win - 1, 0) < 0)
+  {
+    for (i = 0; i < e->n_win; i++)
+      g->no_win += !!e->win[i];
+    return;
+  }
+  for (i = 0; i < e->n_win; i++)
+    g->win[e->win_base + i - g->win_base] += e->win[i];
+}
+
+/* append an ID of the next part, stitching the period across the boundary */
+static void ana_id_merge (ANA_ID *g, const ANA_ID *e)
+{
+  uint64_t p;
+  uint64_t j;
+  int      i;
+
+  if (g->t_last && e->t_first)
+  {
+    p = e->t_first > g->t_last ? e->t_first - g->t_last : 0;
+    ana_period(g, p);
+
+    /* e could not know the jitter of its first period */
+    if (e->first_period != ANA_NONE)
+    {
+      j = p > e->first_period ? p - e->first_period : e->first_period - p;
+      g->jit[ana_bucket(j)]++;
+      if (j > g->jit_max)
+        g->jit_max = j;
+    }
+    if (e->last_period != ANA_NONE)
+      g->last_period = e->last_period;
+  }
+  else if (!g->t_last)
+  {
+    g->t_first      = e->t_first;
+    g->first_period = e->first_period;
+    g->last_period  = e->last_period;
+  }
+
+  if (e->t_last)
+    g->t_last = e->t_last;
+
+  g->frames   += e->frames;
+  g->periods  += e->periods;
+  g->sum      += e->sum;
+  g->sum2     += e->sum2;
+  g->dlc_mask |= e->dlc_mask;
+  if (e->p_min < g->p_min)
+    g->p_min = e->p_min;
+  if (e->p_max > g->p_max)
+    g->p_max = e->p_max;
+  if (e->jit_max > g->jit_max)
+    g->jit_max = e->jit_max;
+  for (i = 0; i < ANA_HIST; i++)
+  {
+    g->hist[i] += e->hist[i];
+    g->jit[i]  += e->jit[i];
+  }
+}
+
+static int ana_merge (ANA_PART *g, const ANA_PART *e, uint64_t gap)
+{
+  ANA_ID *d;
+  size_t  i;
+  int     n;
+
+  for (n = 0; n < 3; n++)
+    ana_chan_merge(&g->chan[n], &e->chan[n], gap);
+
+  for (i = 0; i < e->ids.size; i++)
+  {
+    if (e->ids.ids[i].key == ANA_FREE)
+      continue;
+
+    d = ana_id(&g->ids, e->ids.ids[i].key);
+    if (!d)
+      return -1;
+    ana_id_merge(d, &e->ids.ids[i]);
+  }
+
+  return 0;
+}
+
+static int id_cmp (const void *a, const void *b)
+{
+  uint64_t ka = ((const ANA_ID *) a)->key;
+  uint64_t kb = ((const ANA_ID *) b)->key;
+
+  return ka < kb ? -1 : ka > kb;
+}
+
+static int key_cmp (const void *a, const void *b)
+{
+  uint32_t ka = *(const uint32_t *) a;
+  uint32_t kb = *(const uint32_t *) b;
+
+  return ka < kb ? -1 : ka > kb;
+}
+
+static const char *fmt_ns (char *buf, size_t size, uint64_t ns)
+{
+  if (ns >= 1000000000ULL && !(ns % 1000000000ULL))
+    snprintf(buf, size, "%llus", (unsigned long long) (ns / 1000000000ULL));
+  else if (ns >= 1000000ULL && !(ns % 1000000ULL))
+    snprintf(buf, size, "%llums", (unsigned long long) (ns / 1000000ULL));
+  else
+    snprintf(buf, size, "%lluus", (unsigned long long) (ns / 1000ULL));
+
+  return buf;
+}
+
+static void print_time (uint64_t ns)
+{
+  printf("%llu.%03llu", (unsigned long long) (ns / 1000000000ULL), (unsigned long long) (ns % 1000000000ULL / 1000000ULL));
+}
+
+static void print_hist (const char *name, const unsigned int *h)
+{
+  char buf[24];
+  int  i;
+
+  printf("          %-7s", name);
+  for (i = 0; i < ANA_HIST; i++)
+  {
+    if (h[i])
+      printf(" %s:%u", i ? fmt_ns(buf, sizeof(buf), ana_bounds[i - 1]) : "0", h[i]);
+  }
+  printf("\n");
+}
+
+static void print_chan (int n, const ANA_CHAN *ch, const unsigned int bps[2], uint64_t span, uint64_t window, uint64_t gap)
+{
+  unsigned long long  load[ANA_LOAD_HIST];
+  uint64_t            peak = 0;
+  uint64_t            peak_at = 0;
+  size_t              from;
+  size_t              to;
+  size_t              i;
+  char                buf[24];
+  int                 b;
+
+  printf("\nport %d  ", n + 1);
+  if (bps[1])
+    printf("%u / %u bit/s\n", bps[0], bps[1]);
+  else
+    printf("%u bit/s\n", bps[0]);
+
+  printf("  frames    %llu  (FD %llu, BRS %llu, RTR %llu, extended %llu, error frames %llu)\n",
+         ch->frames, ch->fd, ch->brs, ch->rtr, ch->eff, ch->err);
+  if (!ch->frames)
+    return;
+
+  printf("  DLC      ");
+  for (i = 0; i < 16; i++)
+  {
+    if (ch->dlc[i])
+      printf(" %zu:%llu", i, ch->dlc[i]);
+  }
+  printf("\n");
+
+  if (!span)
+  {
+    printf("  load      %.3f s on the wire, no time stamps\n", ch->wire_ps / 1e12);
+    return;
+  }
+
+  printf("  load      %.2f %% mean", ch->wire_ps / (span * 1e3) * 100);
+
+  /* the first and the last window are only partly covered */
+  from = ch->n_win > 2 ? 1 : 0;
+  to   = ch->n_win > 2 ? ch->n_win - 1 : ch->n_win;
+  memset(load, 0, sizeof(load));
+  for (i = from; i < to; i++)
+  {
+    if (ch->win[i] > peak)
+    {
+      peak    = ch->win[i];
+      peak_at = (ch->win_base + i) * window;
+    }
+    b = ch->win[i] * ANA_LOAD_HIST / (window * 1000);
+    load[b < ANA_LOAD_HIST ? b : ANA_LOAD_HIST - 1]++;
+  }
+  if (from < to)
+  {
+    printf(", %.2f %% peak in %s at ", peak / (window * 1e3) * 100, fmt_ns(buf, sizeof(buf), window));
+    print_time(peak_at);
+  }
+  printf("\n");
+
+  if (from < to)
+  {
+    printf("  windows  ");
+    for (b = 0; b < ANA_LOAD_HIST; b++)
+      printf(" %d%%:%llu", b * 100 / ANA_LOAD_HIST, load[b]);
+    printf("\n");
+  }
+  if (ch->no_win)
+    printf("  windows   %llu load samples too far apart, use a longer -w\n", ch->no_win);
+
+  printf("  gaps      largest %.6f s at ", ch->gap_max / 1e9);
+  print_time(ch->gap_at);
+  printf(", %llu at least %s\n", ch->gaps, fmt_ns(buf, sizeof(buf), gap));
+}
+
+static void print_ids (const ANA_IDS *t, int hist)
+{
+  ANA_ID       *ids;
+  const ANA_ID *d;
+  long double   mean;
+  long double   var;
+  size_t        n = 0;
+  size_t        i;
+  uint32_t      key;
+  int           k;
+
+  ids = malloc((t->used ? t->used : 1) * sizeof(*ids));
+  if (!ids)
+  {
+    perror("tripleanalyze");
+    return;
+  }
+  for (i = 0; i < t->size; i++)
+  {
+    if (t->ids[i].key != ANA_FREE)
+      ids[n++] = t->ids[i];
+  }
+  qsort(ids, n, sizeof(*ids), id_cmp);
+
+  printf("\nport  ID              frames   period ms   stddev ms      min ms      max ms  c2c max ms  DLC\n");
+  for (i = 0; i < n; i++)
+  {
+    d   = &ids[i];
+    key = (uint32_t) d->key;
+
+    if (key & CAN_EFF_FLAG)
+      printf("%-4d  %08X", (int) (d->key >> 32) + 1, key & CAN_EFF_MASK);
+    else
+      printf("%-4d  %03X     ", (int) (d->key >> 32) + 1, key);
+
+    printf(" %14llu", d->frames);
+    if (d->periods)
+    {
+      mean = (long double) d->sum / d->periods;
+      var  = d->sum2 / d->periods - mean * mean;
+      printf("  %10.3Lf  %10.3Lf  %10.3f  %10.3f  %10.3f", mean / 1e6, var > 0 ? sqrtl(var) / 1e6 : 0.0L,
+             d->p_min / 1e6, d->p_max / 1e6, d->jit_max / 1e6);
+    }
+    else
+      printf("  %10s  %10s  %10s  %10s  %10s", "-", "-", "-", "-", "-");
+
+    printf(" ");
+    for (k = 0; k < 16; k++)
+    {
+      if (d->dlc_mask & (1U << k))
+        printf(" %d", k);
+    }
+    printf("\n");
+
+    if (hist && d->periods)
+    {
+      print_hist("period", d->hist);
+      print_hist("jitter", d->jit);
+    }
+  }
+
+  free(ids);
+}
+
+static void print_usage (char *prg)
+{
+  fprintf(stderr, "\nUsage: %s [options] <capture>\n", prg);
+  fprintf(stderr, "         -s <s1>:<s2>:<s3>           (tripled speed codes of the ports, default 09:09:13)\n");
+  fprintf(stderr, "         -u <port>:<bit/s>[:<bit/s>] (bit rates of a port, nominal and data, e.g. after tripled -c)\n");
+  fprintf(stderr, "         -E                          (count stuff bits from the content, default worst case)\n");
+  fprintf(stderr, "         -w <msec>                   (bus load window, default 100)\n");
+  fprintf(stderr, "         -g <msec>                   (count gaps at least this long, default 1000)\n");
+  fprintf(stderr, "         -H                          (period and jitter histograms per ID)\n");
+  fprintf(stderr, "         -j <threads>                (threads, default all CPUs)\n");
+  fprintf(stderr, "         -b <baud>                   (raw capture: stamp frames by byte offset at this tty rate)\n");
+  fprintf(stderr, "         -t <sec>[.frac]             (raw capture: time of the first byte)\n");
+  fprintf(stderr, "         -d rx|tx|both               (tap capture: directions to analyse, default rx)\n");
+  fprintf(stderr, "         -c <ports>                  (ports to analyse, e.g. 13, default 123)\n");
+  fprintf(stderr, "         -T [from]:[to]              (frames stamped in this window, seconds)\n");
+  fprintf(stderr, "         -i <id>[,<id>...]           (frames with these hex IDs, 8 digits for extended ones)\n");
+  fprintf(stderr, "         -q                          (no statistics on stderr)\n");
+  fprintf(stderr, "\nSpeed codes are the ones of tripled -s, see tripled -h.\n");
+  fprintf(stderr, "\nExample:\n");
+  fprintf(stderr, "%s -s 0A:0A:24 -w 10 fleet.tcap\n", prg);
+  fprintf(stderr, "%s -u 3:500000:4000000 -H -i 18DAF110 fleet.tcap\n", prg);
+  fprintf(stderr, "\n");
+  exit(EXIT_FAILURE);
+}
+
+int main (int argc, char *argv[])
+{
+  static ANA_JOB      jobs[ANA_MAX_THREADS];
+  static uint32_t     keys[ANA_MAX_IDS];
+  static ANA_PART     all;
+  pthread_t           tid[ANA_MAX_THREADS];
+  CAP_CHUNK          *chunks;
+  CAP_FILE            c;
+  CAP_OPTS            o;
+  CAP_STATS           st;
+  TCAP_QUERY          q;
+  unsigned int        bps[3][2];
+  char               *tok;
+  char               *end;
+  uint64_t            window = 100000000ULL;
+  uint64_t            gap = 1000000000ULL;
+  uint64_t            t_first = 0;
+  uint64_t            t_last = 0;
+  uint32_t            flags = 0;
+  int                 threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int                 hist = 0;
+  int                 quiet = 0;
+  int                 max_chunks;
+  int                 n_chunks;
+  int                 wave;
+  int                 opt;
+  int                 i;
+  int                 n;
+
+  memset(&o, 0, sizeof(o));
+  memset(&st, 0, sizeof(st));
+  memset(&q, 0, sizeof(q));
+  q.keys = keys;
+
+  /* what tripled sets without -s */
+  bps[0][0] = can_speed_bps(SPEED_250k);
+  bps[1][0] = can_speed_bps(SPEED_250k);
+  bps[0][1] = bps[1][1] = 0;
+  can_fd_speed_bps(CAN_250K_1M, &bps[2][0], &bps[2][1]);
+
+  while ((opt = getopt(argc, argv, "s:u:Ew:g:Hj:b:t:d:c:T:i:qh?")) != -1)
+  {
+    switch (opt)
+    {
+    case 's':
+      tok = strtok(optarg, ":");
+      for (n = 0; n < 3 && tok; n++, tok = strtok(NULL, ":"))
+      {
+        if (n < 2)
+          bps[n][0] = can_speed_bps(look_up_can_speed(strtol(tok, NULL, 16)));
+        else
+          can_fd_speed_bps(look_up_can_fd_speed(strtol(tok, NULL, 16)), &bps[2][0], &bps[2][1]);
+      }
+      break;
+    case 'u':
+      n = strtol(optarg, &end, 10) - 1;
+      if (n < 0 || n > 2 || *end != ':')
+        print_usage(argv[0]);
+      bps[n][0] = strtoul(end + 1, &end, 10);
+      bps[n][1] = *end == ':' ? strtoul(end + 1, &end, 10) : 0;
+      if (*end || !bps[n][0] || (n < 2 && bps[n][1]))
+        print_usage(argv[0]);
+      break;
+    case 'E':
+      flags |= TRIPLE_FT_EXACT;
+      break;
+    case 'w':
+      window = (uint64_t) (strtod(optarg, NULL) * 1e6);
+      if (!window)
+        print_usage(argv[0]);
+      break;
+    case 'g':
+      gap = (uint64_t) (strtod(optarg, NULL) * 1e6);
+      break;
+    case 'H':
+      hist = 1;
+      break;
+    case 'j':
+      threads = atoi(optarg);
+      break;
+    case 'b':
+      o.baud = strtoul(optarg, NULL, 0);
+      break;
+    case 't':
+      o.t0_ns = (uint64_t) (strtod(optarg, NULL) * 1e9);
+      break;
+    case 'd':
+      if (!strcmp(optarg, "rx"))
+        o.dirs = CAP_DIR_RX;
+      else if (!strcmp(optarg, "tx"))
+        o.dirs = CAP_DIR_TX;
+      else if (!strcmp(optarg, "both"))
+        o.dirs = CAP_DIR_RX | CAP_DIR_TX;
+      else
+        print_usage(argv[0]);
+      break;
+    case 'c':
+      q.channels = 0;
+      for (tok = optarg; *tok; tok++)
+      {
+        if (*tok < '1' || *tok > '3')
+          print_usage(argv[0]);
+        q.channels |= 1 << (*tok - '1');
+      }
+      break;
+    case 'T':
+      tok = strchr(optarg, ':');
+      if (!tok)
+        print_usage(argv[0]);
+      *tok++ = 0;
+      q.t_from = *optarg ? (uint64_t) (strtod(optarg, NULL) * 1e9) : 0;
+      q.t_to   = *tok ? (uint64_t) (strtod(tok, NULL) * 1e9) : 0;
+      break;
+    case 'i':
+      for (tok = strtok(optarg, ","); tok && q.n_keys < ANA_MAX_IDS; tok = strtok(NULL, ","))
+      {
+        uint32_t id = strtoul(tok, &end, 16);
+
+        if (*end || end == tok)
+          print_usage(argv[0]);
+        keys[q.n_keys++] = strlen(tok) > 3 ? TCAP_KEY(id | CAN_EFF_FLAG) : id & CAN_SFF_MASK;
+      }
+      break;
+    case 'q':
+      quiet = 1;
+      break;
+    default:
+      print_usage(argv[0]);
+      break;
+    }
+  }
+
+  if (optind != argc - 1)
+    print_usage(argv[0]);
+
+  qsort(keys, q.n_keys, sizeof(*keys), key_cmp);
+
+  if (threads < 1)
+    threads = 1;
+  if (threads > ANA_MAX_THREADS)
+    threads = ANA_MAX_THREADS;
+
+  if (cap_open(&c, argv[optind]) < 0)
+  {
+    perror(argv[optind]);
+    exit(EXIT_FAILURE);
+  }
+
+  max_chunks = tcap_hdr(&c) ? tcap_hdr(&c)->blocks + 1 : ANA_MAX_CHUNKS;
+  chunks     = malloc(max_chunks * sizeof(*chunks));
+  n_chunks   = chunks ? tcap_select(&c, &q, chunks, max_chunks, ANA_CHUNK_SIZE) : -1;
+  if (n_chunks < 0)
+  {
+    perror("tripleanalyze");
+    exit(EXIT_FAILURE);
+  }
+
+  for (i = 0; i < threads; i++)
+  {
+    jobs[i].c      = &c;
+    jobs[i].o      = &o;
+    jobs[i].q      = &q;
+    jobs[i].flags  = flags;
+    jobs[i].window = window;
+    jobs[i].gap    = gap;
+    /* the data phase runs at the nominal rate when none is set, as in the driver */
+    for (n = 0; n < 3; n++)
+    {
+      jobs[i].bit_ps[n][0] = (uint32_t) (1000000000000ULL / bps[n][0]);
+      jobs[i].bit_ps[n][1] = (uint32_t) (1000000000000ULL / (bps[n][1] ? bps[n][1] : bps[n][0]));
+    }
+  }
+
+  /* threads chunks at a time, merged in file order */
+  for (wave = 0; wave < n_chunks; wave += threads)
+  {
+    for (i = 0; i < threads && wave + i < n_chunks; i++)
+    {
+      jobs[i].range = chunks[wave + i];
+      memset(&jobs[i].st, 0, sizeof(jobs[i].st));
+
+      /* the first chunk of a wave runs on this thread */
+      if (!i || pthread_create(&tid[i], NULL, ana_thread, &jobs[i]))
+      {
+        tid[i] = 0;
+        if (i)
+          ana_thread(&jobs[i]);
+      }
+    }
+    ana_thread(&jobs[0]);
+
+    for (i = 0; i < threads && wave + i < n_chunks; i++)
+    {
+      if (tid[i])
+        pthread_join(tid[i], NULL);
+
+      if (jobs[i].part.oom || ana_merge(&all, &jobs[i].part, gap) < 0)
+      {
+        fprintf(stderr, "tripleanalyze: out of memory\n");
+        exit(EXIT_FAILURE);
+      }
+      ana_part_free(&jobs[i].part);
+
+      st.frames += jobs[i].st.frames;
+      st.other  += jobs[i].st.other;
+      st.errors += jobs[i].st.errors;
+      st.bytes  += jobs[i].st.bytes;
+    }
+  }
+
+  for (n = 0; n < 3; n++)
+  {
+    if (all.chan[n].t_first && (!t_first || all.chan[n].t_first < t_first))
+      t_first = all.chan[n].t_first;
+    if (all.chan[n].t_last > t_last)
+      t_last = all.chan[n].t_last;
+  }
+
+  printf("%s: %s, %llu frames, %llu malformed, %llu other", argv[optind], cap_fmt_name(c.fmt),
+         st.frames, st.errors, st.other);
+  if (tcap_hdr(&c))
+    printf(", %llu dropped by the source", (unsigned long long) tcap_hdr(&c)->dropped);
+  printf("\n");
+  if (t_first)
+  {
+    printf("time      ");
+    print_time(t_first);
+    printf(" - ");
+    print_time(t_last);
+    printf(" (%.3f s)\n", (t_last - t_first) / 1e9);
+  }
+
+  for (n = 0; n < 3; n++)
+  {
+    if (!q.channels || (q.channels & (1 << n)))
+      print_chan(n, &all.chan[n], bps[n], t_last - t_first, window, gap);
+  }
+
+  print_ids(&all.ids, hist);
+
+  if (!quiet)
+    fprintf(stderr, "%s: %d chunks on %d threads\n", argv[optind], n_chunks, threads);
+
+  ana_part_free(&all);
+  free(chunks);
+  cap_close(&c);
+
+  return 0;
+}
@@ -0,0 +1,421 @@
+/*
+ * tripledump.c - decode captured Triple byte streams offline
+ *
+ *   tripledump [options] <capture>
+ *
+ * Reads a raw tty capture, a debugfs tap pcap, bin frames or a tcap,
+ * decodes it with the codec of libtriple and writes pcap, pcapng, candump
+ * log, bin frames or an indexed tcap. Captures are cut into chunks that
+ * are decoded on all cores; the output of each wave of chunks is written
+ * in file order. Time, port and ID queries on a tcap only read the blocks
+ * its index names.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "capio.h"
+#include "capout.h"
+#include "tcap.h"
+
+#define  DUMP_MAX_CHUNKS            4096
+#define  DUMP_CHUNK_SIZE            (32UL << 20)
+#define  DUMP_MAX_THREADS           256
+#define  DUMP_MAX_IDS               4096
+
+typedef struct
+{
+  const CAP_FILE   *c;
+  const CAP_OPTS   *o;
+  const TCAP_QUERY *q;
+  CAP_CHUNK         range;
+  int               fmt;
+  char            **name;
+  CAP_BUF           out;
+  CAP_STATS         st;
+} DUMP_JOB;
+
+static int dump_frame (void *ctx, const CAP_FRAME *f)
+{
+  DUMP_JOB *j = ctx;
+
+  if (f->f.channel < 3 && tcap_match(j->q, f))
+    cap_out_frame(&j->out, j->fmt, f, j->name);
+
+  return 0;
+}
+
+static void *dump_thread (void *arg)
+{
+  DUMP_JOB *j = arg;
+
+  cap_decode(j->c, j->o, &j->range, dump_frame, j, &j->st);
+  return NULL;
+}
+
+static double now (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_usage (char *prg)
+{
+  fprintf(stderr, "\nUsage: %s [options] <capture>\n", prg);
+  fprintf(stderr, "         -f pcap|pcapng|candump|bin|tcap  (output format, default pcapng)\n");
+  fprintf(stderr, "         -o <file>                   (output file, default stdout, required for tcap)\n");
+  fprintf(stderr, "         -j <threads>                (decode threads, default all CPUs)\n");
+  fprintf(stderr, "         -b <baud>                   (raw capture: stamp frames by byte offset at this tty rate)\n");
+  fprintf(stderr, "         -t <sec>[.frac]             (raw capture: time of the first byte)\n");
+  fprintf(stderr, "         -d rx|tx|both               (tap capture: directions to decode, default rx)\n");
+  fprintf(stderr, "         -c <ports>                  (ports to keep, e.g. 13, default 123)\n");
+  fprintf(stderr, "         -T [from]:[to]              (frames stamped in this window, seconds)\n");
+  fprintf(stderr, "         -i <id>[,<id>...]           (frames with these hex IDs, 8 digits for extended ones)\n");
+  fprintf(stderr, "         -I                          (print the index of a tcap and exit)\n");
+  fprintf(stderr, "         -n[port1]:[port2]:[port3]   (interface names for pcapng/candump, default can0:can1:can2)\n");
+  fprintf(stderr, "         -q                          (no statistics on stderr)\n");
+  fprintf(stderr, "\nExample:\n");
+  fprintf(stderr, "%s -f candump -n can0:can1:canfd0 capture.raw > capture.log\n", prg);
+  fprintf(stderr, "cat /sys/kernel/debug/triplecan/ttyACM0/tap > tap.pcap; %s -d both -o frames.pcapng tap.pcap\n", prg);
+  fprintf(stderr, "%s -f candump -i 18DAF110,7E8 -T 1700000000:1700000060 long.tcap\n", prg);
+  fprintf(stderr, "\n");
+  exit(EXIT_FAILURE);
+}
+
+/* "123,18DAF100" -> keys, candump style: more than 3 digits is extended */
+static int parse_ids (char *arg, uint32_t *keys, int max)
+{
+  char     *tok;
+  char     *end;
+  uint32_t  id;
+  int       n = 0;
+
+  for (tok = strtok(arg, ","); tok && n < max; tok = strtok(NULL, ","))
+  {
+    id = strtoul(tok, &end, 16);
+    if (*end || end == tok)
+      return -1;
+
+    keys[n++] = strlen(tok) > 3 ? TCAP_KEY(id | CAN_EFF_FLAG) : id & CAN_SFF_MASK;
+  }
+
+  return n;
+}
+
+static int key_cmp (const void *a, const void *b)
+{
+  uint32_t ka = *(const uint32_t *) a;
+  uint32_t kb = *(const uint32_t *) b;
+
+  return ka < kb ? -1 : ka > kb;
+}
+
+static void print_key (uint32_t key)
+{
+  if (key & CAN_EFF_FLAG)
+    printf("%08X", key & CAN_EFF_MASK);
+  else
+    printf("%03X", key);
+}
+
+static void dump_info (const CAP_FILE *c, const char *path)
+{
+  const TCAP_HDR    *h = tcap_hdr(c);
+  const TCAP_BLOCK  *b = tcap_blocks(c);
+  const TCAP_ID     *ids = tcap_ids(c);
+  uint64_t           i;
+
+  if (!h)
+  {
+    printf("%s: %s, %zu bytes, no index\n", path, cap_fmt_name(c->fmt), c->len);
+    return;
+  }
+
+  printf("%s: tcap, %llu frames in %llu blocks of %u, %llu dropped by the source\n", path,
+         (unsigned long long) h->frames, (unsigned long long) h->blocks, h->block_frames,
+         (unsigned long long) h->dropped);
+  printf("time    %llu.%09llu - %llu.%09llu (%.3f s)\n",
+         (unsigned long long) (h->t_first / 1000000000ULL), (unsigned long long) (h->t_first % 1000000000ULL),
+         (unsigned long long) (h->t_last / 1000000000ULL), (unsigned long long) (h->t_last % 1000000000ULL),
+         (h->t_last - h->t_first) / 1e9);
+  printf("ports   1: %llu  2: %llu  3: %llu frames\n", (unsigned long long) h->chan_frames[0],
+         (unsigned long long) h->chan_frames[1], (unsigned long long) h->chan_frames[2]);
+
+  if (!ids)
+  {
+    printf("IDs     no posting list, block ID ranges only\n");
+    for (i = 0; i < h->blocks; i++)
+    {
+      printf("block %6llu  %u frames  ", (unsigned long long) i, b[i].frames);
+      print_key(b[i].key_min);
+      printf(" - ");
+      print_key(b[i].key_max);
+      printf("\n");
+    }
+    return;
+  }
+
+  printf("IDs     %llu\n", (unsigned long long) h->n_ids);
+  for (i = 0; i < h->n_ids; i++)
+  {
+    printf("  ");
+    print_key(ids[i].key);
+    printf("  %12llu frames  %8u blocks\n", (unsigned long long) ids[i].frames, ids[i].blocks);
+  }
+}
+
+/* bin records of one job into the tcap */
+static void dump_tcap (TCAP_WRITER *w, const CAP_BUF *b)
+{
+  struct triple_rxring_frame  r;
+  size_t                      off;
+
+  for (off = 0; off + sizeof(r) <= b->len; off += sizeof(r))
+  {
+    memcpy(&r, b->p + off, sizeof(r));
+    if (tcap_write(w, &r) < 0)
+    {
+      perror("tcap");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+int main (int argc, char *argv[])
+{
+  static DUMP_JOB   jobs[DUMP_MAX_THREADS];
+  static uint32_t   keys[DUMP_MAX_IDS];
+  pthread_t         tid[DUMP_MAX_THREADS];
+  CAP_CHUNK        *chunks;
+  CAP_FILE          c;
+  CAP_OPTS          o;
+  CAP_STATS         st;
+  CAP_BUF           hdr;
+  TCAP_QUERY        q;
+  TCAP_WRITER      *w = NULL;
+  FILE             *out = stdout;
+  const char       *out_path = NULL;
+  char             *name[3] = { "can0", "can1", "can2" };
+  char             *tok;
+  int               fmt = CAP_OUT_PCAPNG;
+  int               threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int               quiet = 0;
+  int               info = 0;
+  int               max_chunks;
+  int               n_chunks;
+  int               wave;
+  int               opt;
+  int               i;
+  double            t;
+
+  memset(&o, 0, sizeof(o));
+  memset(&st, 0, sizeof(st));
+  memset(&hdr, 0, sizeof(hdr));
+  memset(&q, 0, sizeof(q));
+  q.keys = keys;
+
+  while ((opt = getopt(argc, argv, "f:o:j:b:t:d:c:T:i:In:qh?")) != -1)
+  {
+    switch (opt)
+    {
+    case 'f':
+      fmt = cap_out_parse(optarg);
+      if (fmt < 0)
+        print_usage(argv[0]);
+      break;
+    case 'o':
+      out_path = optarg;
+      break;
+    case 'j':
+      threads = atoi(optarg);
+      break;
+    case 'b':
+      o.baud = strtoul(optarg, NULL, 0);
+      break;
+    case 't':
+      o.t0_ns = (uint64_t) (strtod(optarg, NULL) * 1e9);
+      break;
+    case 'd':
+      if (!strcmp(optarg, "rx"))
+        o.dirs = CAP_DIR_RX;
+      else if (!strcmp(optarg, "tx"))
+        o.dirs = CAP_DIR_TX;
+      else if (!strcmp(optarg, "both"))
+        o.dirs = CAP_DIR_RX | CAP_DIR_TX;
+      else
+        print_usage(argv[0]);
+      break;
+    case 'c':
+      q.channels = 0;
+      for (tok = optarg; *tok; tok++)
+      {
+        if (*tok < '1' || *tok > '3')
+          print_usage(argv[0]);
+        q.channels |= 1 << (*tok - '1');
+      }
+      break;
+    case 'T':
+      tok = strchr(optarg, ':');
+      if (!tok)
+        print_usage(argv[0]);
+      *tok++ = 0;
+      q.t_from = *optarg ? (uint64_t) (strtod(optarg, NULL) * 1e9) : 0;
+      q.t_to   = *tok ? (uint64_t) (strtod(tok, NULL) * 1e9) : 0;
+      break;
+    case 'i':
+      i = parse_ids(optarg, keys + q.n_keys, DUMP_MAX_IDS - q.n_keys);
+      if (i < 0)
+        print_usage(argv[0]);
+      q.n_keys += i;
+      break;
+    case 'I':
+      info = 1;
+      break;
+    case 'n':
+      tok = strtok(optarg, ":");
+      for (i = 0; i < 3 && tok; i++, tok = strtok(NULL, ":"))
+        name[i] = tok;
+      break;
+    case 'q':
+      quiet = 1;
+      break;
+    default:
+      print_usage(argv[0]);
+      break;
+    }
+  }
+
+  if (optind != argc - 1 || (fmt == CAP_OUT_TCAP && !out_path && !info))
+    print_usage(argv[0]);
+
+  qsort(keys, q.n_keys, sizeof(*keys), key_cmp);
+
+  if (threads < 1)
+    threads = 1;
+  if (threads > DUMP_MAX_THREADS)
+    threads = DUMP_MAX_THREADS;
+
+  if (cap_open(&c, argv[optind]) < 0)
+  {
+    perror(argv[optind]);
+    exit(EXIT_FAILURE);
+  }
+
+  if (info)
+  {
+    dump_info(&c, argv[optind]);
+    cap_close(&c);
+    return 0;
+  }
+
+  if (fmt == CAP_OUT_TCAP)
+  {
+    w = tcap_writer_open(out_path, 0);
+    if (!w)
+    {
+      perror(out_path);
+      exit(EXIT_FAILURE);
+    }
+  }
+  else if (out_path)
+  {
+    out = fopen(out_path, "w");
+    if (!out)
+    {
+      perror(out_path);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  t = now();
+
+  /* the index bounds the chunks of a tcap to its blocks */
+  max_chunks = tcap_hdr(&c) ? tcap_hdr(&c)->blocks + 1 : DUMP_MAX_CHUNKS;
+  chunks     = malloc(max_chunks * sizeof(*chunks));
+  n_chunks   = chunks ? tcap_select(&c, &q, chunks, max_chunks, DUMP_CHUNK_SIZE) : -1;
+  if (n_chunks < 0)
+  {
+    perror("tripledump");
+    exit(EXIT_FAILURE);
+  }
+
+  cap_out_header(&hdr, fmt, name);
+  if (hdr.len)
+    fwrite(hdr.p, 1, hdr.len, out);
+  cap_buf_free(&hdr);
+
+  /* threads chunks at a time, written in order once the wave is done */
+  for (wave = 0; wave < n_chunks; wave += threads)
+  {
+    for (i = 0; i < threads && wave + i < n_chunks; i++)
+    {
+      jobs[i].c        = &c;
+      jobs[i].o        = &o;
+      jobs[i].q        = &q;
+      jobs[i].range    = chunks[wave + i];
+      jobs[i].fmt      = fmt;
+      jobs[i].name     = name;
+      jobs[i].out.len  = 0;
+      memset(&jobs[i].st, 0, sizeof(jobs[i].st));
+
+      /* the first chunk of a wave runs on this thread */
+      if (!i || pthread_create(&tid[i], NULL, dump_thread, &jobs[i]))
+      {
+        tid[i] = 0;
+        if (i)
+          dump_thread(&jobs[i]);
+      }
+    }
+    dump_thread(&jobs[0]);
+
+    for (i = 0; i < threads && wave + i < n_chunks; i++)
+    {
+      if (tid[i])
+        pthread_join(tid[i], NULL);
+
+      if (w)
+        dump_tcap(w, &jobs[i].out);
+      else if (jobs[i].out.len && fwrite(jobs[i].out.p, 1, jobs[i].out.len, out) != jobs[i].out.len)
+      {
+        perror("tripledump");
+        exit(EXIT_FAILURE);
+      }
+
+      st.frames += jobs[i].st.frames;
+      st.other  += jobs[i].st.other;
+      st.errors += jobs[i].st.errors;
+      st.bytes  += jobs[i].st.bytes;
+    }
+  }
+
+  if (w ? tcap_writer_close(w) : fflush(out) || (out != stdout && fclose(out)))
+  {
+    perror("tripledump");
+    exit(EXIT_FAILURE);
+  }
+
+  t = now() - t;
+  if (!quiet)
+    fprintf(stderr, "%s: %s, %llu bytes in %d chunks, %llu frames, %llu other, %llu errors, %.1f MB/s\n",
+            argv[optind], cap_fmt_name(c.fmt), st.bytes, n_chunks, st.frames, st.other, st.errors,
+            t > 0 ? st.bytes / t / 1e6 : 0.0);
+
+  for (i = 0; i < threads; i++)
+    cap_buf_free(&jobs[i].out);
+  free(chunks);
+  cap_close(&c);
+
+  return 0;
+}
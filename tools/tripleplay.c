@@ -0,0 +1,573 @@
+/*
+ * tripleplay.c - replay a capture onto the ports of an adapter
+ *
+ *   tripleplay [options] <capture> <tty>|<file>
+ *
+ * A reader thread decodes the capture (any format tripledump reads),
+ * filters and remaps the frames and encodes them with libtriple into
+ * segments of back to back wire bytes, each frame tagged with when it is
+ * due. The sender writes every frame that is due within the batch window
+ * in one write(), so the rate is bounded by the adapter and the bus, not
+ * by a syscall per frame.
+ *
+ * Pacing sleeps with clock_nanosleep() on an absolute CLOCK_MONOTONIC
+ * deadline up to the busy-wait margin before it, then spins on the clock.
+ *
+ * The tty is driven directly, it must not have the line discipline
+ * attached (tripled not running on it). Any other file gets the bytes as
+ * they would go to the adapter.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "capio.h"
+#include "tcap.h"
+#include "triple_codec.h"
+
+#define  PLAY_SEG_FRAMES            8192
+#define  PLAY_SEGS                  8
+#define  PLAY_MAX_IDS               4096
+#define  PLAY_RX_BATCH              256
+
+/* encoded frames, end[i] is where frame i stops in buf */
+typedef struct
+{
+  unsigned char  *buf;
+  uint32_t       *end;
+  uint64_t       *due;                  /* ns after the start of the replay */
+  int             n;
+} PLAY_SEG;
+
+typedef struct
+{
+  /* filled in by main */
+  CAP_FILE          c;
+  CAP_OPTS          o;
+  TCAP_QUERY        q;
+  int               map[3];             /* source port -> adapter port, -1 drops */
+  double            scale;              /* 0 -> as fast as possible  */
+  int               loops;              /* 0 -> forever              */
+
+  /* segment ring, reader -> sender */
+  PLAY_SEG          seg[PLAY_SEGS];
+  unsigned int      head;               /* next to fill              */
+  unsigned int      tail;               /* next to send              */
+  bool              done;
+  pthread_mutex_t   lock;
+  pthread_cond_t    cond;
+
+  /* reader state */
+  PLAY_SEG         *cur;
+  bool              have_t0;
+  uint64_t          t0;                 /* stamp of the first frame  */
+  uint64_t          t_last;
+  uint64_t          t_base;             /* time of this loop         */
+  unsigned long long frames_in;
+} PLAY;
+
+static volatile sig_atomic_t running = 1;
+
+static void sig_stop (int sig)
+{
+  (void) sig;
+  running = 0;
+}
+
+static uint64_t now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Sleep until deadline - spin, then spin up to it */
+static void wait_until (uint64_t deadline, uint64_t spin)
+{
+  struct timespec ts;
+  uint64_t        t = deadline > spin ? deadline - spin : 0;
+
+  if (now_ns() < t)
+  {
+    ts.tv_sec  = t / 1000000000ULL;
+    ts.tv_nsec = t % 1000000000ULL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && running)
+      ;
+  }
+
+  while (running && now_ns() < deadline)
+    ;
+}
+
+/* hand the filled segment to the sender, wait for a free one */
+static PLAY_SEG *play_push (PLAY *p, bool last)
+{
+  pthread_mutex_lock(&p->lock);
+
+  if (p->cur && p->cur->n)
+    p->head++;
+  if (last)
+    p->done = true;
+  pthread_cond_broadcast(&p->cond);
+
+  while (!last && running && p->head - p->tail >= PLAY_SEGS)
+    pthread_cond_wait(&p->cond, &p->lock);
+
+  p->cur = last || !running ? NULL : &p->seg[p->head % PLAY_SEGS];
+  if (p->cur)
+    p->cur->n = 0;
+
+  pthread_mutex_unlock(&p->lock);
+  return p->cur;
+}
+
+static int play_frame (void *ctx, const CAP_FRAME *f)
+{
+  PLAY         *p = ctx;
+  PLAY_SEG     *s = p->cur;
+  TRIPLE_FRAME  t = f->f;
+  uint32_t      from;
+
+  if (!running)
+    return 1;
+
+  if (f->f.channel > 2 || p->map[f->f.channel] < 0 || !tcap_match(&p->q, f))
+    return 0;
+
+  if (!p->have_t0)
+  {
+    p->have_t0 = true;
+    p->t0      = f->ts_ns;
+  }
+  p->t_last = f->ts_ns;
+
+  t.channel = p->map[f->f.channel];
+  from      = s->n ? s->end[s->n - 1] : 0;
+
+  s->end[s->n] = from + triple_encode(s->buf + from, &t);
+  s->due[s->n] = p->scale > 0 && f->ts_ns > p->t0 ? p->t_base + (uint64_t) ((f->ts_ns - p->t0) / p->scale) : p->t_base;
+  s->n++;
+  p->frames_in++;
+
+  if (s->n == PLAY_SEG_FRAMES && !play_push(p, false))
+    return 1;
+
+  return 0;
+}
+
+static void *play_reader (void *arg)
+{
+  PLAY      *p = arg;
+  CAP_STATS  st;
+  int        loop;
+
+  memset(&st, 0, sizeof(st));
+  play_push(p, false);
+
+  for (loop = 0; running && (!p->loops || loop < p->loops); loop++)
+  {
+    if (p->cur)
+      cap_for_each(&p->c, &p->o, play_frame, p, &st);
+
+    /* the next round follows the last frame of this one */
+    if (p->have_t0 && p->scale > 0)
+      p->t_base += (uint64_t) ((p->t_last - p->t0) / p->scale) + 1000;
+    p->have_t0 = false;
+
+    if (!p->frames_in)
+      break;                            /* nothing matched, nothing to loop */
+  }
+
+  play_push(p, true);
+  return NULL;
+}
+
+/* whatever the adapter sends back, so the tty never throttles */
+static unsigned long long play_drain (TRIPLE_ADAPTER *a)
+{
+  static TRIPLE_FRAME  rx[PLAY_RX_BATCH];
+  unsigned long long   n = 0;
+  int                  got;
+
+  while ((got = triple_recv(a, rx, PLAY_RX_BATCH)) > 0)
+  {
+    n += got;
+    if (got < PLAY_RX_BATCH)
+      break;
+  }
+
+  return n;
+}
+
+static int play_write (TRIPLE_ADAPTER *a, int fd, const unsigned char *buf, size_t len, unsigned long long *rx)
+{
+  struct pollfd  pfd;
+  ssize_t        done;
+
+  while (len && running)
+  {
+    if (a)
+      done = triple_write_encoded(a, buf, len);
+    else
+      done = write(fd, buf, len);
+
+    if (done < 0 && errno != EINTR && errno != EAGAIN)
+      return -1;
+
+    if (done > 0)
+    {
+      buf += done;
+      len -= done;
+      continue;
+    }
+
+    /* adapter busy: wait for room, take what came in meanwhile */
+    pfd.fd     = a ? triple_fd(a) : fd;
+    pfd.events = POLLOUT | (a ? POLLIN : 0);
+    poll(&pfd, 1, 100);
+    if (a && (pfd.revents & POLLIN))
+      *rx += play_drain(a);
+  }
+
+  return 0;
+}
+
+static int parse_map (char *arg, int map[3])
+{
+  char *tok;
+  int   from;
+  int   to;
+
+  for (tok = strtok(arg, ","); tok; tok = strtok(NULL, ","))
+  {
+    if (sscanf(tok, "%d:%d", &from, &to) == 2 && from >= 1 && from <= 3 && to >= 1 && to <= 3)
+      map[from - 1] = to - 1;
+    else if (sscanf(tok, "%d", &from) == 1 && from >= 1 && from <= 3 && strchr(tok, ':') && !strcmp(strchr(tok, ':'), ":-"))
+      map[from - 1] = -1;
+    else
+      return -1;
+  }
+
+  return 0;
+}
+
+static int key_cmp (const void *a, const void *b)
+{
+  uint32_t ka = *(const uint32_t *) a;
+  uint32_t kb = *(const uint32_t *) b;
+
+  return ka < kb ? -1 : ka > kb;
+}
+
+static void print_usage (char *prg)
+{
+  fprintf(stderr, "\nUsage: %s [options] <capture> <tty>|<file>\n", prg);
+  fprintf(stderr, "         -s <factor>                 (time scale, 2 plays twice as fast, default 1 = original timing)\n");
+  fprintf(stderr, "         -x                          (as fast as possible)\n");
+  fprintf(stderr, "         -w <usec>                   (batch window: frames due this soon go in one write, default 100)\n");
+  fprintf(stderr, "         -B <usec>                   (busy-wait the last usec before a deadline, default 50, 0 sleeps only)\n");
+  fprintf(stderr, "         -r <prio>                   (send at SCHED_FIFO priority prio with memory locked)\n");
+  fprintf(stderr, "         -m <from>:<to>[,...]        (port map, e.g. 1:3,3:1 or 2:- to drop port 2)\n");
+  fprintf(stderr, "         -c <ports>                  (source ports to play, e.g. 13, default 123)\n");
+  fprintf(stderr, "         -i <id>[,<id>...]           (only these hex IDs, 8 digits for extended ones)\n");
+  fprintf(stderr, "         -T [from]:[to]              (only frames stamped in this window, seconds)\n");
+  fprintf(stderr, "         -L <n>                      (play n times, 0 = until Ctrl-C, default 1)\n");
+  fprintf(stderr, "         -b <baud>                   (raw capture: stamp frames by byte offset at this tty rate)\n");
+  fprintf(stderr, "         -d rx|tx|both               (tap capture: directions to play, default rx)\n");
+  fprintf(stderr, "         -q                          (no statistics on stderr)\n");
+  fprintf(stderr, "\nThe tty must not be in use by tripled. Ports keep the speeds they were set to.\n");
+  fprintf(stderr, "\nExample:\n");
+  fprintf(stderr, "%s -m 1:2 -i 7E0,7E8 drive.tcap /dev/ttyACM0\n", prg);
+  fprintf(stderr, "%s -x -L 0 burst.tcap /dev/ttyACM0\n", prg);
+  fprintf(stderr, "\n");
+  exit(EXIT_FAILURE);
+}
+
+int main (int argc, char *argv[])
+{
+  static PLAY          p;
+  static uint32_t      keys[PLAY_MAX_IDS];
+  struct sigaction     sa;
+  TRIPLE_ADAPTER      *a = NULL;
+  PLAY_SEG            *s;
+  pthread_t            reader;
+  char                *tok;
+  char                *end;
+  uint64_t             window = 100000;
+  uint64_t             spin = 50000;
+  uint64_t             start;
+  uint64_t             t;
+  unsigned long long   sent = 0;
+  unsigned long long   bytes = 0;
+  unsigned long long   rx = 0;
+  unsigned long long   late = 0;
+  unsigned long long   writes = 0;
+  double               err_sum = 0;
+  int64_t              err_max = 0;
+  int64_t              err;
+  int                  quiet = 0;
+  int                  prio = 0;
+  int                  fd = -1;
+  sigset_t             sigs;
+  uint32_t             from;
+  int                  opt;
+  int                  i;
+  int                  j;
+  int                  k;
+
+  p.scale  = 1.0;
+  p.loops  = 1;
+  p.q.keys = keys;
+  for (i = 0; i < 3; i++)
+    p.map[i] = i;
+
+  while ((opt = getopt(argc, argv, "s:xw:B:r:m:c:i:T:L:b:d:qh?")) != -1)
+  {
+    switch (opt)
+    {
+    case 's':
+      p.scale = strtod(optarg, NULL);
+      if (p.scale <= 0)
+        print_usage(argv[0]);
+      break;
+    case 'x':
+      p.scale = 0;
+      break;
+    case 'w':
+      window = strtoull(optarg, NULL, 0) * 1000;
+      break;
+    case 'B':
+      spin = strtoull(optarg, NULL, 0) * 1000;
+      break;
+    case 'r':
+      prio = atoi(optarg);
+      break;
+    case 'm':
+      if (parse_map(optarg, p.map) < 0)
+        print_usage(argv[0]);
+      break;
+    case 'c':
+      for (tok = optarg; *tok; tok++)
+      {
+        if (*tok < '1' || *tok > '3')
+          print_usage(argv[0]);
+        p.q.channels |= 1 << (*tok - '1');
+      }
+      break;
+    case 'i':
+      for (tok = strtok(optarg, ","); tok && p.q.n_keys < PLAY_MAX_IDS; tok = strtok(NULL, ","))
+      {
+        uint32_t id = strtoul(tok, &end, 16);
+
+        if (*end || end == tok)
+          print_usage(argv[0]);
+        keys[p.q.n_keys++] = strlen(tok) > 3 ? TCAP_KEY(id | CAN_EFF_FLAG) : id & CAN_SFF_MASK;
+      }
+      break;
+    case 'T':
+      tok = strchr(optarg, ':');
+      if (!tok)
+        print_usage(argv[0]);
+      *tok++ = 0;
+      p.q.t_from = *optarg ? (uint64_t) (strtod(optarg, NULL) * 1e9) : 0;
+      p.q.t_to   = *tok ? (uint64_t) (strtod(tok, NULL) * 1e9) : 0;
+      break;
+    case 'L':
+      p.loops = atoi(optarg);
+      break;
+    case 'b':
+      p.o.baud = strtoul(optarg, NULL, 0);
+      break;
+    case 'd':
+      if (!strcmp(optarg, "rx"))
+        p.o.dirs = CAP_DIR_RX;
+      else if (!strcmp(optarg, "tx"))
+        p.o.dirs = CAP_DIR_TX;
+      else if (!strcmp(optarg, "both"))
+        p.o.dirs = CAP_DIR_RX | CAP_DIR_TX;
+      else
+        print_usage(argv[0]);
+      break;
+    case 'q':
+      quiet = 1;
+      break;
+    default:
+      print_usage(argv[0]);
+      break;
+    }
+  }
+
+  if (optind != argc - 2)
+    print_usage(argv[0]);
+
+  qsort(keys, p.q.n_keys, sizeof(*keys), key_cmp);
+
+  if (cap_open(&p.c, argv[optind]) < 0)
+  {
+    perror(argv[optind]);
+    exit(EXIT_FAILURE);
+  }
+  if (p.c.fmt == CAP_FMT_RAW && !p.o.baud && p.scale > 0 && !quiet)
+    fprintf(stderr, "%s: raw capture without -b has no time, playing as fast as possible\n", argv[0]);
+
+  /* an adapter when it is a tty, else the bytes go to the file; nothing new under /dev */
+  fd = open(argv[optind + 1], O_WRONLY | O_NOCTTY);
+  if (fd < 0 && errno == ENOENT && strncmp(argv[optind + 1], "/dev/", 5))
+    fd = open(argv[optind + 1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd >= 0 && isatty(fd))
+  {
+    close(fd);
+    fd = -1;
+    a  = triple_open(argv[optind + 1]);
+  }
+  if (fd < 0 && !a)
+  {
+    perror(argv[optind + 1]);
+    exit(EXIT_FAILURE);
+  }
+
+  for (i = 0; i < PLAY_SEGS; i++)
+  {
+    p.seg[i].buf = malloc((size_t) PLAY_SEG_FRAMES * TRIPLE_CODEC_MAX_FRAME);
+    p.seg[i].end = malloc(PLAY_SEG_FRAMES * sizeof(*p.seg[i].end));
+    p.seg[i].due = malloc(PLAY_SEG_FRAMES * sizeof(*p.seg[i].due));
+    if (!p.seg[i].buf || !p.seg[i].end || !p.seg[i].due)
+    {
+      perror("tripleplay");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = sig_stop;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  /* signals end the sender's sleep, the reader never sees them */
+  sigemptyset(&sigs);
+  sigaddset(&sigs, SIGINT);
+  sigaddset(&sigs, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+  pthread_mutex_init(&p.lock, NULL);
+  pthread_cond_init(&p.cond, NULL);
+  if (pthread_create(&reader, NULL, play_reader, &p))
+  {
+    perror("pthread_create");
+    exit(EXIT_FAILURE);
+  }
+  pthread_sigmask(SIG_UNBLOCK, &sigs, NULL);
+
+  /* only the sender, the reader keeps its normal priority */
+  if (prio > 0)
+  {
+    struct sched_param sp = { .sched_priority = prio };
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+      perror("mlockall");
+    if ((errno = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp)))
+      perror("SCHED_FIFO");
+  }
+
+  /* let the reader fill the ring before the clock starts */
+  pthread_mutex_lock(&p.lock);
+  while (running && !p.done && p.head - p.tail < PLAY_SEGS / 2)
+    pthread_cond_wait(&p.cond, &p.lock);
+  pthread_mutex_unlock(&p.lock);
+
+  start = now_ns();
+
+  while (running)
+  {
+    pthread_mutex_lock(&p.lock);
+    while (running && !p.done && p.head == p.tail)
+      pthread_cond_wait(&p.cond, &p.lock);
+    s = p.head != p.tail ? &p.seg[p.tail % PLAY_SEGS] : NULL;
+    pthread_mutex_unlock(&p.lock);
+
+    if (!s)
+      break;
+
+    for (i = 0; i < s->n && running; i = j)
+    {
+      if (p.scale > 0)
+        wait_until(start + s->due[i], spin);
+
+      /* everything due within the window goes now */
+      t = now_ns() - start;
+      for (j = i + 1; j < s->n && (p.scale == 0 || s->due[j] <= t + window); j++)
+        ;
+
+      from = i ? s->end[i - 1] : 0;
+      if (play_write(a, fd, s->buf + from, s->end[j - 1] - from, &rx) < 0)
+      {
+        perror(argv[optind + 1]);
+        running = 0;
+        break;
+      }
+
+      /* how far from due each frame went out, early ones by the window at most */
+      for (k = i; p.scale > 0 && k < j; k++)
+      {
+        err = (int64_t) t - (int64_t) s->due[k];
+        err_sum += err < 0 ? -err : err;
+        if (err > err_max)
+          err_max = err;
+        if (err > (int64_t) window)
+          late++;
+      }
+
+      sent  += j - i;
+      bytes += s->end[j - 1] - from;
+      writes++;
+
+      if (a)
+        rx += play_drain(a);
+    }
+
+    pthread_mutex_lock(&p.lock);
+    p.tail++;
+    pthread_cond_broadcast(&p.cond);
+    pthread_mutex_unlock(&p.lock);
+  }
+
+  running = 0;
+  pthread_mutex_lock(&p.lock);
+  pthread_cond_broadcast(&p.cond);
+  pthread_mutex_unlock(&p.lock);
+  pthread_join(reader, NULL);
+
+  t = now_ns() - start;
+  if (!quiet)
+  {
+    fprintf(stderr, "%s: %llu frames, %llu bytes in %llu writes, %.3f s, %.0f frames/s, %llu frames received\n",
+            argv[0], sent, bytes, writes, t / 1e9, t ? sent / (t / 1e9) : 0.0, rx);
+    if (p.scale > 0 && sent)
+      fprintf(stderr, "%s: timing error mean %.1f us, max late %.1f us, %llu frames later than the window\n",
+              argv[0], err_sum / sent / 1e3, err_max / 1e3, late);
+  }
+
+  triple_close(a);
+  if (fd >= 0)
+    close(fd);
+  cap_close(&p.c);
+
+  return 0;
+}
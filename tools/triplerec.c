@@ -0,0 +1,227 @@
+/*
+ * triplerec.c - record all three ports of an adapter into a tcap
+ *
+ *   triplerec [options] <tty>|<rx ring device>
+ *
+ * Reads the memory mapped RX ring the driver offers with rx_ring_frames
+ * set (/dev/triplecan-<tty>) and writes every frame into an indexed tcap.
+ * The ring stamps are CLOCK_MONOTONIC; they are moved to CLOCK_REALTIME
+ * with the offset between both clocks at start.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "tcap.h"
+
+static volatile sig_atomic_t running = 1;
+
+static void sig_stop (int sig)
+{
+  (void) sig;
+  running = 0;
+}
+
+static uint64_t clock_ns (clockid_t id)
+{
+  struct timespec ts;
+
+  clock_gettime(id, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void print_usage (char *prg)
+{
+  fprintf(stderr, "\nUsage: %s [options] <tty>|<rx ring device>\n", prg);
+  fprintf(stderr, "         -o <file>                   (tcap to write, default triple-<time>.tcap)\n");
+  fprintf(stderr, "         -t <sec>                    (stop after this many seconds)\n");
+  fprintf(stderr, "         -w <frames>                 (wake up once this many frames wait, default 1/4 ring)\n");
+  fprintf(stderr, "         -q                          (no statistics on stderr)\n");
+  fprintf(stderr, "\nThe driver needs the module parameter rx_ring_frames, e.g. rx_ring_frames=65536\n");
+  fprintf(stderr, "\nExample:\n");
+  fprintf(stderr, "%s -o bench.tcap ttyACM0\n", prg);
+  fprintf(stderr, "\n");
+  exit(EXIT_FAILURE);
+}
+
+int main (int argc, char *argv[])
+{
+  struct triple_rxring_hdr          *h;
+  const struct triple_rxring_frame  *f;
+  struct triple_rxring_frame         rec;
+  struct sigaction                   sa;
+  struct pollfd                      pfd;
+  TCAP_WRITER                       *w;
+  char                               dev[64];
+  char                               out[64];
+  const char                        *out_path = NULL;
+  unsigned long long                 frames = 0;
+  uint64_t                           dropped0;
+  uint64_t                           rt_off;
+  uint64_t                           stop_ns = 0;
+  size_t                             size;
+  int                                wake = 0;
+  int                                quiet = 0;
+  int                                opt;
+  int                                fd;
+  int                                n;
+
+  while ((opt = getopt(argc, argv, "o:t:w:qh?")) != -1)
+  {
+    switch (opt)
+    {
+    case 'o':
+      out_path = optarg;
+      break;
+    case 't':
+      stop_ns = (uint64_t) (strtod(optarg, NULL) * 1e9);
+      break;
+    case 'w':
+      wake = atoi(optarg);
+      break;
+    case 'q':
+      quiet = 1;
+      break;
+    default:
+      print_usage(argv[0]);
+      break;
+    }
+  }
+
+  if (optind != argc - 1)
+    print_usage(argv[0]);
+
+  if (strchr(argv[optind], '/'))
+    snprintf(dev, sizeof(dev), "%s", argv[optind]);
+  else
+    snprintf(dev, sizeof(dev), "/dev/triplecan-%s", argv[optind]);
+
+  fd = open(dev, O_RDWR);
+  if (fd < 0)
+  {
+    perror(dev);
+    exit(EXIT_FAILURE);
+  }
+
+  /* the header tells how much there is to map */
+  h = mmap(NULL, sizeof(*h), PROT_READ, MAP_SHARED, fd, 0);
+  if (h == MAP_FAILED)
+  {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  if (h->magic != TRIPLE_RXRING_MAGIC || h->version != TRIPLE_RXRING_VERSION ||
+      h->frame_size != sizeof(struct triple_rxring_frame) || !h->frames || (h->frames & (h->frames - 1)))
+  {
+    fprintf(stderr, "%s: not a Triple RX ring\n", dev);
+    exit(EXIT_FAILURE);
+  }
+  size = h->offset + (size_t) h->frames * h->frame_size;
+  munmap(h, sizeof(*h));
+
+  h = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (h == MAP_FAILED)
+  {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+
+  if (!out_path)
+  {
+    time_t     now = time(NULL);
+    struct tm  tm;
+
+    strftime(out, sizeof(out), "triple-%Y%m%d-%H%M%S.tcap", localtime_r(&now, &tm));
+    out_path = out;
+  }
+
+  w = tcap_writer_open(out_path, 0);
+  if (!w)
+  {
+    perror(out_path);
+    exit(EXIT_FAILURE);
+  }
+
+  /* no SA_RESTART: a signal has to end the poll */
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = sig_stop;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  h->wake  = wake > 0 ? (uint32_t) wake : h->frames / 4;
+  dropped0 = __atomic_load_n(&h->dropped, __ATOMIC_RELAXED);
+  rt_off   = clock_ns(CLOCK_REALTIME) - clock_ns(CLOCK_MONOTONIC);
+  if (stop_ns)
+    stop_ns += clock_ns(CLOCK_MONOTONIC);
+
+  pfd.fd     = fd;
+  pfd.events = POLLIN;
+
+  if (!quiet)
+    fprintf(stderr, "%s: recording %s into %s, Ctrl-C to stop\n", argv[0], dev, out_path);
+
+  while (running)
+  {
+    /* with a large wake threshold the timeout picks up the rest */
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 100) < 0 && errno != EINTR)
+    {
+      perror("poll");
+      break;
+    }
+
+    for (n = 0; (f = triple_rxring_peek(h, n)); n++)
+    {
+      rec = *f;
+      rec.tstamp_ns += rt_off;
+      if (tcap_write(w, &rec) < 0)
+      {
+        perror(out_path);
+        running = 0;
+        break;
+      }
+    }
+    triple_rxring_release(h, n);
+    frames += n;
+
+    if (pfd.revents & (POLLHUP | POLLERR))
+    {
+      if (!quiet)
+        fprintf(stderr, "%s: %s went away\n", argv[0], dev);
+      break;
+    }
+
+    if (stop_ns && clock_ns(CLOCK_MONOTONIC) >= stop_ns)
+      break;
+  }
+
+  tcap_writer_drops(w, __atomic_load_n(&h->dropped, __ATOMIC_RELAXED) - dropped0);
+  if (tcap_writer_close(w) < 0)
+  {
+    perror(out_path);
+    exit(EXIT_FAILURE);
+  }
+
+  if (!quiet)
+    fprintf(stderr, "%s: %llu frames, %llu dropped by the ring\n", argv[0], frames,
+            (unsigned long long) (__atomic_load_n(&h->dropped, __ATOMIC_RELAXED) - dropped0));
+
+  munmap(h, size);
+  close(fd);
+
+  return 0;
+}
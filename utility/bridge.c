@@ -0,0 +1,364 @@
+/*
+ * bridge.c - tripled userspace bridge, tty <-> CAN_RAW sockets
+ *
+ * One epoll loop: bytes read from the tty are decoded in place and handed
+ * to the sockets with one sendmmsg() per channel and batch; frames queued
+ * on the sockets are picked up with recvmmsg(), encoded back to back and
+ * written to the tty in one go. When the tty does not take the bytes fast
+ * enough the sockets are no longer polled, so the backlog stays in their
+ * receive queues instead of growing here.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "bridge.h"
+#include "triple_codec.h"
+
+#define  BRIDGE_TTY                 3     /* epoll data of the tty, sockets are 0 - 2 */
+#define  BRIDGE_RX_BUF              16384 /* bytes per tty read      */
+#define  BRIDGE_TX_BUF              (256 * TRIPLE_CODEC_MAX_FRAME)
+
+typedef struct
+{
+  int             tty;
+  int             ep;
+  int             sock[3];
+  bool            throttled;            /* sockets not polled, tty is behind */
+
+  TRIPLE_DECODER  dec;
+  unsigned char   rx[BRIDGE_RX_BUF];
+  TRIPLE_FRAME    frames[BRIDGE_BATCH];
+
+  unsigned char   tx[BRIDGE_TX_BUF];
+  int             tx_head;              /* first byte not yet written */
+  int             tx_tail;              /* end of the encoded bytes  */
+
+  BRIDGE_STATS   *st;
+} BRIDGE;
+
+int bridge_open_socket (const char *name)
+{
+  struct sockaddr_can  addr;
+  int                  on = 1;
+  int                  s;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.can_family  = AF_CAN;
+  addr.can_ifindex = if_nametoindex(name);
+  if (!addr.can_ifindex)
+  {
+    syslog(LOG_ERR, "bridge: no CAN interface %s", name);
+    return -1;
+  }
+
+  s = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
+  if (s < 0)
+  {
+    perror("bridge socket");
+    return -1;
+  }
+
+  /* CAN FD frames pass when the netdev has the MTU for them */
+  setsockopt(s, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &on, sizeof(on));
+
+  if (bind(s, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+  {
+    perror("bridge bind");
+    close(s);
+    return -1;
+  }
+
+  return s;
+}
+
+static void bridge_poll_sockets (BRIDGE *b, bool on)
+{
+  struct epoll_event ev;
+  int                channel;
+
+  if (b->throttled == !on)
+    return;
+
+  for (channel = 0; channel < 3; channel++)
+  {
+    if (b->sock[channel] < 0)
+      continue;
+
+    ev.events   = on ? EPOLLIN : 0;
+    ev.data.u32 = channel;
+    epoll_ctl(b->ep, EPOLL_CTL_MOD, b->sock[channel], &ev);
+  }
+
+  /* the tty is polled for writing exactly while the sockets are not */
+  ev.events   = on ? EPOLLIN : EPOLLIN | EPOLLOUT;
+  ev.data.u32 = BRIDGE_TTY;
+  epoll_ctl(b->ep, EPOLL_CTL_MOD, b->tty, &ev);
+
+  b->throttled = !on;
+}
+
+/* Decoded frames -> sockets, one sendmmsg per channel */
+static void bridge_to_can (BRIDGE *b, int n)
+{
+  struct mmsghdr  msgs[BRIDGE_BATCH];
+  struct iovec    iov[BRIDGE_BATCH];
+  int             channel;
+  int             count;
+  int             sent;
+  int             ret;
+  int             i;
+
+  for (channel = 0; channel < 3; channel++)
+  {
+    count = 0;
+    for (i = 0; i < n; i++)
+    {
+      if (b->frames[i].channel != channel)
+        continue;
+
+      iov[count].iov_base = &b->frames[i].cf;
+      iov[count].iov_len  = b->frames[i].fd ? CANFD_MTU : CAN_MTU;
+      memset(&msgs[count], 0, sizeof(msgs[count]));
+      msgs[count].msg_hdr.msg_iov    = &iov[count];
+      msgs[count].msg_hdr.msg_iovlen = 1;
+      count++;
+    }
+
+    if (!count)
+      continue;
+
+    if (b->sock[channel] < 0)
+    {
+      b->st->to_can_dropped += count;
+      continue;
+    }
+
+    /* A full netdev queue drops the rest, the tty side never waits */
+    for (sent = 0; sent < count; sent += ret)
+    {
+      b->st->syscalls++;
+      ret = sendmmsg(b->sock[channel], msgs + sent, count - sent, MSG_DONTWAIT);
+      if (ret <= 0)
+      {
+        b->st->to_can_dropped += count - sent;
+        break;
+      }
+      b->st->to_can += ret;
+    }
+  }
+}
+
+static int bridge_read_tty (BRIDGE *b)
+{
+  ssize_t  len;
+  int      off = 0;
+  int      used;
+  int      n;
+
+  b->st->syscalls++;
+  len = read(b->tty, b->rx, sizeof(b->rx));
+  if (len < 0)
+    return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+  if (len == 0)
+    return -1;
+
+  b->st->tty_bytes_in += len;
+
+  while (off < len)
+  {
+    n = triple_decode(&b->dec, b->rx + off, len - off, &used, b->frames, BRIDGE_BATCH);
+    off += used;
+    if (n)
+      bridge_to_can(b, n);
+  }
+
+  return 0;
+}
+
+static int bridge_write_tty (BRIDGE *b)
+{
+  ssize_t len;
+
+  while (b->tx_head < b->tx_tail)
+  {
+    b->st->syscalls++;
+    len = write(b->tty, b->tx + b->tx_head, b->tx_tail - b->tx_head);
+    if (len < 0)
+    {
+      if (errno == EAGAIN)
+        break;
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+
+    b->tx_head += len;
+    b->st->tty_bytes_out += len;
+  }
+
+  if (b->tx_head == b->tx_tail)
+    b->tx_head = b->tx_tail = 0;
+
+  /* room for another full batch, or poll the tty for writing meanwhile */
+  bridge_poll_sockets(b, sizeof(b->tx) - b->tx_tail >= BRIDGE_BATCH * TRIPLE_CODEC_MAX_FRAME);
+  return 0;
+}
+
+/* One batch of socket frames -> encoded bytes for the tty */
+static void bridge_from_can (BRIDGE *b, int channel)
+{
+  struct mmsghdr  msgs[BRIDGE_BATCH];
+  struct iovec    iov[BRIDGE_BATCH];
+  int             n;
+  int             i;
+
+  /* Move the unwritten rest down so a batch fits */
+  if (b->tx_head)
+  {
+    memmove(b->tx, b->tx + b->tx_head, b->tx_tail - b->tx_head);
+    b->tx_tail -= b->tx_head;
+    b->tx_head  = 0;
+  }
+
+  if (sizeof(b->tx) - b->tx_tail < BRIDGE_BATCH * TRIPLE_CODEC_MAX_FRAME)
+    return;
+
+  for (i = 0; i < BRIDGE_BATCH; i++)
+  {
+    iov[i].iov_base = &b->frames[i].cf;
+    iov[i].iov_len  = CANFD_MTU;
+    memset(&msgs[i], 0, sizeof(msgs[i]));
+    msgs[i].msg_hdr.msg_iov    = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  b->st->syscalls++;
+  n = recvmmsg(b->sock[channel], msgs, BRIDGE_BATCH, MSG_DONTWAIT, NULL);
+  if (n <= 0)
+    return;
+
+  for (i = 0; i < n; i++)
+  {
+    b->frames[i].channel = channel;
+    b->frames[i].fd      = msgs[i].msg_len == CANFD_MTU;
+    b->tx_tail += triple_encode(b->tx + b->tx_tail, &b->frames[i]);
+  }
+
+  b->st->to_tty += n;
+}
+
+int bridge_run (int tty, char *name[3], int *running, BRIDGE_STATS *stats)
+{
+  static BRIDGE       b;
+  struct epoll_event  ev;
+  struct epoll_event  events[4];
+  int                 channel;
+  int                 bridged = 0;
+  int                 n;
+  int                 i;
+  int                 err = 0;
+
+  memset(&b, 0, sizeof(b));
+  memset(stats, 0, sizeof(*stats));
+  b.sock[0] = b.sock[1] = b.sock[2] = -1;
+  b.tty = tty;
+  b.st  = stats;
+  triple_decoder_init(&b.dec);
+
+  b.ep = epoll_create1(EPOLL_CLOEXEC);
+  if (b.ep < 0)
+  {
+    perror("bridge epoll_create1");
+    return -1;
+  }
+
+  ev.events   = EPOLLIN;
+  ev.data.u32 = BRIDGE_TTY;
+  epoll_ctl(b.ep, EPOLL_CTL_ADD, tty, &ev);
+
+  for (channel = 0; channel < 3; channel++)
+  {
+    b.sock[channel] = name[channel] ? bridge_open_socket(name[channel]) : -1;
+    if (name[channel] && b.sock[channel] < 0)
+    {
+      err = -1;
+      goto out;
+    }
+
+    if (b.sock[channel] < 0)
+      continue;
+
+    ev.events   = EPOLLIN;
+    ev.data.u32 = channel;
+    epoll_ctl(b.ep, EPOLL_CTL_ADD, b.sock[channel], &ev);
+    syslog(LOG_INFO, "bridge: port %d <-> %s", channel + 1, name[channel]);
+    bridged++;
+  }
+
+  if (!bridged)
+  {
+    syslog(LOG_ERR, "bridge: no interface names given (-n)");
+    err = -1;
+    goto out;
+  }
+
+  while (*running)
+  {
+    stats->syscalls++;
+    n = epoll_wait(b.ep, events, 4, 1000);
+    if (n < 0 && errno != EINTR)
+    {
+      err = -1;
+      break;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+      if (events[i].data.u32 == BRIDGE_TTY)
+      {
+        if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && bridge_read_tty(&b) < 0)
+        {
+          syslog(LOG_ERR, "bridge: tty gone: %s", strerror(errno));
+          *running = 0;
+          err = -1;
+          break;
+        }
+      }
+      else
+        bridge_from_can(&b, events[i].data.u32);
+    }
+
+    if ((b.tx_tail > b.tx_head || b.throttled) && bridge_write_tty(&b) < 0)
+    {
+      syslog(LOG_ERR, "bridge: tty write: %s", strerror(errno));
+      err = -1;
+      break;
+    }
+  }
+
+out:
+  for (channel = 0; channel < 3; channel++)
+  {
+    if (b.sock[channel] >= 0)
+      close(b.sock[channel]);
+  }
+  close(b.ep);
+
+  return err;
+}
@@ -0,0 +1,703 @@
+/*
+ * bridge_uring.c - tripled userspace bridge on io_uring
+ *
+ * Same job as the epoll loop in bridge.c with far fewer syscalls:
+ *
+ *  - the tty is read by one multishot read into a ring of provided buffers,
+ *    decoded in place and the buffer handed straight back to the kernel
+ *  - every CAN socket has one multishot recv into a second buffer ring, one
+ *    CAN frame per buffer, so frames of a channel stay in order
+ *  - decoded frames go out as IORING_OP_SEND from a pool of send slots
+ *  - encoded frames fill one of two registered buffers while the other one
+ *    is written to the tty with IORING_OP_WRITE_FIXED
+ *
+ * All of it is submitted and reaped with one io_uring_enter() per loop.
+ * Frames that do not fit the tty buffers keep their recv buffer, and once
+ * the ring runs dry the kernel stops the multishot recv; it is rearmed
+ * when the tty caught up, so backpressure ends in the socket queues.
+ *
+ * Rings are set up with raw syscalls, no liburing needed. Kernels without
+ * provided buffer rings (< 5.19) make bridge_run_uring() return
+ * BRIDGE_NO_URING and tripled uses the epoll loop instead; kernels without
+ * multishot reads (< 6.7) or recvs (< 6.0) rearm single shot requests.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "bridge.h"
+
+#if defined(__has_include) && __has_include(<linux/io_uring.h>)
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+#include <linux/can.h>
+
+#include "triple_codec.h"
+
+#define  UR_ENTRIES                 256
+#define  UR_OP_READ_MULTISHOT       49    /* IORING_OP_READ_MULTISHOT, not in older headers */
+
+#define  UR_TTY_GROUP               0     /* provided buffers of the tty read */
+#define  UR_TTY_BUFS                16
+#define  UR_TTY_BUF_LEN             4096
+
+#define  UR_CAN_GROUP               1     /* provided buffers of the socket recvs */
+#define  UR_CAN_BUFS                256
+#define  UR_CAN_BUF_LEN             128   /* >= CANFD_MTU            */
+
+#define  UR_SEND_SLOTS              256
+#define  UR_TX_BUF                  (128 * TRIPLE_CODEC_MAX_FRAME)
+
+enum
+{
+  UR_TTY_READ = 1,
+  UR_TTY_WRITE,
+  UR_RECV,                              /* index: channel            */
+  UR_SEND,                              /* index: send slot          */
+  UR_TIMEOUT,
+};
+
+#define  UR_DATA(type, index)       (((__u64) (type) << 32) | (index))
+
+typedef struct
+{
+  struct canfd_frame  cf;
+  int                 channel;
+} UR_SEND_SLOT;
+
+/* provided buffer ring, buffer bid at base + bid * len */
+typedef struct
+{
+  struct io_uring_buf_ring  *ring;
+  size_t                     ring_sz;
+  unsigned char             *base;
+  unsigned int               n;
+  unsigned int               len;
+  __u16                      tail;
+} UR_BUFS;
+
+typedef struct
+{
+  int                   fd;
+  unsigned int          sq_entries;
+  unsigned int         *sq_head;
+  unsigned int         *sq_tail;
+  unsigned int         *sq_mask;
+  unsigned int         *sq_array;
+  unsigned int         *cq_head;
+  unsigned int         *cq_tail;
+  unsigned int         *cq_mask;
+  struct io_uring_sqe  *sqes;
+  struct io_uring_cqe  *cqes;
+  void                 *sq_ptr;
+  void                 *cq_ptr;
+  size_t                sq_sz;
+  size_t                cq_sz;
+  unsigned int          tail;           /* local SQ tail             */
+  unsigned int          to_submit;
+
+  int                   tty;
+  int                   sock[3];
+  bool                  read_mshot;     /* multishot read works      */
+  bool                  recv_mshot;     /* multishot recv works      */
+  bool                  tty_rearm;      /* read waits for buffers    */
+  bool                  recv_rearm[3];
+  bool                  fixed;          /* tx buffers registered     */
+  bool                  failed;
+
+  UR_BUFS               rx;             /* tty reads                 */
+  UR_BUFS               can;            /* socket recvs              */
+  __u16                 can_fifo[UR_CAN_BUFS]; /* received, waiting for tty room */
+  unsigned char         can_chan[UR_CAN_BUFS];
+  unsigned int          fifo_head;
+  unsigned int          fifo_tail;
+
+  TRIPLE_DECODER        dec;
+  TRIPLE_FRAME          frames[BRIDGE_BATCH];
+
+  UR_SEND_SLOT          send[UR_SEND_SLOTS];
+  int                   send_free[UR_SEND_SLOTS];
+  int                   n_send_free;
+
+  unsigned char         tx[2][UR_TX_BUF];
+  int                   tx_len[2];
+  int                   tx_fill;        /* buffer being encoded into */
+  int                   tx_off;         /* written of the other one  */
+  bool                  tx_busy;
+  bool                  tx_retry;       /* rest of a short write waits for an SQE */
+
+  struct __kernel_timespec ts;
+  BRIDGE_STATS         *st;
+} UR;
+
+static int ur_enter (UR *u, unsigned int wait)
+{
+  int ret;
+
+  __atomic_store_n(u->sq_tail, u->tail, __ATOMIC_RELEASE);
+
+  u->st->syscalls++;
+  ret = syscall(__NR_io_uring_enter, u->fd, u->to_submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+  if (ret < 0)
+    return errno == EINTR || errno == EAGAIN || errno == EBUSY ? 0 : -1;
+
+  u->to_submit -= ret;
+  return 0;
+}
+
+static struct io_uring_sqe *ur_sqe (UR *u)
+{
+  struct io_uring_sqe *sqe;
+  unsigned int         index;
+
+  if (u->tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries)
+  {
+    ur_enter(u, 0);
+    if (u->tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries)
+      return NULL;
+  }
+
+  index = u->tail & *u->sq_mask;
+  sqe   = &u->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  u->sq_array[index] = index;
+  u->tail++;
+  u->to_submit++;
+
+  return sqe;
+}
+
+static void ur_buf_put (UR_BUFS *b, unsigned int bid)
+{
+  struct io_uring_buf *buf = &b->ring->bufs[b->tail & (b->n - 1)];
+
+  buf->addr = (uintptr_t) (b->base + bid * b->len);
+  buf->len  = b->len;
+  buf->bid  = bid;
+  b->tail++;
+  __atomic_store_n(&b->ring->tail, b->tail, __ATOMIC_RELEASE);
+}
+
+static int ur_buf_setup (UR *u, UR_BUFS *b, int group, unsigned int n, unsigned int len)
+{
+  struct io_uring_buf_reg  reg;
+  unsigned int             i;
+
+  b->n       = n;
+  b->len     = len;
+  b->ring_sz = n * sizeof(struct io_uring_buf);
+  b->ring    = mmap(NULL, b->ring_sz, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  b->base    = mmap(NULL, n * len, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (b->ring == MAP_FAILED || b->base == MAP_FAILED)
+    return -1;
+
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr    = (uintptr_t) b->ring;
+  reg.ring_entries = n;
+  reg.bgid         = group;
+  if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    return -1;
+
+  for (i = 0; i < n; i++)
+    ur_buf_put(b, i);
+
+  return 0;
+}
+
+static int ur_setup (UR *u)
+{
+  struct io_uring_params  p;
+  struct iovec            iov[2];
+
+  memset(&p, 0, sizeof(p));
+  u->fd = syscall(__NR_io_uring_setup, UR_ENTRIES, &p);
+  if (u->fd < 0)
+    return -1;
+
+  u->sq_entries = p.sq_entries;
+  u->sq_sz      = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  u->cq_sz      = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    if (u->cq_sz > u->sq_sz)
+      u->sq_sz = u->cq_sz;
+    u->cq_sz = u->sq_sz;
+  }
+
+  u->sq_ptr = mmap(NULL, u->sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+  if (u->sq_ptr == MAP_FAILED)
+    return -1;
+
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    u->cq_ptr = u->sq_ptr;
+  else
+  {
+    u->cq_ptr = mmap(NULL, u->cq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+    if (u->cq_ptr == MAP_FAILED)
+      return -1;
+  }
+
+  u->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+  if (u->sqes == MAP_FAILED)
+    return -1;
+
+  u->sq_head  = (unsigned int *) ((char *) u->sq_ptr + p.sq_off.head);
+  u->sq_tail  = (unsigned int *) ((char *) u->sq_ptr + p.sq_off.tail);
+  u->sq_mask  = (unsigned int *) ((char *) u->sq_ptr + p.sq_off.ring_mask);
+  u->sq_array = (unsigned int *) ((char *) u->sq_ptr + p.sq_off.array);
+  u->cq_head  = (unsigned int *) ((char *) u->cq_ptr + p.cq_off.head);
+  u->cq_tail  = (unsigned int *) ((char *) u->cq_ptr + p.cq_off.tail);
+  u->cq_mask  = (unsigned int *) ((char *) u->cq_ptr + p.cq_off.ring_mask);
+  u->cqes     = (struct io_uring_cqe *) ((char *) u->cq_ptr + p.cq_off.cqes);
+  u->tail     = *u->sq_tail;
+
+  if (ur_buf_setup(u, &u->rx, UR_TTY_GROUP, UR_TTY_BUFS, UR_TTY_BUF_LEN) < 0 ||
+      ur_buf_setup(u, &u->can, UR_CAN_GROUP, UR_CAN_BUFS, UR_CAN_BUF_LEN) < 0)
+    return -1;
+
+  /* Fixed buffers need locked memory, plain writes do without */
+  iov[0].iov_base = u->tx[0];
+  iov[0].iov_len  = UR_TX_BUF;
+  iov[1].iov_base = u->tx[1];
+  iov[1].iov_len  = UR_TX_BUF;
+  u->fixed = syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_BUFFERS, iov, 2) == 0;
+
+  return 0;
+}
+
+static void ur_teardown (UR *u)
+{
+  if (u->fd >= 0)
+    close(u->fd);
+  if (u->sqes && u->sqes != MAP_FAILED)
+    munmap(u->sqes, u->sq_entries * sizeof(struct io_uring_sqe));
+  if (u->cq_ptr && u->cq_ptr != MAP_FAILED && u->cq_ptr != u->sq_ptr)
+    munmap(u->cq_ptr, u->cq_sz);
+  if (u->sq_ptr && u->sq_ptr != MAP_FAILED)
+    munmap(u->sq_ptr, u->sq_sz);
+  if (u->rx.ring && u->rx.ring != MAP_FAILED)
+    munmap(u->rx.ring, u->rx.ring_sz);
+  if (u->rx.base && u->rx.base != MAP_FAILED)
+    munmap(u->rx.base, u->rx.n * u->rx.len);
+  if (u->can.ring && u->can.ring != MAP_FAILED)
+    munmap(u->can.ring, u->can.ring_sz);
+  if (u->can.base && u->can.base != MAP_FAILED)
+    munmap(u->can.base, u->can.n * u->can.len);
+}
+
+static void ur_arm_read (UR *u)
+{
+  struct io_uring_sqe *sqe = ur_sqe(u);
+
+  if (!sqe)
+  {
+    u->tty_rearm = true;
+    return;
+  }
+
+  sqe->opcode    = u->read_mshot ? UR_OP_READ_MULTISHOT : IORING_OP_READ;
+  sqe->fd        = u->tty;
+  sqe->off       = (__u64) -1;
+  sqe->len       = u->read_mshot ? 0 : UR_TTY_BUF_LEN;
+  sqe->flags     = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = UR_TTY_GROUP;
+  sqe->user_data = UR_DATA(UR_TTY_READ, 0);
+  u->tty_rearm   = false;
+}
+
+static void ur_arm_recv (UR *u, int channel)
+{
+  struct io_uring_sqe *sqe = ur_sqe(u);
+
+  if (!sqe)
+  {
+    u->recv_rearm[channel] = true;
+    return;
+  }
+
+  sqe->opcode    = IORING_OP_RECV;
+  sqe->fd        = u->sock[channel];
+  sqe->ioprio    = u->recv_mshot ? IORING_RECV_MULTISHOT : 0;
+  sqe->len       = u->recv_mshot ? 0 : UR_CAN_BUF_LEN;
+  sqe->flags     = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = UR_CAN_GROUP;
+  sqe->user_data = UR_DATA(UR_RECV, channel);
+  u->recv_rearm[channel] = false;
+}
+
+static void ur_arm_timeout (UR *u)
+{
+  struct io_uring_sqe *sqe = ur_sqe(u);
+
+  if (!sqe)
+    return;
+
+  u->ts.tv_sec   = 1;
+  u->ts.tv_nsec  = 0;
+  sqe->opcode    = IORING_OP_TIMEOUT;
+  sqe->addr      = (uintptr_t) &u->ts;
+  sqe->len       = 1;
+  sqe->user_data = UR_DATA(UR_TIMEOUT, 0);
+}
+
+/* Decoded frames -> IORING_OP_SEND, one slot each */
+static void ur_to_can (UR *u, int n)
+{
+  struct io_uring_sqe *sqe;
+  UR_SEND_SLOT        *s;
+  int                  slot;
+  int                  i;
+
+  for (i = 0; i < n; i++)
+  {
+    if (u->sock[u->frames[i].channel] < 0 || !u->n_send_free)
+    {
+      u->st->to_can_dropped++;
+      continue;
+    }
+
+    sqe = ur_sqe(u);
+    if (!sqe)
+    {
+      u->st->to_can_dropped++;
+      continue;
+    }
+
+    slot       = u->send_free[--u->n_send_free];
+    s          = &u->send[slot];
+    s->cf      = u->frames[i].cf;
+    s->channel = u->frames[i].channel;
+
+    sqe->opcode    = IORING_OP_SEND;
+    sqe->fd        = u->sock[s->channel];
+    sqe->addr      = (uintptr_t) &s->cf;
+    sqe->len       = u->frames[i].fd ? CANFD_MTU : CAN_MTU;
+    sqe->msg_flags = MSG_DONTWAIT;
+    sqe->user_data = UR_DATA(UR_SEND, slot);
+  }
+}
+
+static void ur_tty_read_done (UR *u, struct io_uring_cqe *cqe)
+{
+  unsigned char *buf;
+  unsigned int   bid;
+  int            off = 0;
+  int            used;
+  int            n;
+
+  if (cqe->res == -EINVAL && u->read_mshot)
+  {
+    /* no multishot read in this kernel */
+    u->read_mshot = false;
+    ur_arm_read(u);
+    return;
+  }
+
+  if (cqe->res == -ENOBUFS)
+    u->tty_rearm = true;
+  else if (cqe->res <= 0)
+  {
+    syslog(LOG_ERR, "bridge: tty read: %s", cqe->res ? strerror(-cqe->res) : "end of file");
+    u->failed = true;
+    return;
+  }
+  else
+  {
+    bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    buf = u->rx.base + bid * u->rx.len;
+    u->st->tty_bytes_in += cqe->res;
+
+    while (off < cqe->res)
+    {
+      n = triple_decode(&u->dec, buf + off, cqe->res - off, &used, u->frames, BRIDGE_BATCH);
+      off += used;
+      ur_to_can(u, n);
+    }
+
+    ur_buf_put(&u->rx, bid);
+
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+      ur_arm_read(u);
+  }
+}
+
+/* Received socket frames -> tty buffer, oldest first, while there is room */
+static void ur_drain_can (UR *u)
+{
+  TRIPLE_FRAME  f;
+  unsigned int  bid;
+  int           len;
+  int           channel;
+
+  while (u->fifo_head != u->fifo_tail && UR_TX_BUF - u->tx_len[u->tx_fill] >= TRIPLE_CODEC_MAX_FRAME)
+  {
+    bid = u->can_fifo[u->fifo_head % UR_CAN_BUFS];
+    len = u->can_chan[bid] >> 7 ? CANFD_MTU : CAN_MTU;
+
+    memset(&f, 0, sizeof(f));
+    memcpy(&f.cf, u->can.base + bid * u->can.len, len);
+    f.channel = u->can_chan[bid] & 0x7F;
+    f.fd      = len == CANFD_MTU;
+
+    u->tx_len[u->tx_fill] += triple_encode(u->tx[u->tx_fill] + u->tx_len[u->tx_fill], &f);
+    u->st->to_tty++;
+
+    ur_buf_put(&u->can, bid);
+    u->fifo_head++;
+  }
+
+  /* multishot recvs stopped for lack of buffers run again */
+  for (channel = 0; channel < 3; channel++)
+  {
+    if (u->recv_rearm[channel] && u->fifo_head == u->fifo_tail)
+      ur_arm_recv(u, channel);
+  }
+}
+
+static void ur_recv_done (UR *u, struct io_uring_cqe *cqe, int channel)
+{
+  unsigned int bid;
+
+  if (cqe->res == -EINVAL && u->recv_mshot)
+  {
+    u->recv_mshot = false;
+    ur_arm_recv(u, channel);
+    return;
+  }
+
+  if (cqe->res == CAN_MTU || cqe->res == CANFD_MTU)
+  {
+    bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    u->can_chan[bid] = channel | (cqe->res == CANFD_MTU ? 0x80 : 0);
+    u->can_fifo[u->fifo_tail++ % UR_CAN_BUFS] = bid;
+  }
+  else if (cqe->flags & IORING_CQE_F_BUFFER)
+    ur_buf_put(&u->can, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+  else if (cqe->res < 0 && cqe->res != -ENOBUFS)
+  {
+    syslog(LOG_ERR, "bridge: port %d recv: %s", channel + 1, strerror(-cqe->res));
+    u->failed = true;
+    return;
+  }
+
+  if (!(cqe->flags & IORING_CQE_F_MORE))
+  {
+    /* out of buffers: wait until the tty took some frames */
+    if (cqe->res == -ENOBUFS)
+      u->recv_rearm[channel] = true;
+    else
+      ur_arm_recv(u, channel);
+  }
+}
+
+/* Write buffer busy from tx_off on, false if there is no free SQE */
+static bool ur_tty_write (UR *u, int busy)
+{
+  struct io_uring_sqe *sqe = ur_sqe(u);
+
+  if (!sqe)
+    return false;
+
+  sqe->opcode    = u->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+  sqe->fd        = u->tty;
+  sqe->off       = (__u64) -1;
+  sqe->addr      = (uintptr_t) (u->tx[busy] + u->tx_off);
+  sqe->len       = u->tx_len[busy] - u->tx_off;
+  sqe->buf_index = busy;
+  sqe->user_data = UR_DATA(UR_TTY_WRITE, busy);
+
+  return true;
+}
+
+static void ur_tty_flush (UR *u)
+{
+  if (u->tx_busy)
+  {
+    if (u->tx_retry)
+      u->tx_retry = !ur_tty_write(u, !u->tx_fill);
+    return;
+  }
+
+  if (!u->tx_len[u->tx_fill])
+    return;
+
+  u->tx_off = 0;
+  if (!ur_tty_write(u, u->tx_fill))
+    return;
+
+  u->tx_fill = !u->tx_fill;
+  u->tx_busy = true;
+}
+
+static void ur_tty_write_done (UR *u, struct io_uring_cqe *cqe, int busy)
+{
+  if (cqe->res < 0 && cqe->res != -EAGAIN && cqe->res != -EINTR)
+  {
+    syslog(LOG_ERR, "bridge: tty write: %s", strerror(-cqe->res));
+    u->failed = true;
+    return;
+  }
+
+  if (cqe->res > 0)
+  {
+    u->tx_off += cqe->res;
+    u->st->tty_bytes_out += cqe->res;
+  }
+
+  /* The rest of a short write goes first, ur_tty_flush() retries without an SQE */
+  if (u->tx_off < u->tx_len[busy])
+  {
+    u->tx_retry = !ur_tty_write(u, busy);
+    return;
+  }
+
+  u->tx_len[busy] = 0;
+  u->tx_busy      = false;
+}
+
+static void ur_reap (UR *u)
+{
+  struct io_uring_cqe *cqe;
+  unsigned int         head = *u->cq_head;
+  unsigned int         tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+  unsigned int         index;
+
+  for (; head != tail; head++)
+  {
+    cqe   = &u->cqes[head & *u->cq_mask];
+    index = (unsigned int) cqe->user_data;
+
+    switch (cqe->user_data >> 32)
+    {
+    case UR_TTY_READ:
+      ur_tty_read_done(u, cqe);
+      break;
+    case UR_TTY_WRITE:
+      ur_tty_write_done(u, cqe, index);
+      break;
+    case UR_RECV:
+      ur_recv_done(u, cqe, index);
+      break;
+    case UR_SEND:
+      if (cqe->res < 0)
+        u->st->to_can_dropped++;
+      else
+        u->st->to_can++;
+      u->send_free[u->n_send_free++] = index;
+      break;
+    case UR_TIMEOUT:
+      ur_arm_timeout(u);
+      break;
+    }
+  }
+
+  __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+}
+
+int bridge_run_uring (int tty, char *name[3], int *running, BRIDGE_STATS *stats)
+{
+  static UR  u;
+  int        channel;
+  int        bridged = 0;
+  int        err = 0;
+  int        i;
+
+  memset(&u, 0, sizeof(u));
+  memset(stats, 0, sizeof(*stats));
+  u.fd         = -1;
+  u.tty        = tty;
+  u.st         = stats;
+  u.read_mshot = true;
+  u.recv_mshot = true;
+  u.sock[0] = u.sock[1] = u.sock[2] = -1;
+  triple_decoder_init(&u.dec);
+
+  for (i = 0; i < UR_SEND_SLOTS; i++)
+    u.send_free[u.n_send_free++] = i;
+
+  if (ur_setup(&u) < 0)
+  {
+    syslog(LOG_NOTICE, "bridge: io_uring not usable (%s), using epoll", strerror(errno));
+    ur_teardown(&u);
+    return BRIDGE_NO_URING;
+  }
+
+  for (channel = 0; channel < 3; channel++)
+  {
+    if (!name[channel])
+      continue;
+
+    u.sock[channel] = bridge_open_socket(name[channel]);
+    if (u.sock[channel] < 0)
+    {
+      err = -1;
+      goto out;
+    }
+
+    syslog(LOG_INFO, "bridge: port %d <-> %s (io_uring)", channel + 1, name[channel]);
+    ur_arm_recv(&u, channel);
+    bridged++;
+  }
+
+  if (!bridged)
+  {
+    syslog(LOG_ERR, "bridge: no interface names given (-n)");
+    err = -1;
+    goto out;
+  }
+
+  ur_arm_read(&u);
+  ur_arm_timeout(&u);
+
+  while (*running && !u.failed)
+  {
+    if (ur_enter(&u, 1) < 0)
+    {
+      syslog(LOG_ERR, "bridge: io_uring_enter: %s", strerror(errno));
+      err = -1;
+      break;
+    }
+
+    ur_reap(&u);
+    ur_drain_can(&u);
+    ur_tty_flush(&u);
+
+    if (u.tty_rearm)
+      ur_arm_read(&u);
+  }
+
+  if (u.failed)
+    err = -1;
+
+out:
+  for (channel = 0; channel < 3; channel++)
+  {
+    if (u.sock[channel] >= 0)
+      close(u.sock[channel]);
+  }
+  ur_teardown(&u);
+
+  return err;
+}
+
+#else
+
+int bridge_run_uring (int tty, char *name[3], int *running, BRIDGE_STATS *stats)
+{
+  return BRIDGE_NO_URING;
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef __BRIDGE_H__
+#define __BRIDGE_H__
+
+/*
+ * Userspace tty <-> SocketCAN bridge, used instead of the line discipline
+ * when tripled runs with -b. Channel n is bridged to the CAN netdev name[n]
+ * (e.g. vcan0), channels without a name are not bridged.
+ */
+
+#define  BRIDGE_BATCH               64    /* frames per recvmmsg / sendmmsg */
+/* tripled -b[uring/epoll] */
+#define  BRIDGE_OFF                 0
+#define  BRIDGE_AUTO                1     /* io_uring, epoll when the kernel lacks it */
+#define  BRIDGE_EPOLL               2
+#define  BRIDGE_URING               3
+
+#define  BRIDGE_NO_URING            -2    /* bridge_run_uring(): kernel can't, use bridge_run() */
+
+typedef struct
+{
+  unsigned long long  to_can;           /* frames tty -> netdev      */
+  unsigned long long  to_tty;           /* frames netdev -> tty      */
+  unsigned long long  to_can_dropped;   /* netdev refused them       */
+  unsigned long long  tty_bytes_in;
+  unsigned long long  tty_bytes_out;
+  unsigned long long  syscalls;         /* read/write/recvmmsg/sendmmsg/epoll_wait/io_uring_enter */
+} BRIDGE_STATS;
+
+int bridge_open_socket (const char *name);
+int bridge_run         (int tty, char *name[3], int *running, BRIDGE_STATS *stats);
+int bridge_run_uring   (int tty, char *name[3], int *running, BRIDGE_STATS *stats);
+
+#endif //__BRIDGE_H__
@@ -0,0 +1,48 @@
+#ifndef __LDISC_CFG_H__
+#define __LDISC_CFG_H__
+
+#include <stdbool.h>
+
+#include "triple_ioctl.h"
+
+#define  LDISC_MAX_PERIODIC   64
+
+/*
+ * Runtime configuration of the triplecan line discipline, collected from
+ * the command line and pushed to the driver once TIOCSETD succeeded.
+ */
+typedef struct
+{
+  bool                      filter_set[3];
+  struct triple_filter_cfg  filter[3];
+  struct triple_id_range    eff[3][TRIPLE_FILTER_MAX_EFF];
+
+  bool                      change_set[3];
+  struct triple_change_cfg  change[3];
+  struct triple_change_id  *change_ids[3];
+
+  struct triple_gw_cfg      gw;
+  struct triple_gw_route    routes[TRIPLE_GW_MAX_ROUTES];
+
+  bool                      txq_set[3];
+  struct triple_txq_cfg     txq[3];
+
+  int                        n_periodic;
+  struct triple_periodic_cmd periodic[LDISC_MAX_PERIODIC];
+
+  struct triple_bitrate_cfg  bitrate[3]; /* nominal_bps 0 -> not sent */
+
+  struct triple_idstats_cfg  idstats[3]; /* enable 0 -> not sent      */
+} LDISC_CFG;
+
+void ldisc_cfg_init   (LDISC_CFG *cfg);
+int  ldisc_parse_filter(LDISC_CFG *cfg, char *arg);
+int  ldisc_parse_change(LDISC_CFG *cfg, char *arg);
+int  ldisc_parse_route (LDISC_CFG *cfg, char *arg);
+int  ldisc_parse_periodic(LDISC_CFG *cfg, char *arg);
+int  ldisc_parse_txq   (LDISC_CFG *cfg, char *arg);
+int  ldisc_parse_idstats(LDISC_CFG *cfg, char *arg);
+void ldisc_set_bitrate (LDISC_CFG *cfg, int channel, unsigned int nominal_bps, unsigned int data_bps, bool exact);
+void ldisc_cfg_apply  (LDISC_CFG *cfg, int fd);
+
+#endif //__LDISC_CFG_H__
@@ -0,0 +1,38 @@
+#ifndef __MCP2517FD_H__
+#define __MCP2517FD_H__
+
+/*
+ * Bit timing of the MCP2517FD on port 3. bt[] holds the values of
+ * tripled -c in enum USER_BITTIMING_PAR order: BRP, TSEG1, TSEG2 and SJW
+ * are register values (time quanta minus one), TDCO and TDCV are SYSCLK
+ * cycles, TDCMOD is enum TDC_MOD.
+ */
+
+#include <stdio.h>
+
+#include "tripled_helper.h"
+
+#define  MCP2517FD_SYSCLK           40000000
+#define  MCP2517FD_BT_LEN           (TDCMOD + 1)
+#define  MCP2517FD_MAX_ERR          0.005     /* bit rate, relative      */
+
+/* bit/s of BRP, TSEG1 and TSEG2 register values */
+unsigned int mcp2517fd_bps (unsigned int brp, unsigned int tseg1, unsigned int tseg2);
+
+/*
+ * Best register values for nominal and data bit rate and sample point
+ * (per mille, 0 -> 87.5 % below 1 Mbit/s, else 75 %). Transmitter delay
+ * compensation is automatic above 1 Mbit/s. 0, or -1 with *why set.
+ */
+int mcp2517fd_calc (unsigned int bt[MCP2517FD_BT_LEN], unsigned int nominal_bps, unsigned int nominal_sp,
+                    unsigned int data_bps, unsigned int data_sp, const char **why);
+
+/* tripled -r: <nominal>[@<sp %>][:<data>[@<sp %>]], rates in bit/s with k or M */
+int mcp2517fd_parse (unsigned int bt[MCP2517FD_BT_LEN], char *arg, const char **why);
+
+/* NULL when the values fit the registers and each other, else what is wrong */
+const char *mcp2517fd_check (const unsigned int bt[MCP2517FD_BT_LEN]);
+
+void mcp2517fd_print (FILE *f, const unsigned int bt[MCP2517FD_BT_LEN]);
+
+#endif //__MCP2517FD_H__
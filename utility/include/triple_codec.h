@@ -0,0 +1,43 @@
+#ifndef __TRIPLE_CODEC_H__
+#define __TRIPLE_CODEC_H__
+
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <linux/can.h>
+
+#include "tripled_helper.h"
+
+/* longest encoded CAN FD frame: every byte after the length escaped */
+#define  TRIPLE_CODEC_MAX_FRAME     (2 + 2 * (1 + ID_LEN + 2 + DATA_FD_LEN) + 1)
+
+/* one frame from or to the adapter, same as in libtriple.h */
+#ifndef __TRIPLE_FRAME_T__
+#define __TRIPLE_FRAME_T__
+typedef struct
+{
+  int                 channel;          /* 0 - 2                     */
+  bool                fd;               /* frame is a CAN FD frame   */
+  struct canfd_frame  cf;               /* struct can_frame layout when !fd */
+} TRIPLE_FRAME;
+#endif
+
+/* adapter -> host byte stream state, survives between reads */
+typedef struct
+{
+  unsigned char  buf[TRIPLE_MTU];       /* unescaped frame so far    */
+  int            count;
+  bool           esc;                   /* last byte was U2C_TR_SPEC_BYTE */
+  bool           len;                   /* next byte is the length, never escaped */
+  bool           skip;                  /* frame overflowed, wait for the end */
+
+  unsigned long  frames;                /* CAN frames decoded        */
+  unsigned long  other;                 /* status, version, marker answers */
+  unsigned long  errors;                /* overlong or malformed frames */
+} TRIPLE_DECODER;
+
+void triple_decoder_init (TRIPLE_DECODER *d);
+int  triple_decode       (TRIPLE_DECODER *d, const unsigned char *in, int n, int *used, TRIPLE_FRAME *out, int max);
+int  triple_encode       (unsigned char *p, const TRIPLE_FRAME *f);
+
+#endif //__TRIPLE_CODEC_H__
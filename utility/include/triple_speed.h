@@ -0,0 +1,20 @@
+#ifndef __TRIPLE_SPEED_H__
+#define __TRIPLE_SPEED_H__
+
+/*
+ * Port speeds: the codes tripled -s takes, the enum CAN_SPEED and
+ * CAN_FD_SPEED values sent to the adapter and the bit rates behind them.
+ * Shared by tripled and the offline tools, so both time frames alike.
+ */
+
+#include "tripled_helper.h"
+
+/* tripled -s code -> enum CAN_SPEED (port 1, 2) / enum CAN_FD_SPEED (port 3) */
+int look_up_can_speed    (int speed);
+int look_up_can_fd_speed (int speed);
+
+/* bit/s of an enum CAN_SPEED / CAN_FD_SPEED value */
+unsigned int can_speed_bps    (int speed);
+void         can_fd_speed_bps (int speed, unsigned int *nominal, unsigned int *data);
+
+#endif //__TRIPLE_SPEED_H__
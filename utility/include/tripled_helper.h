@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <unistd.h>
 
 #define  TRIPLE_MTU                 128 //40
 #define  TRIPLE_MAGIC               0x739A//0x729B
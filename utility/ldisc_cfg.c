@@ -0,0 +1,462 @@
+/*
+ * ldisc_cfg.c - tripled side of the triplecan private ioctls
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <linux/can.h>
+
+#include "ldisc_cfg.h"
+
+void ldisc_cfg_init (LDISC_CFG *cfg)
+{
+  int channel;
+
+  memset(cfg, 0, sizeof(*cfg));
+
+  for (channel = 0; channel < 3; channel++)
+  {
+    cfg->filter[channel].channel = channel;
+    cfg->filter[channel].eff     = (uintptr_t) cfg->eff[channel];
+    cfg->txq[channel].channel    = channel;
+    cfg->bitrate[channel].channel = channel;
+    cfg->idstats[channel].channel = channel;
+  }
+
+  cfg->gw.routes = (uintptr_t) cfg->routes;
+}
+
+static void parse_hex_bytes (const char *hex, unsigned char *out, int n)
+{
+  char byte[3] = { 0 };
+  int  i;
+
+  for (i = 0; i < n && hex[0] && hex[1]; i++, hex += 2)
+  {
+    byte[0] = hex[0];
+    byte[1] = hex[1];
+    out[i] = strtoul(byte, NULL, 16);
+  }
+}
+
+static canid_t parse_can_id (const char *id)
+{
+  canid_t can_id = strtoul(id, NULL, 16);
+
+  if (strlen(id) > 3)
+    can_id |= CAN_EFF_FLAG;
+
+  return can_id;
+}
+
+/*
+ * -i<port>:<id list>
+ *   id list: comma separated hex ids or ranges (100-1FF). Ids written with
+ *   more than three digits are extended ids, like in candump (0000007DF).
+ */
+int ldisc_parse_filter (LDISC_CFG *cfg, char *arg)
+{
+  char                      *port;
+  char                      *item;
+  char                      *dash;
+  char                      *save;
+  unsigned long              from;
+  unsigned long              to;
+  bool                       eff;
+  int                        channel;
+  struct triple_filter_cfg  *f;
+
+  port = strtok_r(arg, ":", &save);
+  if (port == NULL)
+    return -1;
+
+  channel = atoi(port) - 1;
+  if (channel < 0 || channel > 2)
+    return -1;
+
+  f = &cfg->filter[channel];
+  f->enable = 1;
+  cfg->filter_set[channel] = true;
+
+  while ((item = strtok_r(NULL, ",", &save)) != NULL)
+  {
+    dash = strchr(item, '-');
+    if (dash)
+      *dash++ = '\0';
+
+    eff  = strlen(item) > 3 || (dash && strlen(dash) > 3);
+    from = strtoul(item, NULL, 16);
+    to   = dash ? strtoul(dash, NULL, 16) : from;
+
+    if (to < from)
+      return -1;
+
+    if (!eff)
+    {
+      if (to > CAN_SFF_MASK)
+        return -1;
+
+      for (; from <= to; from++)
+        f->sff[from >> 5] |= 1U << (from & 31);
+      continue;
+    }
+
+    if (to > CAN_EFF_MASK || f->n_eff >= TRIPLE_FILTER_MAX_EFF)
+      return -1;
+
+    cfg->eff[channel][f->n_eff].from = from;
+    cfg->eff[channel][f->n_eff].to   = to;
+    f->n_eff++;
+  }
+
+  return 0;
+}
+
+/*
+ * -o<port>:<timeout ms>:<id list>
+ *   id list: comma separated hex ids, each optionally followed by a
+ *   payload mask in hex bytes (7DF/FF00FF); without mask all bits count.
+ */
+int ldisc_parse_change (LDISC_CFG *cfg, char *arg)
+{
+  char                      *port;
+  char                      *timeout;
+  char                      *item;
+  char                      *slash;
+  char                      *save;
+  int                        channel;
+  struct triple_change_cfg  *c;
+  struct triple_change_id   *id;
+
+  port    = strtok_r(arg, ":", &save);
+  timeout = strtok_r(NULL, ":", &save);
+  if (port == NULL || timeout == NULL)
+    return -1;
+
+  channel = atoi(port) - 1;
+  if (channel < 0 || channel > 2)
+    return -1;
+
+  if (cfg->change_ids[channel] == NULL)
+  {
+    cfg->change_ids[channel] = calloc(TRIPLE_CHANGE_MAX_IDS, sizeof(struct triple_change_id));
+    if (cfg->change_ids[channel] == NULL)
+      return -1;
+  }
+
+  c = &cfg->change[channel];
+  c->channel    = channel;
+  c->timeout_ms = strtoul(timeout, NULL, 10);
+  c->ids        = (uintptr_t) cfg->change_ids[channel];
+  cfg->change_set[channel] = true;
+
+  while ((item = strtok_r(NULL, ",", &save)) != NULL)
+  {
+    if (c->n_ids >= TRIPLE_CHANGE_MAX_IDS)
+      return -1;
+
+    id = &cfg->change_ids[channel][c->n_ids++];
+
+    slash = strchr(item, '/');
+    if (slash)
+      *slash++ = '\0';
+
+    id->can_id = parse_can_id(item);
+
+    memset(id->mask, 0xFF, sizeof(id->mask));
+    if (!slash)
+      continue;
+
+    memset(id->mask, 0, sizeof(id->mask));
+    parse_hex_bytes(slash, id->mask, sizeof(id->mask));
+  }
+
+  return 0;
+}
+
+/*
+ * -g<src>:<dst>:<id>[/<mask>][=<new id>][:<and mask>]
+ *   ports are 1 - 3, ids in hex as for -i, '*' matches every frame.
+ *   The optional payload mask is ANDed to the forwarded data (hex bytes).
+ */
+int ldisc_parse_route (LDISC_CFG *cfg, char *arg)
+{
+  char                    *src;
+  char                    *dst;
+  char                    *spec;
+  char                    *and_mask;
+  char                    *slash;
+  char                    *equal;
+  char                    *save;
+  struct triple_gw_route  *r;
+
+  src      = strtok_r(arg, ":", &save);
+  dst      = strtok_r(NULL, ":", &save);
+  spec     = strtok_r(NULL, ":", &save);
+  and_mask = strtok_r(NULL, ":", &save);
+  if (src == NULL || dst == NULL || spec == NULL || cfg->gw.n_routes >= TRIPLE_GW_MAX_ROUTES)
+    return -1;
+
+  r = &cfg->routes[cfg->gw.n_routes];
+  memset(r, 0, sizeof(*r));
+
+  r->src = atoi(src) - 1;
+  r->dst = atoi(dst) - 1;
+  if (r->src > 2 || r->dst > 2 || r->src == r->dst)
+    return -1;
+
+  equal = strchr(spec, '=');
+  if (equal)
+  {
+    *equal++ = '\0';
+    r->flags |= TRIPLE_GW_REWRITE_ID;
+    r->new_id = parse_can_id(equal);
+  }
+
+  slash = strchr(spec, '/');
+  if (slash)
+    *slash++ = '\0';
+
+  if (strcmp(spec, "*") != 0)
+  {
+    r->can_id = parse_can_id(spec);
+    if (slash)
+      r->mask = CAN_EFF_FLAG | strtoul(slash, NULL, 16);
+    else
+      r->mask = CAN_EFF_FLAG | ((r->can_id & CAN_EFF_FLAG) ? CAN_EFF_MASK : CAN_SFF_MASK);
+  }
+
+  if (and_mask)
+  {
+    r->flags |= TRIPLE_GW_MOD_DATA;
+    memset(r->and_mask, 0xFF, sizeof(r->and_mask));
+    parse_hex_bytes(and_mask, r->and_mask, sizeof(r->and_mask));
+  }
+
+  cfg->gw.n_routes++;
+  return 0;
+}
+
+/*
+ * -p<port>:<period us>:<id>#<data>     classic frame
+ * -p3:<period us>:<id>##<flags><data>  CAN FD frame (port 3 in FD mode)
+ */
+int ldisc_parse_periodic (LDISC_CFG *cfg, char *arg)
+{
+  char                        *port;
+  char                        *period;
+  char                        *frame;
+  char                        *data;
+  char                        *save;
+  char                         flags[2] = { 0 };
+  struct triple_periodic_cmd  *cmd;
+
+  port   = strtok_r(arg, ":", &save);
+  period = strtok_r(NULL, ":", &save);
+  frame  = strtok_r(NULL, ":", &save);
+  if (port == NULL || period == NULL || frame == NULL || cfg->n_periodic >= LDISC_MAX_PERIODIC)
+    return -1;
+
+  data = strchr(frame, '#');
+  if (data == NULL)
+    return -1;
+  *data++ = '\0';
+
+  cmd = &cfg->periodic[cfg->n_periodic];
+  memset(cmd, 0, sizeof(*cmd));
+
+  cmd->op        = TRIPLE_PERIODIC_ADD;
+  cmd->channel   = atoi(port) - 1;
+  cmd->period_us = strtoul(period, NULL, 10);
+  if (cmd->channel > 2 || cmd->period_us == 0)
+    return -1;
+
+  if (*data == '#')
+  {
+    data++;
+    cmd->fd = 1;
+    if (*data == '\0')
+      return -1;
+    flags[0] = *data++;
+    cmd->frame.flags = strtoul(flags, NULL, 16) & (CANFD_BRS | CANFD_ESI);
+  }
+
+  cmd->frame.can_id = parse_can_id(frame);
+  cmd->frame.len    = strlen(data) / 2;
+  if (cmd->frame.len > (cmd->fd ? CANFD_MAX_DLEN : CAN_MAX_DLEN))
+    return -1;
+  parse_hex_bytes(data, cmd->frame.data, cmd->frame.len);
+
+  cfg->n_periodic++;
+  return 0;
+}
+
+/*
+ * -q<port>:<fifo|id>[:<max age us>]
+ *   id: frames queued in the driver leave in bus arbitration order
+ *   max age: frames still queued after it are dropped instead of sent
+ */
+int ldisc_parse_txq (LDISC_CFG *cfg, char *arg)
+{
+  char                   *port;
+  char                   *order;
+  char                   *age;
+  char                   *save;
+  struct triple_txq_cfg  *txq;
+  int                     channel;
+
+  port  = strtok_r(arg, ":", &save);
+  order = strtok_r(NULL, ":", &save);
+  age   = strtok_r(NULL, ":", &save);
+  if (port == NULL || order == NULL)
+    return -1;
+
+  channel = atoi(port) - 1;
+  if (channel < 0 || channel > 2)
+    return -1;
+
+  txq = &cfg->txq[channel];
+  if (strcmp(order, "id") == 0)
+    txq->order = TRIPLE_TXQ_ID;
+  else if (strcmp(order, "fifo") == 0)
+    txq->order = TRIPLE_TXQ_FIFO;
+  else
+    return -1;
+
+  if (age)
+    txq->max_age_us = strtoul(age, NULL, 10);
+
+  cfg->txq_set[channel] = true;
+  return 0;
+}
+
+/*
+ * -m <port>[:<eff slots>]
+ *   per CAN id statistics in the driver, EFF table size a power of two
+ */
+int ldisc_parse_idstats (LDISC_CFG *cfg, char *arg)
+{
+  char          *port;
+  char          *slots;
+  char          *save;
+  int            channel;
+  unsigned long  n = 0;
+
+  port  = strtok_r(arg, ":", &save);
+  slots = strtok_r(NULL, ":", &save);
+  if (port == NULL)
+    return -1;
+
+  channel = atoi(port) - 1;
+  if (channel < 0 || channel > 2)
+    return -1;
+
+  /* 0 -> driver default, otherwise what the driver takes */
+  if (slots)
+  {
+    n = strtoul(slots, NULL, 10);
+    if (n && (n < TRIPLE_IDSTATS_EFF_MIN || n > TRIPLE_IDSTATS_EFF_MAX || (n & (n - 1))))
+      return -1;
+  }
+
+  cfg->idstats[channel].enable    = 1;
+  cfg->idstats[channel].eff_slots = n;
+  return 0;
+}
+
+/* Bitrates the adapter was set to, the driver derives frame wire time and bus load from them */
+void ldisc_set_bitrate (LDISC_CFG *cfg, int channel, unsigned int nominal_bps, unsigned int data_bps, bool exact)
+{
+  cfg->bitrate[channel].nominal_bps = nominal_bps;
+  cfg->bitrate[channel].data_bps    = data_bps;
+  cfg->bitrate[channel].exact       = exact;
+}
+
+void ldisc_cfg_apply (LDISC_CFG *cfg, int fd)
+{
+  int channel;
+  int i;
+
+  for (channel = 0; channel < 3; channel++)
+  {
+    if (!cfg->filter_set[channel])
+      continue;
+
+    if (ioctl(fd, TRIPLE_IOCSFILTER, &cfg->filter[channel]) < 0)
+    {
+      perror("ioctl TRIPLE_IOCSFILTER");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for (channel = 0; channel < 3; channel++)
+  {
+    if (!cfg->change_set[channel])
+      continue;
+
+    if (ioctl(fd, TRIPLE_IOCSCHANGE, &cfg->change[channel]) < 0)
+    {
+      perror("ioctl TRIPLE_IOCSCHANGE");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for (channel = 0; channel < 3; channel++)
+  {
+    if (!cfg->txq_set[channel])
+      continue;
+
+    if (ioctl(fd, TRIPLE_IOCSTXQ, &cfg->txq[channel]) < 0)
+    {
+      perror("ioctl TRIPLE_IOCSTXQ");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for (channel = 0; channel < 3; channel++)
+  {
+    if (!cfg->bitrate[channel].nominal_bps)
+      continue;
+
+    if (ioctl(fd, TRIPLE_IOCSBITRATE, &cfg->bitrate[channel]) < 0)
+    {
+      perror("ioctl TRIPLE_IOCSBITRATE");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for (channel = 0; channel < 3; channel++)
+  {
+    if (!cfg->idstats[channel].enable)
+      continue;
+
+    if (ioctl(fd, TRIPLE_IOCSIDSTATS, &cfg->idstats[channel]) < 0)
+    {
+      perror("ioctl TRIPLE_IOCSIDSTATS");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (cfg->gw.n_routes && ioctl(fd, TRIPLE_IOCSGATEWAY, &cfg->gw) < 0)
+  {
+    perror("ioctl TRIPLE_IOCSGATEWAY");
+    exit(EXIT_FAILURE);
+  }
+
+  for (i = 0; i < cfg->n_periodic; i++)
+  {
+    if (ioctl(fd, TRIPLE_IOCPERIODIC, &cfg->periodic[i]) < 0)
+    {
+      perror("ioctl TRIPLE_IOCPERIODIC");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
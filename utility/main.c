@@ -31,12 +31,18 @@
 #include <sys/ioctl.h>
 #include <net/if.h>
 #include <termios.h>
+#include <time.h>
 #include <linux/tty.h>
 #include <linux/sockios.h>
 #include <linux/version.h>
 
 #include "version.h"
 #include "tripled_helper.h"
+#include "triple_ioctl.h"
+#include "ldisc_cfg.h"
+#include "triple_speed.h"
+#include "mcp2517fd.h"
+#include "bridge.h"
 /*
  * Before 3.1.0, the ldisc number is private define
  * in kernel, userspace application cannot use it.
@@ -56,9 +62,8 @@ static char ttypath [TTYPATH_LENGTH];
 static void print_version (char *prg);
 static void print_usage (char *prg);
 static void child_handler (int signum);
-static int look_up_can_speed (int speed);
-static int look_up_can_fd_speed (int speed);
 static void run_interactive ();
+
 static void print_bittiming();
 static void parse_bittiming();
 static void print_speed();
@@ -88,29 +93,52 @@ int main (int argc, char *argv[])
   int             speed[3];
   char           *name[3];
   bool listen_only[3];
-  unsigned int user_speed[10];
+  unsigned int user_speed[MCP2517FD_BT_LEN];
   bool can_fd = false;
   bool iso_crc = false;
   bool esi = false;
   bool user_bittiming = false;
+  const char *why;
+  bool set_worker = false;
+  bool exact_stuffing = false;
+  bool ldisc_opts = false;
+  int bridge = BRIDGE_OFF;
+  int ret;
+  BRIDGE_STATS bridge_stats;
+  struct timespec t_start;
+  struct timespec t_end;
+  double elapsed;
+  unsigned int nominal_bps;
+  unsigned int data_bps;
+  struct triple_worker_cfg worker;
+  static LDISC_CFG ldisc_cfg;
 
   name[PORT_1] = NULL;
   name[PORT_2] = NULL;
   name[PORT_3] = NULL;
 
+  /* what look_up_can_speed() / look_up_can_fd_speed() fall back to */
+  speed[PORT_1] = SPEED_250k;
+  speed[PORT_2] = SPEED_250k;
+  speed[PORT_3] = CAN_250K_1M;
+
   ttypath[0] = '\0';
   const char delim[] = ":";
   int i = 0;
 
-  char *tmp[3];
+  /* up to the 11 values of -c and the NULL after them */
+  char *tmp[MCP2517FD_BT_LEN + 1];
 
-  while ((opt = getopt(argc, argv, "s:n:l:duvtwh?f:c:")) != -1)
+  memset(&worker, 0, sizeof(worker));
+  ldisc_cfg_init(&ldisc_cfg);
+
+  while ((opt = getopt(argc, argv, "s:n:l:db::uvtwxh?f:c:r:a:i:o:g:p:q:m:")) != -1)
   {
     switch (opt)
     {
     case 's'://set speed
       tmp[i] = strtok(optarg, ":");
-      while (tmp[i] != NULL)
+      while (tmp[i] != NULL && i < MCP2517FD_BT_LEN)
       {
         tmp[++i] = strtok(NULL, ":");
       }
@@ -120,14 +148,14 @@ int main (int argc, char *argv[])
       break;
     case 'n'://set names
       name[i] = strtok(optarg, ":");
-      while (name[i] != NULL)
+      while (name[i] != NULL && i < PORT_3)
       {
         name[++i] = strtok(NULL, ":");
       }
       break;
     case 'l'://set listen-only
       tmp[i] = strtok(optarg, ":");
-      while (tmp[i] != NULL)
+      while (tmp[i] != NULL && i < MCP2517FD_BT_LEN)
       {
         tmp[++i] = strtok(NULL, ":");
       }
@@ -138,6 +166,19 @@ int main (int argc, char *argv[])
     case 'd'://run a deamon
       run_as_daemon = 0;
       break;
+    case 'b'://userspace bridge instead of the line discipline
+      if (!optarg)
+        bridge = BRIDGE_AUTO;
+      else if (!strcmp(optarg, "epoll"))
+        bridge = BRIDGE_EPOLL;
+      else if (!strcmp(optarg, "uring"))
+        bridge = BRIDGE_URING;
+      else
+      {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+      break;
     case 'v':// print version
       if (argc == 3)
       {
@@ -147,7 +188,7 @@ int main (int argc, char *argv[])
     case 'f':// CAN FD on
       can_fd = true;
       tmp[i] = strtok(optarg, ":");
-      while (tmp[i] != NULL)
+      while (tmp[i] != NULL && i < MCP2517FD_BT_LEN)
       {
         tmp[++i] = strtok(NULL, ":");
       }
@@ -157,12 +198,74 @@ int main (int argc, char *argv[])
     case 'c':// User defined CAND FD bittiming
       user_bittiming = true;
       tmp[i] = strtok(optarg, ":");
-      while (tmp[i] != NULL)
+      while (tmp[i] != NULL && i < MCP2517FD_BT_LEN)
       {
         tmp[++i] = strtok(NULL, ":");
       }
-      for (i = 0; i < 11; i++)
+      if (i != MCP2517FD_BT_LEN)
+        print_bittiming();
+      for (i = 0; i < MCP2517FD_BT_LEN; i++)
         user_speed[i] = strtoul(tmp[i], NULL, 10);
+      why = mcp2517fd_check(user_speed);
+      if (why)
+      {
+        fprintf(stderr, "-c: %s\n", why);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'r':// CAN FD bit rates and sample points, bittiming calculated
+      user_bittiming = true;
+      if (mcp2517fd_parse(user_speed, optarg, &why) < 0)
+      {
+        fprintf(stderr, "-r: %s\n", why);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'a':// RX/TX worker priority and CPU affinity
+      set_worker = true;
+      ldisc_opts = true;
+      tmp[i] = strtok(optarg, ":");
+      while (tmp[i] != NULL && i < MCP2517FD_BT_LEN)
+      {
+        tmp[++i] = strtok(NULL, ":");
+      }
+      worker.prio = atoi(tmp[0]);
+      if (tmp[1])
+        strncpy(worker.cpus, tmp[1], TRIPLE_CPULIST_LEN - 1);
+      break;
+    case 'i':// acceptance filter
+      if (ldisc_parse_filter(&ldisc_cfg, optarg) < 0)
+        print_usage(argv[0]);
+      ldisc_opts = true;
+      break;
+    case 'o':// change-only delivery
+      if (ldisc_parse_change(&ldisc_cfg, optarg) < 0)
+        print_usage(argv[0]);
+      ldisc_opts = true;
+      break;
+    case 'g':// channel to channel gateway
+      if (ldisc_parse_route(&ldisc_cfg, optarg) < 0)
+        print_usage(argv[0]);
+      ldisc_opts = true;
+      break;
+    case 'p':// periodic transmit
+      if (ldisc_parse_periodic(&ldisc_cfg, optarg) < 0)
+        print_usage(argv[0]);
+      ldisc_opts = true;
+      break;
+    case 'q':// driver TX queue order
+      if (ldisc_parse_txq(&ldisc_cfg, optarg) < 0)
+        print_usage(argv[0]);
+      ldisc_opts = true;
+      break;
+    case 'm':// per CAN id statistics
+      if (ldisc_parse_idstats(&ldisc_cfg, optarg) < 0)
+        print_usage(argv[0]);
+      ldisc_opts = true;
+      break;
+    case 'x':// exact bit stuffing in the driver's bus load
+      exact_stuffing = true;
+      ldisc_opts = true;
       break;
     case 'u':
       print_bittiming();
@@ -179,11 +282,23 @@ int main (int argc, char *argv[])
     i=0;
   }
 
+  /* the bridge runs without the line discipline, nothing would apply these */
+  if (bridge && ldisc_opts)
+  {
+    fprintf(stderr, "-a, -i, -o, -g, -p, -q, -m and -x configure the line discipline and do not work with -b\n");
+    exit(EXIT_FAILURE);
+  }
+
   /* Initialize the logging interface */
   openlog(DAEMON_NAME, LOG_PID, LOG_LOCAL5);
 
+  if (user_bittiming)
+    mcp2517fd_print(stderr, user_speed);
+
   /* Parse serial device name and optional can interface name */
   tty = argv[optind];
+  if (NULL == tty && user_bittiming)
+    exit(EXIT_SUCCESS);
   if (NULL == tty)
     print_usage(argv[0]);
   /*
@@ -262,11 +377,62 @@ int main (int argc, char *argv[])
   USB2CAN_TRIPLE_GetFWVersion(fd);
   sleep(2);
 
+  if (bridge)
+  {
+    if (run_as_daemon && daemon(0, 0))
+    {
+      syslog(LOG_ERR, "failed to daemonize");
+      exit(EXIT_FAILURE);
+    }
+
+    signal(SIGINT, child_handler);
+    signal(SIGTERM, child_handler);
+
+    tripled_running = 1;
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+    ret = BRIDGE_NO_URING;
+    if (bridge != BRIDGE_EPOLL)
+      ret = bridge_run_uring(fd, name, &tripled_running, &bridge_stats);
+    if (ret == BRIDGE_NO_URING && bridge == BRIDGE_URING)
+      syslog(LOG_ERR, "bridge: io_uring not available");
+    else if (ret == BRIDGE_NO_URING)
+      ret = bridge_run(fd, name, &tripled_running, &bridge_stats);
+    if (ret < 0)
+      exit_code = EXIT_FAILURE;
+    clock_gettime(CLOCK_MONOTONIC, &t_end);
+
+    elapsed = (t_end.tv_sec - t_start.tv_sec) + (t_end.tv_nsec - t_start.tv_nsec) / 1e9;
+    syslog(LOG_NOTICE, "bridge: %llu frames to CAN (%llu dropped), %llu to tty, %.0f frames/s, %.2f syscalls/frame",
+           bridge_stats.to_can, bridge_stats.to_can_dropped, bridge_stats.to_tty,
+           (bridge_stats.to_can + bridge_stats.to_tty) / (elapsed > 0 ? elapsed : 1),
+           (double) bridge_stats.syscalls / (bridge_stats.to_can + bridge_stats.to_tty + 1));
+    goto restore;
+  }
+
   if (ioctl(fd, TIOCSETD, &ldisc) < 0)
   {
     perror("ioctl TIOCSETD");
     exit(EXIT_FAILURE);
   }
+
+  if (set_worker && ioctl(fd, TRIPLE_IOCSWORKER, &worker) < 0)
+  {
+    perror("ioctl TRIPLE_IOCSWORKER");
+    exit(EXIT_FAILURE);
+  }
+
+  ldisc_set_bitrate(&ldisc_cfg, PORT_1, can_speed_bps(speed[PORT_1]), 0, exact_stuffing);
+  ldisc_set_bitrate(&ldisc_cfg, PORT_2, can_speed_bps(speed[PORT_2]), 0, exact_stuffing);
+  if (!user_bittiming)
+    can_fd_speed_bps(speed[PORT_3], &nominal_bps, &data_bps);
+  else
+  {
+    nominal_bps = mcp2517fd_bps(user_speed[NBRP], user_speed[NTSEG1], user_speed[NTSEG2]);
+    data_bps    = mcp2517fd_bps(user_speed[DBRP], user_speed[DTSEG1], user_speed[DTSEG2]);
+  }
+  ldisc_set_bitrate(&ldisc_cfg, PORT_3, nominal_bps, data_bps, exact_stuffing);
+
+  ldisc_cfg_apply(&ldisc_cfg, fd);
   /************* try to rename the created netdevice **************************************************/
   for (channel = 0; channel < 3; channel++)
   {
@@ -334,6 +500,7 @@ int main (int argc, char *argv[])
     exit(EXIT_FAILURE);
   }
 
+restore:
   /* Reset old rates */
   cfsetispeed(&tios, old_ispeed);
   cfsetospeed(&tios, old_ospeed);
@@ -392,86 +559,10 @@ static void child_handler (int signum)
 
 } /* END: child_handler() */
 
-static int look_up_can_speed (int speed)
-{
-  switch (speed)
-  {
-
-  case 0x01:   return SPEED_10k;
-  case 0x02:   return SPEED_20k;
-  case 0x03:   return SPEED_33_3k;
-  case 0x04:   return SPEED_50k;
-  case 0x05:   return SPEED_62_5k;
-  case 0x06:   return SPEED_83_3k;
-  case 0x07:   return SPEED_100k;
-  case 0x08:   return SPEED_125k;
-  case 0x09:   return SPEED_250k;
-  case 0x0A:   return SPEED_500k;
-  case 0x0B:   return SPEED_1M;
-
-  default:  return 250;
-  }
-}
-
-static int look_up_can_fd_speed (int speed)
-{
-  switch (speed)
-  {
-  //nominal 125
-  case 0x01:   return CAN_125K_250K;
-  case 0x02:   return CAN_125K_500K;
-  case 0x03:   return CAN_125K_833K;
-  case 0x04:   return CAN_125K_1M;
-  case 0x05:   return CAN_125K_1M5;
-  case 0x06:   return CAN_125K_2M;
-  case 0x07:   return CAN_125K_3M;
-  case 0x08:   return CAN_125K_4M;
-  case 0x09:   return CAN_125K_5M;
-  case 0x0A:   return CAN_125K_6M7;
-  case 0x0B:   return CAN_125K_8M;
-  case 0x0C:   return CAN_125K_10M;
-
-  case 0x11:   return CAN_250K_500K;
-  case 0x12:   return CAN_250K_833K;
-  case 0x13:   return CAN_250K_1M;
-  case 0x14:   return CAN_250K_1M5;
-  case 0x15:   return CAN_250K_2M;
-  case 0x16:   return CAN_250K_3M;
-  case 0x17:   return CAN_250K_4M;
-  case 0x18:   return CAN_250K_5M;
-  case 0x19:   return CAN_250K_6M7;
-  case 0x1A:   return CAN_250K_8M;
-  case 0x1B:   return CAN_250K_10M;
-
-  case 0x21:   return CAN_500K_833K;
-  case 0x22:   return CAN_500K_1M;
-  case 0x23:   return CAN_500K_1M5;
-  case 0x24:   return CAN_500K_2M;
-  case 0x25:   return CAN_500K_3M;
-  case 0x26:   return CAN_500K_4M;
-  case 0x27:   return CAN_500K_5M;
-  case 0x28:   return CAN_500K_6M7;
-  case 0x29:   return CAN_500K_8M;
-  case 0x2A:   return CAN_500K_10M;
-
-  case 0x31:   return CAN_1000K_1M5;
-  case 0x32:   return CAN_1000K_2M;
-  case 0x33:   return CAN_1000K_3M;
-  case 0x34:   return CAN_1000K_4M;
-  case 0x35:   return CAN_1000K_5M;
-  case 0x36:   return CAN_1000K_6M7;
-  case 0x37:   return CAN_1000K_8M;
-  case 0x38:   return CAN_1000K_10M;
-
-  default:  return 2501000;
-  }
-}
-
 static void print_bittiming()
 {
   fprintf(stderr, "For detailed information see MCP2517FD datasheet\n");
-  fprintf(stderr, "No validation is provided, so be careful !!\n");
-  fprintf(stderr, "You can find online calculators\n");
+  fprintf(stderr, "The values are checked against the register fields, -r calculates them from bit rates\n");
   fprintf(stderr, "<bittiming options> --> ./tripled_64 -c[NBRP]:[NTSEG1]:[NTSEG2]:[NSJW]:[DBRP]:[DTSEG1]:[DTSEG2]:[DSJW]:[TDCO]:[TDCV]:[TDCMOD]\n");
   fprintf(stderr, "Nominal bittiming\n");
   fprintf(stderr, "NBRP - Nominal Baud Rate Prescaler\n");
@@ -563,6 +654,8 @@ static void print_usage (char *prg)
 {
   fprintf(stderr, "\nUsage: %s [options] <tty>\\n\n", prg);
   fprintf(stderr, "         -d                          (stay in foreground; no daemonize)\n");
+  fprintf(stderr, "         -b[uring/epoll]             (bridge in userspace, no kernel module: ports <-> CAN netdevs named by -n, e.g. vcan;\n");
+  fprintf(stderr, "                                      io_uring loop when the kernel has it, else epoll)\n");
   fprintf(stderr, "         -h                          (show this help page)\n");
   fprintf(stderr, "         -v                          (show version info)\n");
   fprintf(stderr, "         -t                          (show supported CAN 2.0 and CAN FD speeds)\n");
@@ -572,10 +665,21 @@ static void print_usage (char *prg)
   fprintf(stderr, "         -l[1/0]:[1/0]:[1/0]         (listen-only mode )\n");
   fprintf(stderr, "         -f[1/0]:[1/0]               (CAN FD on port 3 -> [ESI]:[ISO_CRC]\n");
   fprintf(stderr, "         -c<bittiming options>       (User defined CAN FD bittiming, see ./tripled_64 -u)\n");
+  fprintf(stderr, "         -r[nominal][@sp]:[data][@sp] (CAN FD bit rates and sample points in %%, bittiming calculated;\n");
+  fprintf(stderr, "                                      e.g. -r500k@80:4M@75, without tty only prints the bittiming)\n");
+  fprintf(stderr, "         -a[prio]:[cpulist]          (RX/TX worker: SCHED_FIFO prio, 0 = normal; CPUs e.g. 2-3)\n");
+  fprintf(stderr, "         -i[port]:[id list]          (acceptance filter, e.g. -i1:100-1FF,7DF,18DAF110; repeatable)\n");
+  fprintf(stderr, "         -o[port]:[ms]:[id[/mask]]   (deliver id only on payload change or after ms, e.g. -o1:1000:100,7DF/FF00)\n");
+  fprintf(stderr, "         -g[src]:[dst]:[id[/mask][=newid]][:and] (in-driver gateway, e.g. -g1:2:100/7F0=200; repeatable)\n");
+  fprintf(stderr, "         -p[port]:[us]:[id#data]     (send frame every us microseconds, e.g. -p1:10000:123#DEADBEEF; repeatable)\n");
+  fprintf(stderr, "         -q[port]:[fifo/id][:us]     (driver TX queue order, id = bus arbitration order; drop frames queued longer than us)\n");
+  fprintf(stderr, "         -m[port][:slots]            (per CAN id statistics in debugfs, slots = EFF ids kept, power of 2, 16 - 65536; repeatable)\n");
+  fprintf(stderr, "         -x                          (bus load with bit stuffing counted per frame instead of worst case)\n");
   fprintf(stderr, "\nExamples:\n");
   fprintf(stderr, "tripled_64 -s1:2:3 /dev/ttyACM0\n");
   fprintf(stderr, "tripled_64 /dev/ttyACM0\n");
   fprintf(stderr, "tripled_64 dev/ttyACM0 -ncan0:can1:can2\n");
+  fprintf(stderr, "tripled_64 -b -nvcan0:vcan1:vcan2 /dev/ttyACM0\n");
   fprintf(stderr, "\n");
   exit(EXIT_FAILURE);
 
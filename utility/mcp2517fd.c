@@ -0,0 +1,251 @@
+/*
+ * mcp2517fd.c - bit timing calculator and check for the MCP2517FD
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mcp2517fd.h"
+
+#define  MCP2517FD_BRP_MAX          256
+#define  MCP2517FD_TQ_MIN           4
+#define  MCP2517FD_TDCO_MAX         63
+#define  MCP2517FD_TDCV_MAX         63
+#define  MCP2517FD_NOMINAL_MAX      1000000
+#define  MCP2517FD_DATA_MAX         10000000
+
+/* field sizes of CiNBTCFG and CiDBTCFG, in time quanta */
+typedef struct
+{
+  unsigned int  tseg1;
+  unsigned int  tseg2;
+  unsigned int  sjw;
+} MCP2517FD_LIMITS;
+
+static const MCP2517FD_LIMITS mcp2517fd_nominal = { 256, 128, 128 };
+static const MCP2517FD_LIMITS mcp2517fd_data    = { 32, 16, 16 };
+
+unsigned int mcp2517fd_bps (unsigned int brp, unsigned int tseg1, unsigned int tseg2)
+{
+  return MCP2517FD_SYSCLK / ((brp + 1) * (1 + (tseg1 + 1) + (tseg2 + 1)));
+}
+
+/*
+ * Prescaler and segments in time quanta for one phase. The closest bit
+ * rate wins, then the closest sample point, then the smaller prescaler:
+ * more quanta per bit and a short delay compensation offset.
+ */
+static int mcp2517fd_phase (const MCP2517FD_LIMITS *l, unsigned int bps, unsigned int sp,
+                            unsigned int *brp, unsigned int *tseg1, unsigned int *tseg2)
+{
+  double        best_err = -1;
+  double        best_sp = 0;
+  double        err;
+  double        sp_err;
+  unsigned int  b;
+  unsigned int  ntq;
+  unsigned int  t1;
+  unsigned int  t2;
+
+  for (b = 1; b <= MCP2517FD_BRP_MAX; b++)
+  {
+    ntq = (unsigned int) (((unsigned long long) MCP2517FD_SYSCLK + (unsigned long long) b * bps / 2) /
+                          ((unsigned long long) b * bps));
+    if (ntq < MCP2517FD_TQ_MIN || ntq > 1 + l->tseg1 + l->tseg2)
+      continue;
+
+    /* sync segment, then TSEG1 up to the sample point */
+    t1 = (sp * ntq + 500) / 1000;
+    t1 = t1 > 1 ? t1 - 1 : 1;
+    if (t1 > ntq - 2)
+      t1 = ntq - 2;
+    t2 = ntq - 1 - t1;
+    if (t2 > l->tseg2)
+    {
+      t2 = l->tseg2;
+      t1 = ntq - 1 - t2;
+    }
+    if (t1 > l->tseg1)
+      continue;
+
+    err    = fabs((double) MCP2517FD_SYSCLK / (b * ntq) - bps) / bps;
+    sp_err = fabs(1000.0 * (1 + t1) / ntq - sp);
+    if (best_err < 0 || err < best_err - 1e-9 || (err < best_err + 1e-9 && sp_err < best_sp - 1e-9))
+    {
+      best_err = err;
+      best_sp  = sp_err;
+      *brp     = b;
+      *tseg1   = t1;
+      *tseg2   = t2;
+    }
+  }
+
+  return best_err >= 0 && best_err <= MCP2517FD_MAX_ERR ? 0 : -1;
+}
+
+int mcp2517fd_calc (unsigned int bt[MCP2517FD_BT_LEN], unsigned int nominal_bps, unsigned int nominal_sp,
+                    unsigned int data_bps, unsigned int data_sp, const char **why)
+{
+  unsigned int brp;
+  unsigned int tseg1;
+  unsigned int tseg2;
+
+  if (!nominal_bps || nominal_bps > MCP2517FD_NOMINAL_MAX || data_bps > MCP2517FD_DATA_MAX ||
+      (data_bps && data_bps < nominal_bps))
+  {
+    *why = "bit rate out of range (nominal up to 1 Mbit/s, data up to 10 Mbit/s and not below nominal)";
+    return -1;
+  }
+  if (nominal_sp >= 1000 || data_sp >= 1000)
+  {
+    *why = "sample point must be below 100 %";
+    return -1;
+  }
+
+  if (!data_bps)
+    data_bps = nominal_bps;
+  if (!nominal_sp)
+    nominal_sp = nominal_bps < 1000000 ? 875 : 750;
+  if (!data_sp)
+    data_sp = 750;
+
+  if (mcp2517fd_phase(&mcp2517fd_nominal, nominal_bps, nominal_sp, &brp, &tseg1, &tseg2) < 0)
+  {
+    *why = "no nominal bit timing within 0.5 % of the bit rate";
+    return -1;
+  }
+  bt[NBRP]   = brp - 1;
+  bt[NTSEG1] = tseg1 - 1;
+  bt[NTSEG2] = tseg2 - 1;
+  bt[NSJW]   = (tseg2 < mcp2517fd_nominal.sjw ? tseg2 : mcp2517fd_nominal.sjw) - 1;
+
+  if (mcp2517fd_phase(&mcp2517fd_data, data_bps, data_sp, &brp, &tseg1, &tseg2) < 0)
+  {
+    *why = "no data bit timing within 0.5 % of the bit rate";
+    return -1;
+  }
+  bt[DBRP]   = brp - 1;
+  bt[DTSEG1] = tseg1 - 1;
+  bt[DTSEG2] = tseg2 - 1;
+  bt[DSJW]   = (tseg2 < mcp2517fd_data.sjw ? tseg2 : mcp2517fd_data.sjw) - 1;
+
+  /* the secondary sample point sits at the sample point, in SYSCLK cycles */
+  bt[TDCV] = 0;
+  if (data_bps > 1000000)
+  {
+    bt[TDCMOD] = TDCMOD_AUTO;
+    bt[TDCO]   = (1 + tseg1) * brp < MCP2517FD_TDCO_MAX ? (1 + tseg1) * brp : MCP2517FD_TDCO_MAX;
+  }
+  else
+  {
+    bt[TDCMOD] = TDCMOD_OFF;
+    bt[TDCO]   = 0;
+  }
+
+  *why = mcp2517fd_check(bt);
+  return *why ? -1 : 0;
+}
+
+/* "500k@87.5" -> bit/s and per mille */
+static int mcp2517fd_parse_phase (char *arg, unsigned int *bps, unsigned int *sp)
+{
+  char   *end;
+  double  v;
+
+  v = strtod(arg, &end);
+  if (end == arg || v <= 0)
+    return -1;
+  if (*end == 'k' || *end == 'K')
+  {
+    v *= 1e3;
+    end++;
+  }
+  else if (*end == 'M')
+  {
+    v *= 1e6;
+    end++;
+  }
+  *bps = (unsigned int) (v + 0.5);
+  *sp  = 0;
+
+  if (*end == '@')
+  {
+    arg = end + 1;
+    v   = strtod(arg, &end);
+    if (end == arg || v <= 0 || v >= 100)
+      return -1;
+    *sp = (unsigned int) (v * 10 + 0.5);
+  }
+
+  return *end ? -1 : 0;
+}
+
+int mcp2517fd_parse (unsigned int bt[MCP2517FD_BT_LEN], char *arg, const char **why)
+{
+  unsigned int  nominal_bps;
+  unsigned int  nominal_sp;
+  unsigned int  data_bps = 0;
+  unsigned int  data_sp = 0;
+  char         *data = strchr(arg, ':');
+
+  if (data)
+    *data++ = '\0';
+
+  if (mcp2517fd_parse_phase(arg, &nominal_bps, &nominal_sp) < 0 ||
+      (data && mcp2517fd_parse_phase(data, &data_bps, &data_sp) < 0))
+  {
+    *why = "expected <nominal>[@<sp %>][:<data>[@<sp %>]], e.g. 500k@80:4M@75";
+    return -1;
+  }
+
+  return mcp2517fd_calc(bt, nominal_bps, nominal_sp, data_bps, data_sp, why);
+}
+
+const char *mcp2517fd_check (const unsigned int bt[MCP2517FD_BT_LEN])
+{
+  if (bt[NBRP] >= MCP2517FD_BRP_MAX || bt[NTSEG1] >= mcp2517fd_nominal.tseg1 ||
+      bt[NTSEG2] >= mcp2517fd_nominal.tseg2 || bt[NSJW] >= mcp2517fd_nominal.sjw)
+    return "nominal value out of range (NBRP 0-255, NTSEG1 0-255, NTSEG2 0-127, NSJW 0-127)";
+  if (bt[DBRP] >= MCP2517FD_BRP_MAX || bt[DTSEG1] >= mcp2517fd_data.tseg1 ||
+      bt[DTSEG2] >= mcp2517fd_data.tseg2 || bt[DSJW] >= mcp2517fd_data.sjw)
+    return "data value out of range (DBRP 0-255, DTSEG1 0-31, DTSEG2 0-15, DSJW 0-15)";
+  if (bt[NSJW] > bt[NTSEG2] || bt[DSJW] > bt[DTSEG2])
+    return "SJW longer than TSEG2";
+  if (3 + bt[NTSEG1] + bt[NTSEG2] < MCP2517FD_TQ_MIN || 3 + bt[DTSEG1] + bt[DTSEG2] < MCP2517FD_TQ_MIN)
+    return "bit time shorter than 4 time quanta";
+  if (bt[TDCMOD] > TDCMOD_AUTO || bt[TDCO] > MCP2517FD_TDCO_MAX || bt[TDCV] > MCP2517FD_TDCV_MAX)
+    return "delay compensation out of range (TDCO 0-63, TDCV 0-63, TDCMOD 0-2)";
+  if (mcp2517fd_bps(bt[NBRP], bt[NTSEG1], bt[NTSEG2]) > MCP2517FD_NOMINAL_MAX)
+    return "nominal bit rate above 1 Mbit/s";
+  if (mcp2517fd_bps(bt[DBRP], bt[DTSEG1], bt[DTSEG2]) > MCP2517FD_DATA_MAX)
+    return "data bit rate above 10 Mbit/s";
+  if (mcp2517fd_bps(bt[DBRP], bt[DTSEG1], bt[DTSEG2]) < mcp2517fd_bps(bt[NBRP], bt[NTSEG1], bt[NTSEG2]))
+    return "data bit rate below the nominal one";
+
+  return NULL;
+}
+
+void mcp2517fd_print (FILE *f, const unsigned int bt[MCP2517FD_BT_LEN])
+{
+  static const char *tdc[] = { "off", "manual", "auto" };
+  unsigned int       n_tq = 3 + bt[NTSEG1] + bt[NTSEG2];
+  unsigned int       d_tq = 3 + bt[DTSEG1] + bt[DTSEG2];
+
+  fprintf(f, "nominal %u bit/s, %u tq of %u SYSCLK, sample point %.1f %%, SJW %u tq\n",
+          mcp2517fd_bps(bt[NBRP], bt[NTSEG1], bt[NTSEG2]), n_tq, bt[NBRP] + 1,
+          100.0 * (2 + bt[NTSEG1]) / n_tq, bt[NSJW] + 1);
+  fprintf(f, "data    %u bit/s, %u tq of %u SYSCLK, sample point %.1f %%, SJW %u tq\n",
+          mcp2517fd_bps(bt[DBRP], bt[DTSEG1], bt[DTSEG2]), d_tq, bt[DBRP] + 1,
+          100.0 * (2 + bt[DTSEG1]) / d_tq, bt[DSJW] + 1);
+  fprintf(f, "TDC     %s, offset %u, value %u\n", bt[TDCMOD] <= TDCMOD_AUTO ? tdc[bt[TDCMOD]] : "?",
+          bt[TDCO], bt[TDCV]);
+  fprintf(f, "-c%u:%u:%u:%u:%u:%u:%u:%u:%u:%u:%u\n", bt[NBRP], bt[NTSEG1], bt[NTSEG2], bt[NSJW],
+          bt[DBRP], bt[DTSEG1], bt[DTSEG2], bt[DSJW], bt[TDCO], bt[TDCV], bt[TDCMOD]);
+}
@@ -0,0 +1,217 @@
+/*
+ * triple_codec.c - Triple protocol CAN frames <-> byte stream in userspace
+ *
+ * Same wire format as the line discipline (TripleSendHex / TripleRecvHex):
+ *
+ *   FIRST, length, cmd, id[4] (big endian), dlc | flags, port | esi, data, LAST
+ *
+ * with every byte between the length and LAST escaped by U2C_TR_SPEC_BYTE
+ * when it equals one of the framing bytes.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <string.h>
+
+#include "triple_codec.h"
+
+void triple_decoder_init (TRIPLE_DECODER *d)
+{
+  memset(d, 0, sizeof(*d));
+}
+
+/* One complete unescaped frame in d->buf, 1 -> CAN frame in f */
+static int triple_decode_frame (TRIPLE_DECODER *d, TRIPLE_FRAME *f)
+{
+  unsigned char *p = d->buf;
+  unsigned char  flags;
+  bool           rtr;
+  int            len;
+  int            i;
+
+  if (d->count < 3)
+  {
+    d->errors++;
+    return 0;
+  }
+
+  if (p[2] != U2C_TR_CMD_TX_CAN && p[2] != U2C_TR_CMD_TX_CAN_TS)
+  {
+    d->other++;
+    return 0;
+  }
+
+  if (d->count < 10)
+  {
+    d->errors++;
+    return 0;
+  }
+
+  flags = p[7];
+  len   = USB2CAN_TRIPLE_CANFD_LengthFromDLC(flags & 0x0F);
+  rtr   = (flags & 0x40) && !(flags & 0x20);
+  if (9 + (rtr ? 0 : len) >= d->count || (p[8] & 0x0F) < 1 || (p[8] & 0x0F) > 3)
+  {
+    d->errors++;
+    return 0;
+  }
+
+  memset(f, 0, sizeof(*f));
+  f->channel   = (p[8] & 0x0F) - 1;
+  f->fd        = (flags & 0x20) != 0;
+  f->cf.can_id = ((canid_t) p[3] << 24) | ((canid_t) p[4] << 16) | ((canid_t) p[5] << 8) | p[6];
+
+  if (flags & 0x80)
+    f->cf.can_id = (f->cf.can_id & CAN_EFF_MASK) | CAN_EFF_FLAG;
+  else
+    f->cf.can_id &= CAN_SFF_MASK;
+
+  if (flags & 0x40)
+    f->cf.can_id |= CAN_RTR_FLAG;
+
+  if (f->fd)
+  {
+    if (flags & 0x10)
+      f->cf.flags |= CANFD_BRS;
+    if (p[8] & 0x80)
+      f->cf.flags |= CANFD_ESI;
+  }
+  else if (len > CAN_MAX_DLEN)
+    len = CAN_MAX_DLEN;
+
+  /* RTR frames keep their DLC but carry no data */
+  f->cf.len = len;
+  if (!rtr)
+  {
+    for (i = 0; i < len; i++)
+      f->cf.data[i] = p[9 + i];
+  }
+
+  d->frames++;
+  return 1;
+}
+
+/*
+ * Decode up to max CAN frames from n bytes. *used tells how many bytes were
+ * consumed; the rest has to be passed again once out has room. Partial
+ * frames stay in the decoder.
+ */
+int triple_decode (TRIPLE_DECODER *d, const unsigned char *in, int n, int *used, TRIPLE_FRAME *out, int max)
+{
+  unsigned char  s;
+  int            got = 0;
+  int            i;
+
+  for (i = 0; i < n && got < max; i++)
+  {
+    s = in[i];
+
+    if (d->len)
+    {
+      /* the length byte may well be FIRST, LAST or SPEC */
+      d->len = false;
+    }
+    else if (d->esc)
+    {
+      d->esc = false;
+    }
+    else if (s == U2C_TR_SPEC_BYTE)
+    {
+      d->esc = true;
+      continue;
+    }
+    else if (s == U2C_TR_FIRST_BYTE)
+    {
+      /* resync: a frame start drops whatever was not terminated */
+      if (d->count)
+        d->errors++;
+      d->count = 0;
+      d->skip  = false;
+      d->len   = true;
+    }
+    else if (s == U2C_TR_LAST_BYTE)
+    {
+      if (!d->skip && d->count < TRIPLE_MTU)
+      {
+        d->buf[d->count++] = s;
+        got += triple_decode_frame(d, &out[got]);
+      }
+      d->count = 0;
+      d->skip  = false;
+      continue;
+    }
+
+    if (d->skip)
+      continue;
+
+    if (d->count >= TRIPLE_MTU - 1)
+    {
+      d->errors++;
+      d->skip = true;
+      continue;
+    }
+
+    d->buf[d->count++] = s;
+  }
+
+  *used = i;
+  return got;
+}
+
+/* Encode one frame into p (TRIPLE_CODEC_MAX_FRAME bytes), returns the length */
+int triple_encode (unsigned char *p, const TRIPLE_FRAME *f)
+{
+  canid_t        id = f->cf.can_id;
+  unsigned char  dlc = 0;
+  int            len = f->cf.len;
+  int            length = 0;
+  int            i;
+
+  if (f->fd)
+  {
+    for (i = len; i <= DATA_FD_LEN && !USB2CAN_TRIPLE_CANFD_DLCFromLength(&dlc, i); i++)
+      ;
+    len = USB2CAN_TRIPLE_CANFD_LengthFromDLC(dlc);
+    dlc |= 0x20;
+    if (f->cf.flags & CANFD_BRS)
+      dlc |= 0x10;
+  }
+  else
+  {
+    if (len > CAN_MAX_DLEN)
+      len = CAN_MAX_DLEN;
+    USB2CAN_TRIPLE_CANFD_DLCFromLength(&dlc, len);
+  }
+
+  if (id & CAN_EFF_FLAG)
+  {
+    dlc |= 0x80;
+    id  &= CAN_EFF_MASK;
+  }
+  else
+    id &= CAN_SFF_MASK;
+
+  if (f->cf.can_id & CAN_RTR_FLAG)
+    dlc |= 0x40;
+
+  p[length++] = U2C_TR_FIRST_BYTE;
+  p[length++] = 1;
+  length += USB2CAN_TRIPLE_PushByte(U2C_TR_CMD_TX_CAN, p + length);
+  length += USB2CAN_TRIPLE_PushByte(id >> 24, p + length);
+  length += USB2CAN_TRIPLE_PushByte(id >> 16, p + length);
+  length += USB2CAN_TRIPLE_PushByte(id >> 8, p + length);
+  length += USB2CAN_TRIPLE_PushByte(id, p + length);
+  length += USB2CAN_TRIPLE_PushByte(dlc, p + length);
+  length += USB2CAN_TRIPLE_PushByte(f->channel + 1, p + length);
+
+  for (i = 0; i < len; i++)
+    length += USB2CAN_TRIPLE_PushByte(i < f->cf.len ? f->cf.data[i] : 0, p + length);
+
+  p[length++] = U2C_TR_LAST_BYTE;
+  p[1] = length;
+
+  return length;
+}
@@ -0,0 +1,112 @@
+/*
+ * triple_speed.c - port speed codes and their bit rates
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "triple_speed.h"
+
+int look_up_can_speed (int speed)
+{
+  switch (speed)
+  {
+
+  case 0x01:   return SPEED_10k;
+  case 0x02:   return SPEED_20k;
+  case 0x03:   return SPEED_33_3k;
+  case 0x04:   return SPEED_50k;
+  case 0x05:   return SPEED_62_5k;
+  case 0x06:   return SPEED_83_3k;
+  case 0x07:   return SPEED_100k;
+  case 0x08:   return SPEED_125k;
+  case 0x09:   return SPEED_250k;
+  case 0x0A:   return SPEED_500k;
+  case 0x0B:   return SPEED_1M;
+
+  default:  return 250;
+  }
+}
+
+int look_up_can_fd_speed (int speed)
+{
+  switch (speed)
+  {
+  //nominal 125
+  case 0x01:   return CAN_125K_250K;
+  case 0x02:   return CAN_125K_500K;
+  case 0x03:   return CAN_125K_833K;
+  case 0x04:   return CAN_125K_1M;
+  case 0x05:   return CAN_125K_1M5;
+  case 0x06:   return CAN_125K_2M;
+  case 0x07:   return CAN_125K_3M;
+  case 0x08:   return CAN_125K_4M;
+  case 0x09:   return CAN_125K_5M;
+  case 0x0A:   return CAN_125K_6M7;
+  case 0x0B:   return CAN_125K_8M;
+  case 0x0C:   return CAN_125K_10M;
+
+  case 0x11:   return CAN_250K_500K;
+  case 0x12:   return CAN_250K_833K;
+  case 0x13:   return CAN_250K_1M;
+  case 0x14:   return CAN_250K_1M5;
+  case 0x15:   return CAN_250K_2M;
+  case 0x16:   return CAN_250K_3M;
+  case 0x17:   return CAN_250K_4M;
+  case 0x18:   return CAN_250K_5M;
+  case 0x19:   return CAN_250K_6M7;
+  case 0x1A:   return CAN_250K_8M;
+  case 0x1B:   return CAN_250K_10M;
+
+  case 0x21:   return CAN_500K_833K;
+  case 0x22:   return CAN_500K_1M;
+  case 0x23:   return CAN_500K_1M5;
+  case 0x24:   return CAN_500K_2M;
+  case 0x25:   return CAN_500K_3M;
+  case 0x26:   return CAN_500K_4M;
+  case 0x27:   return CAN_500K_5M;
+  case 0x28:   return CAN_500K_6M7;
+  case 0x29:   return CAN_500K_8M;
+  case 0x2A:   return CAN_500K_10M;
+
+  case 0x31:   return CAN_1000K_1M5;
+  case 0x32:   return CAN_1000K_2M;
+  case 0x33:   return CAN_1000K_3M;
+  case 0x34:   return CAN_1000K_4M;
+  case 0x35:   return CAN_1000K_5M;
+  case 0x36:   return CAN_1000K_6M7;
+  case 0x37:   return CAN_1000K_8M;
+  case 0x38:   return CAN_1000K_10M;
+
+  default:  return 2501000;
+  }
+}
+
+/* bit/s of a CAN_SPEED value (kbit/s, 33/62/83 stand for 33.3/62.5/83.3) */
+unsigned int can_speed_bps (int speed)
+{
+  switch (speed)
+  {
+  case SPEED_33_3k:  return 33333;
+  case SPEED_62_5k:  return 62500;
+  case SPEED_83_3k:  return 83333;
+  default:           return speed * 1000;
+  }
+}
+
+/* CAN_FD_SPEED values are <nominal kbit/s><data kbit/s>, data with 3 or 4 digits */
+void can_fd_speed_bps (int speed, unsigned int *nominal, unsigned int *data)
+{
+  int split = speed >= 1000000 ? 10000 : 1000;
+
+  *nominal = (speed / split) * 1000;
+  switch (speed % split)
+  {
+  case 833:   *data = 833333;   break;
+  case 6700:  *data = 6666667;  break;
+  case 9999:  *data = 10000000; break;
+  default:    *data = (speed % split) * 1000; break;
+  }
+}